@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <map>
+
 #include "cnode.h"
 
 #define BUFSIZE 10000
@@ -19,6 +21,67 @@ int main(int argc, char **argv) {
   const std::size_t maxThreadpoolQueueSize = std::stoi(argv[3]);
   const std::size_t threadsCount = 4;
 
+  // optional arguments after the 6 required ones, by name (--journal=path)
+  // or by position in this order. "-" or a missing one - the default.
+  // Read before V8 takes its own flags out of argv
+  const std::vector<std::string> positional = {
+    "topology-aware", "journal", "datasets", "ready-isolates", "pool-min", "pool-max",
+    "isolate-mode", "hot-conv-replicas", "conv-contexts", "run-coalescing"
+  };
+  std::map<std::string, std::string> options;
+  for (int i = 7, position = 0; i < argc; i++) {
+    const std::string arg(argv[i]);
+    if (arg.compare(0, 2, "--") == 0) {
+      // a flag without a value is on, V8 flags are ignored here
+      const auto eq = arg.find('=');
+      if (eq == std::string::npos) {
+        options[arg.substr(2)] = "1";
+      } else {
+        options[arg.substr(2, eq - 2)] = arg.substr(eq + 1);
+      }
+    } else if (position < static_cast<int>(positional.size())) {
+      options[positional[position++]] = arg;
+    }
+  }
+  auto option = [&options](const std::string& name) {
+    const auto it = options.find(name);
+    return it == options.end() || it->second == "-" ? std::string() : it->second;
+  };
+  auto numberOption = [&option](const std::string& name) {
+    const auto value = option(name);
+    return value.empty() ? 0 : std::stoi(value);
+  };
+
+  // pool-min, pool-max: bounds of the elastic pool,
+  // it starts with threadsCount threads (isolates) clamped to them
+  PoolScaling scaling;
+  scaling.minThreads = numberOption("pool-min");
+  scaling.maxThreads = numberOption("pool-max");
+  const std::size_t maxThreadsCount = std::max(threadsCount, scaling.maxThreads);
+
+  // V8 background work (concurrent GC, compilation) runs on a separate
+  // low priority pool, so it does not compete with request threads
+  pb::V8Platform::Options platformOptions;
+  platformOptions.backgroundThreadsCount = 2;
+  platformOptions.backgroundNiceness = 10;
+
+  // topology-aware: 1 - pin workers to cores and keep every conv
+  // (its isolate and its jobs) within one NUMA node
+  std::shared_ptr<pb::Topology> topology;
+  if (numberOption("topology-aware") == 1) {
+    topology = std::make_shared<pb::Topology>(pb::Topology::detect());
+  }
+
+  // ready-isolates: start serving once that many isolates
+  // are created, the rest are created in background (0 - wait for all)
+  const std::size_t readyIsolates = numberOption("ready-isolates");
+
+  // isolate-mode: 1 - every pool thread owns an isolate
+  // and functions are compiled in all of them
+  const auto isolateMode = numberOption("isolate-mode") == 1
+    ? pb::V8Runner::THREAD_ISOLATES
+    : pb::V8Runner::CONV_ISOLATES;
+
   auto v8 = std::make_shared<pb::V8Runner>(
     argc,
     argv,
@@ -26,13 +89,68 @@ int main(int argc, char **argv) {
     maxExecutionTime,
     maxRAMAvailable,
     timeCheckerSleepTime,
-    threadsCount
+    threadsCount,
+    platformOptions,
+    topology,
+    readyIsolates,
+    isolateMode
   );
 
+  // hot-conv-replicas: max replicas of a hot conv (0 - off),
+  // conv mode only
+  if (!option("hot-conv-replicas").empty()) {
+    pb::V8Runner::HotConvs hotConvs;
+    hotConvs.maxReplicas = numberOption("hot-conv-replicas");
+    v8->setHotConvs(hotConvs);
+  }
+
+  // conv-contexts: 1 - every conv gets its own context (conv mode),
+  // set before the journal is replayed
+  if (numberOption("conv-contexts") == 1) {
+    v8->setConvContexts(true);
+  }
+
+  // journal: path to the compile/remove journal,
+  // functions are restored from it before we connect to Erlang
+  const auto journalPath = option("journal");
+  if (!journalPath.empty()) {
+    auto journal = v8->openJournal(journalPath);
+    std::cout << "journal: " << std::get<DATA>(journal) << std::endl;
+    if (std::get<ERR_CODE>(journal) != pb::V8Runner::STATUS::NO_ERR) {
+      return 1;
+    }
+  }
+
+  // datasets: directory of JSON datasets bound as frozen globals
+  const auto datasetsPath = option("datasets");
+  if (!datasetsPath.empty()) {
+    auto datasets = v8->loadDatasets(datasetsPath);
+    std::cout << "datasets: " << std::get<DATA>(datasets) << std::endl;
+    if (std::get<ERR_CODE>(datasets) != pb::V8Runner::STATUS::NO_ERR) {
+      return 1;
+    }
+  }
+
   const std::size_t maxDiffTime = 1000000; // milliseconds
 
-  ThreadPool pool(threadsCount, maxThreadpoolQueueSize);
-  auto cnode = std::make_shared<CNode>(v8, maxDiffTime, pool);
+  // cpus and nodes for every thread the pool may grow to
+  ThreadPool pool(
+    threadsCount,
+    maxThreadpoolQueueSize,
+    topology ? topology->workerCpus(maxThreadsCount) : std::vector<int>(),
+    0,
+    topology ? topology->workerNodes(maxThreadsCount) : std::vector<int>()
+  );
+  // runs (priority 0) are not starved by a deploy storm of compiles (priority 1):
+  // a job gains a priority level for every 100ms it waits
+  pool.setAging(100);
+
+  auto cnode = std::make_shared<CNode>(v8, maxDiffTime, pool, scaling);
+
+  // run-coalescing: 1 - identical runs in flight are executed once
+  if (numberOption("run-coalescing") == 1) {
+    cnode->setRunCoalescing(true);
+  }
 
   int fd = 0;
 
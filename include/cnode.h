@@ -3,7 +3,15 @@
 
 #include <memory>
 #include <unordered_map>
+#include <unordered_set>
 #include <functional>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <condition_variable>
 #include <string.h>
 #include <assert.h>
 
@@ -12,6 +20,8 @@
 
 #include "v8runner.h"
 #include "threadpool.h"
+#include "inlinetask.h"
+#include "inflightruns.h"
 
 typedef std::shared_ptr<ETERM> ETERMptr;
 typedef std::shared_ptr<char> CharPtr;
@@ -35,10 +45,24 @@ auto ErlFree = [](void* obj) {
   free(obj);
 };
 
+// the request terms are captured in place, queueing a job does not allocate
 typedef pb::concurrent::ThreadPool<
-  std::function<void(int)>
+  pb::concurrent::InlineTask<void(int)>
 > ThreadPool;
 
+// Elastic pool: isolates follow the amount of pool threads.
+// Every interval the pool grows by one thread when p99 of the queue wait
+// is above growQueueWaitUs, and shrinks by one when the average share of
+// busy threads is below shrinkBusyRatio and jobs do not wait.
+struct PoolScaling {
+  // 0 - fixed to the initial pool size
+  std::size_t minThreads = 0;
+  std::size_t maxThreads = 0;
+  std::size_t intervalMs = 5000;
+  std::size_t growQueueWaitUs = 10000;
+  double shrinkBusyRatio = 0.25;
+};
+
 class CNode {
 public:
   enum STATUS {
@@ -53,29 +77,87 @@ public:
   CNode(
     const std::shared_ptr<pb::V8Runner>& v8,
     const std::size_t& maxDiffTime,
-    ThreadPool& pool
+    ThreadPool& pool,
+    const PoolScaling& scaling = PoolScaling()
   );
+  ~CNode();
 
   void process(int fd, ErlMessage*& emsg);
+  // runKey is not empty for a coalesced run: its reply goes to the waiters too.
+  // Only a deadline of the caller's timeout (hasDeadline) caps the run
   void processV8(
     int fd,
     ETERMptr fromp,
     ETERMptr tuplep,
     ETERMptr func,
-    std::chrono::milliseconds timeWhenTaskHasBeenAdded,
+    std::chrono::steady_clock::time_point deadline,
+    bool hasDeadline,
+    const pb::RunKey& runKey,
     int threadNum
   );
+  // the job was dequeued after its deadline, the request is not decoded
+  void expireV8(
+    int fd,
+    ETERMptr fromp,
+    const pb::RunKey& runKey,
+    int threadNum
+  );
+
+  // a run identical (conv, node and input) to one in flight
+  // waits for its result instead of being executed again
+  void setRunCoalescing(const bool& enabled);
+  bool getRunCoalescing() const;
 
 private:
+  ETERMptr makeGCStatisticsTerm();
+
+  // to the caller and to runs coalesced with it
+  void sendReply(int fd, const ETERMptr& fromp, const ETERMptr& resp, const pb::RunKey& runKey);
+
+  void scalingFunc();
+  // called by the scaling thread only
+  void resizePool(const std::size_t& threadsCount);
+
   std::shared_ptr<pb::V8Runner> _v8;
   std::size_t _maxDiffTime;
   ThreadPool& _pool;
 
+  PoolScaling _scaling;
+  std::mutex _scalingMutex;
+  std::condition_variable _scalingVar;
+  // set_pool_size changed the bounds, apply them right away
+  bool _scalingChanged;
+  bool _scalingStop;
+  std::thread _scaler;
+
+  // single-flight runs: pids of duplicates which arrived while a run was in flight
+  std::atomic<bool> _runCoalescing;
+  pb::InFlightRuns<ETERMptr> _inFlightRuns;
+
   std::unordered_map<std::string, int> _priorityMap {
     {"check_code", 0},
     {"run", 0},
+    {"run_traced", 0},
     {"compile", 1},
+    {"compile_bulk", 1},
     {"remove", 1},
+    {"remove_conv", 1},
+    {"rollback", 1},
+    {"set_kept_versions", 1},
+    {"kv_put", 1},
+    {"kv_load_file", 1},
+    {"reload_datasets", 1},
+  };
+
+  // commands which carry conv id as the third element
+  const std::unordered_set<std::string> _convCommands {
+    "run",
+    "run_traced",
+    "compile",
+    "compile_bulk",
+    "remove",
+    "remove_conv",
+    "rollback",
   };
 };
 
@@ -0,0 +1,51 @@
+#ifndef PB_DATASETS_H
+#define PB_DATASETS_H
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <map>
+#include <cstdint>
+
+#include <experimental/filesystem>
+namespace fs = std::experimental::filesystem;
+
+namespace pb {
+
+  // Reference data preloaded from a directory of JSON files:
+  // `tariffs.json` becomes a deeply frozen global `tariffs` in every isolate.
+  //
+  // Files are read and validated here once per load, isolates parse
+  // a version into their context when they see it for the first time.
+  // A load replaces the whole set atomically, a bad file keeps the old one.
+  class Datasets {
+  public:
+
+    struct Version {
+      uint64_t version = 0;
+      // global name -> JSON text
+      std::map<std::string, std::string> files;
+    };
+
+    Datasets();
+
+    // throws std::runtime_error, returns new version
+    uint64_t load(const fs::path& dir);
+
+    // reload from the directory of the last load
+    uint64_t reload();
+
+    std::shared_ptr<const Version> current() const;
+
+  private:
+
+    std::shared_ptr<const Version> _current;
+
+    std::mutex _loadMutex;
+    fs::path _dir;
+  };
+
+}
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef CONCURRENT_HISTOGRAM_H
+#define CONCURRENT_HISTOGRAM_H
+
+#include <atomic>
+#include <array>
+#include <cstdint>
+
+namespace pb {
+namespace concurrent {
+
+  // Lock-free log2 histogram.
+  // Bucket 0 holds zero values, bucket i holds values in [2^(i-1), 2^i).
+  // Writers only do relaxed atomic increments, so it is safe to record
+  // from any thread (GC callbacks, pool workers) without a mutex.
+  class Histogram {
+  public:
+
+    static const std::size_t BUCKETS = 40;
+
+    struct Snapshot {
+      uint64_t count = 0;
+      uint64_t sum = 0;
+      uint64_t max = 0;
+      std::array<uint64_t, BUCKETS> buckets {};
+
+      void merge(const Snapshot& other) {
+        this->count += other.count;
+        this->sum += other.sum;
+        if (other.max > this->max) {
+          this->max = other.max;
+        }
+        for (std::size_t i = 0; i < BUCKETS; i++) {
+          this->buckets[i] += other.buckets[i];
+        }
+      }
+
+      // values recorded after `earlier` was taken, max is kept as is
+      Snapshot since(const Snapshot& earlier) const {
+        Snapshot res = *this;
+        res.count -= earlier.count;
+        res.sum -= earlier.sum;
+        for (std::size_t i = 0; i < BUCKETS; i++) {
+          res.buckets[i] -= earlier.buckets[i];
+        }
+        return res;
+      }
+
+      uint64_t mean() const {
+        return this->count ? this->sum / this->count : 0;
+      }
+
+      // upper bound of the bucket which contains the given percentile
+      uint64_t percentile(double p) const {
+        if (this->count == 0) {
+          return 0;
+        }
+
+        const uint64_t rank = static_cast<uint64_t>(p / 100.0 * this->count + 0.5);
+        uint64_t seen = 0;
+
+        for (std::size_t i = 0; i < BUCKETS; i++) {
+          seen += this->buckets[i];
+          if (seen >= rank && seen > 0) {
+            const uint64_t upper = i == 0 ? 0 : (uint64_t(1) << i) - 1;
+            return upper < this->max ? upper : this->max;
+          }
+        }
+
+        return this->max;
+      }
+    };
+
+    Histogram() {
+      this->reset();
+    }
+
+    Histogram(const Histogram&) = delete;
+    Histogram& operator=(const Histogram&) = delete;
+
+    void record(uint64_t value) {
+      this->buckets[Histogram::bucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+      this->count.fetch_add(1, std::memory_order_relaxed);
+      this->sum.fetch_add(value, std::memory_order_relaxed);
+
+      uint64_t prev = this->max.load(std::memory_order_relaxed);
+      while (prev < value &&
+             !this->max.compare_exchange_weak(prev, value, std::memory_order_relaxed));
+    }
+
+    Snapshot snapshot() const {
+      Snapshot res;
+      res.count = this->count.load(std::memory_order_relaxed);
+      res.sum = this->sum.load(std::memory_order_relaxed);
+      res.max = this->max.load(std::memory_order_relaxed);
+      for (std::size_t i = 0; i < BUCKETS; i++) {
+        res.buckets[i] = this->buckets[i].load(std::memory_order_relaxed);
+      }
+      return res;
+    }
+
+    void reset() {
+      for (auto& bucket: this->buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+      }
+      this->count.store(0, std::memory_order_relaxed);
+      this->sum.store(0, std::memory_order_relaxed);
+      this->max.store(0, std::memory_order_relaxed);
+    }
+
+  private:
+
+    static std::size_t bucketFor(uint64_t value) {
+      std::size_t bucket = 0;
+      while (value && bucket < BUCKETS - 1) {
+        value >>= 1;
+        bucket++;
+      }
+      return bucket;
+    }
+
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets;
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+  };
+
+} // namespace concurrent
+} // namespace pb
+
+#endif //CONCURRENT_HISTOGRAM_H
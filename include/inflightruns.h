@@ -0,0 +1,155 @@
+#ifndef PB_IN_FLIGHT_RUNS_H
+#define PB_IN_FLIGHT_RUNS_H
+
+#include <string_view>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <unordered_map>
+
+namespace pb {
+
+  // Conv, node and input of a run.
+  // It shares the decoded buffers instead of copying them, so a big input is
+  // not copied on the receive thread, and copies of a key only bump a counter.
+  // The hash is taken once, keys of equal hashes are compared in full.
+  class RunKey {
+  public:
+
+    typedef std::shared_ptr<const char> Buffer;
+
+    // empty: the run is not coalesced
+    RunKey() = default;
+
+    RunKey(const Buffer& conv, const Buffer& node, const Buffer& input):
+      _parts(std::make_shared<const Parts>(conv, node, input)) {}
+
+    bool empty() const {
+      return !this->_parts;
+    }
+
+    std::size_t hash() const {
+      return this->_parts ? this->_parts->hash : 0;
+    }
+
+    bool operator==(const RunKey& other) const {
+      if (this->_parts == other._parts) {
+        return true;
+      }
+      if (!this->_parts || !other._parts || this->_parts->hash != other._parts->hash) {
+        return false;
+      }
+      for (std::size_t i = 0; i < Parts::COUNT; i++) {
+        if (this->_parts->view(i) != other._parts->view(i)) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    struct Hash {
+      std::size_t operator()(const RunKey& key) const {
+        return key.hash();
+      }
+    };
+
+  private:
+
+    struct Parts {
+      static const std::size_t COUNT = 3;
+
+      Parts(const Buffer& conv, const Buffer& node, const Buffer& input):
+        buffers{conv, node, input}, hash(0) {
+        for (std::size_t i = 0; i < COUNT; i++) {
+          sizes[i] = strlen(buffers[i].get());
+          // boost::hash_combine
+          hash ^= std::hash<std::string_view>()(view(i)) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        }
+      }
+
+      std::string_view view(std::size_t i) const {
+        return std::string_view(buffers[i].get(), sizes[i]);
+      }
+
+      Buffer buffers[COUNT];
+      std::size_t sizes[COUNT];
+      std::size_t hash;
+    };
+
+    std::shared_ptr<const Parts> _parts;
+  };
+
+  // Single-flight runs: a run identical to one in flight waits for its
+  // result instead of being executed again.
+  // The first run of a key is executed by the caller, which completes it
+  // and sends its result to the waiters attached meanwhile.
+  template <typename Waiter>
+  class InFlightRuns {
+  public:
+
+    struct Statistics {
+      // attached runs and the ones which got the result of another run
+      uint64_t runs = 0;
+      uint64_t coalesced = 0;
+    };
+
+    InFlightRuns(): _runs(0), _coalesced(0) {}
+
+    // true: the first run of the key, the caller executes it and must
+    // complete it. false: the waiter is attached to the run in flight
+    bool attach(const RunKey& key, const Waiter& waiter) {
+      this->_runs++;
+
+      std::lock_guard<std::mutex> guard(this->_mutex);
+      auto inFlight = this->_waiters.find(key);
+      if (inFlight != this->_waiters.end()) {
+        inFlight->second.push_back(waiter);
+        this->_coalesced++;
+        return false;
+      }
+      this->_waiters.emplace(key, std::vector<Waiter>());
+      return true;
+    }
+
+    // the run is done (or was not queued at all), a run of the key
+    // which comes after this is executed again. Returns its waiters
+    std::vector<Waiter> complete(const RunKey& key) {
+      std::vector<Waiter> waiters;
+
+      std::lock_guard<std::mutex> guard(this->_mutex);
+      auto inFlight = this->_waiters.find(key);
+      if (inFlight != this->_waiters.end()) {
+        waiters.swap(inFlight->second);
+        this->_waiters.erase(inFlight);
+      }
+      return waiters;
+    }
+
+    // amount of keys in flight
+    std::size_t size() const {
+      std::lock_guard<std::mutex> guard(this->_mutex);
+      return this->_waiters.size();
+    }
+
+    Statistics statistics() const {
+      Statistics stats;
+      stats.runs = this->_runs;
+      stats.coalesced = this->_coalesced;
+      return stats;
+    }
+
+  private:
+
+    mutable std::mutex _mutex;
+    std::unordered_map<RunKey, std::vector<Waiter>, RunKey::Hash> _waiters;
+
+    std::atomic<uint64_t> _runs;
+    std::atomic<uint64_t> _coalesced;
+  };
+
+}
+
+#endif
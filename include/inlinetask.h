@@ -0,0 +1,109 @@
+#ifndef CONCURRENT_INLINE_TASK_H
+#define CONCURRENT_INLINE_TASK_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace pb {
+namespace concurrent {
+
+  // Move-only callable with inline storage.
+  // A callable of up to Capacity bytes is kept in place, so making, moving
+  // and calling a task never allocates (a bigger one does not compile).
+  // Unlike std::function it takes move-only captures, e.g. unique_ptr.
+  template <typename Signature, std::size_t Capacity = 128>
+  class InlineTask;
+
+  template <typename R, typename... Args, std::size_t Capacity>
+  class InlineTask<R(Args...), Capacity> {
+  public:
+
+    InlineTask() noexcept : invoke(nullptr), manage(nullptr) {}
+
+    template <typename F, typename = typename std::enable_if<
+      !std::is_same<typename std::decay<F>::type, InlineTask>::value
+    >::type>
+    InlineTask(F&& f) {
+      typedef typename std::decay<F>::type Callable;
+
+      static_assert(sizeof(Callable) <= Capacity,
+                    "the callable does not fit into the task, capture less or raise Capacity");
+      static_assert(alignof(Callable) <= alignof(std::max_align_t),
+                    "over-aligned callables are not supported");
+      static_assert(std::is_nothrow_move_constructible<Callable>::value,
+                    "tasks are moved between queues, the callable must not throw on move");
+
+      new (&this->storage) Callable(std::forward<F>(f));
+
+      this->invoke = [](void* storage, Args... args) -> R {
+        return (*static_cast<Callable*>(storage))(std::forward<Args>(args)...);
+      };
+
+      // moves the callable to `to` (if any) and destroys it at `from`
+      this->manage = [](void* to, void* from) {
+        auto callable = static_cast<Callable*>(from);
+        if (to) {
+          new (to) Callable(std::move(*callable));
+        }
+        callable->~Callable();
+      };
+    }
+
+    InlineTask(InlineTask&& other) noexcept : InlineTask() {
+      this->take(other);
+    }
+
+    InlineTask& operator=(InlineTask&& other) noexcept {
+      if (this != &other) {
+        this->reset();
+        this->take(other);
+      }
+      return *this;
+    }
+
+    InlineTask(const InlineTask&) = delete;
+    InlineTask& operator=(const InlineTask&) = delete;
+
+    ~InlineTask() {
+      this->reset();
+    }
+
+    explicit operator bool() const noexcept {
+      return this->invoke != nullptr;
+    }
+
+    R operator()(Args... args) {
+      return this->invoke(&this->storage, std::forward<Args>(args)...);
+    }
+
+  private:
+
+    void take(InlineTask& other) noexcept {
+      if (other.manage) {
+        other.manage(&this->storage, &other.storage);
+      }
+      this->invoke = other.invoke;
+      this->manage = other.manage;
+      other.invoke = nullptr;
+      other.manage = nullptr;
+    }
+
+    void reset() noexcept {
+      if (this->manage) {
+        this->manage(nullptr, &this->storage);
+      }
+      this->invoke = nullptr;
+      this->manage = nullptr;
+    }
+
+    typename std::aligned_storage<Capacity, alignof(std::max_align_t)>::type storage;
+    R (*invoke)(void*, Args...);
+    void (*manage)(void*, void*);
+  };
+
+} // namespace concurrent
+} // namespace pb
+
+#endif //CONCURRENT_INLINE_TASK_H
@@ -0,0 +1,121 @@
+#ifndef PB_JOURNAL_H
+#define PB_JOURNAL_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <unordered_set>
+
+#include <experimental/filesystem>
+namespace fs = std::experimental::filesystem;
+
+namespace pb {
+
+  // Append-only log of compile/remove commands, used to restore compiled
+  // functions after restart without Erlang resending every compile.
+  //
+  // Every record is: type (1 byte), then length-prefixed conv, node,
+  // source and V8 code cache (the last two are empty for remove).
+  // A truncated record at the tail (crash during write) is ignored.
+  //
+  // Appends are queued and written (and flushed) in order by a background
+  // thread, which also compacts the file, so callers never wait for the disk.
+  // A failed write keeps its records queued: the file is rebuilt from what
+  // it holds plus them on the next append, a failed compaction keeps the old file.
+  class Journal {
+  public:
+
+    struct Entry {
+      std::string conv;
+      std::string node;
+      std::string src;
+      std::string codeCache;
+    };
+
+    // compaction starts when the file holds this many records
+    // more than twice the amount of live pairs
+    static const std::size_t COMPACT_MIN_RECORDS = 10000;
+
+    explicit Journal(const fs::path& path);
+    // writes what is queued
+    ~Journal();
+
+    // live entries (compiled and not removed afterwards), compacts the file
+    // and starts the writer. Throws if the journal can not be rewritten
+    std::vector<Entry> open();
+
+    void appendCompile(const std::string& conv,
+                       const std::string& node,
+                       const std::string& src,
+                       const std::string& codeCache);
+
+    void appendRemove(const std::string& conv, const std::string& node);
+
+    // wait for the writer to handle everything appended so far
+    void sync();
+
+    std::size_t liveCount();
+    std::size_t compactionsCount();
+
+  private:
+
+    enum RECORD_TYPE {
+      COMPILE = 1,
+      REMOVE = 2
+    };
+
+    struct Record {
+      RECORD_TYPE type;
+      Entry entry;
+    };
+
+    void _append(Record&& record);
+    void _writerFunc();
+
+    // the rest is called by the writer (or open) under _fileMutex
+    void _write(std::deque<Record>& records);
+    void _maybeCompact();
+    // live entries of the file and then of the records
+    std::vector<Entry> _load(const std::deque<Record>& records = std::deque<Record>());
+    // replace the file with the entries, _out must be closed.
+    // Throws and keeps the old file on failure
+    void _rewrite(const std::vector<Entry>& entries);
+
+    static void _writeRecord(std::ofstream& out, RECORD_TYPE type, const Entry& entry);
+    static void _writeField(std::ofstream& out, const std::string& field);
+    static bool _readField(std::ifstream& in, std::string& field);
+    // fsync of a file or a directory
+    static bool _sync(const fs::path& path);
+    static std::string _key(const std::string& conv, const std::string& node);
+
+    fs::path _path;
+
+    // queue of the writer
+    std::mutex _mutex;
+    std::condition_variable _queuedVar;
+    std::condition_variable _writtenVar;
+    std::deque<Record> _queue;
+    uint64_t _appended;
+    uint64_t _written;
+    bool _stop;
+    std::thread _writer;
+
+    std::mutex _fileMutex;
+    std::ofstream _out;
+    // records of a failed write, in front of the next ones
+    std::deque<Record> _pending;
+    std::size_t _records;
+    // no compaction till the file holds this many records (after a failed one)
+    std::size_t _compactAfter;
+    std::size_t _compactions;
+    std::unordered_set<std::string> _liveKeys;
+  };
+
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef PB_KV_STORE_H
+#define PB_KV_STORE_H
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <unordered_map>
+
+namespace pb {
+
+  // Process-wide read-mostly key-value store for lookup tables
+  // (tariffs, dictionaries) which functions read through kv.get(ns, key).
+  //
+  // Values are kept as JSON text and parsed only when a function asks
+  // for the key. Every update builds a new immutable snapshot and
+  // publishes it with an atomic pointer swap: readers never block
+  // writers and always see a whole version.
+  class KVStore {
+  public:
+
+    // key -> JSON value
+    typedef std::unordered_map<std::string, std::string> Namespace;
+
+    struct Snapshot {
+      uint64_t version = 0;
+      std::unordered_map<std::string, std::shared_ptr<const Namespace>> namespaces;
+
+      const std::string* get(const std::string& ns, const std::string& key) const;
+    };
+
+    KVStore();
+
+    std::shared_ptr<const Snapshot> snapshot() const;
+    uint64_t version() const;
+
+    // throws std::invalid_argument if value is not JSON, returns new version.
+    // Copies the namespace, so bulk data should go through loadFile
+    uint64_t put(const std::string& ns, const std::string& key, const std::string& value);
+
+    // replace the namespace with the top level object of a JSON file,
+    // throws std::runtime_error, returns new version
+    uint64_t loadFile(const std::string& ns, const std::string& path);
+
+    uint64_t removeNamespace(const std::string& ns);
+
+  private:
+
+    uint64_t _publish(const std::string& ns, std::shared_ptr<const Namespace> values);
+
+    std::shared_ptr<const Snapshot> _snapshot;
+
+    // serializes writers only
+    std::mutex _writeMutex;
+  };
+
+}
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef PB_LIB_CACHE_H
+#define PB_LIB_CACHE_H
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+
+#include <experimental/filesystem>
+namespace fs = std::experimental::filesystem;
+
+namespace pb {
+
+  // Libraries for require(), read once from the libs directory and shared
+  // by all isolates.
+  //
+  // A library is keyed by its directory and file name ("libs/moment.js").
+  // The set of files is an immutable snapshot swapped atomically,
+  // so require() never waits for disk: files are read before the swap.
+  //
+  // watch() starts an inotify thread which reloads a library when it is
+  // written or moved into the directory. Bytes of a library are owned by
+  // the cache, not mapped: V8 reads them in place (external strings) while
+  // the file may be rewritten or truncated. Still update libraries by
+  // writing a new file and renaming it over the old one, a reload during
+  // an in-place write may read a half written file.
+  class LibCache {
+  public:
+
+    class File {
+    public:
+      // throws std::runtime_error
+      explicit File(const fs::path& path);
+
+      File(const File&) = delete;
+      File& operator=(const File&) = delete;
+
+      const char* data() const { return this->_data.data(); }
+      std::size_t size() const { return this->_data.size(); }
+
+      // pure ASCII: V8 can use the bytes as an external one-byte string
+      bool isOneByte() const { return this->_oneByte; }
+
+    private:
+      std::string _data;
+      bool _oneByte;
+    };
+
+    typedef std::unordered_map<std::string, std::shared_ptr<const File>> Files;
+
+    LibCache();
+    ~LibCache();
+
+    // read every .js file of the directory (recursively) on all cores,
+    // returns their amount
+    std::size_t load(const fs::path& dir);
+
+    // read one library again by its key, throws std::runtime_error
+    void reload(const std::string& name);
+
+    // nullptr if there is no such library
+    std::shared_ptr<const File> get(const std::string& name) const;
+
+    // current snapshot of all libraries
+    std::shared_ptr<const Files> files() const;
+
+    // start/stop the inotify watcher of the loaded directory
+    bool watch();
+    void stopWatching();
+
+    static std::string key(const fs::path& path);
+
+  private:
+
+    void _publish(const std::string& name, const std::shared_ptr<const File>& file);
+    void _addWatches(const fs::path& dir);
+    void _watchFunc();
+
+    std::shared_ptr<const Files> _files;
+
+    // serializes writers only
+    std::mutex _writeMutex;
+    fs::path _dir;
+
+    int _inotifyFd;
+    std::unordered_map<int, fs::path> _watches;
+    std::atomic<bool> _watching;
+    std::thread _watcher;
+  };
+
+}
+
+#endif
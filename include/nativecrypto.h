@@ -0,0 +1,86 @@
+#ifndef PB_NATIVE_CRYPTO_H
+#define PB_NATIVE_CRYPTO_H
+
+#include <string>
+#include <cstdint>
+
+#include <v8.h>
+
+namespace pb {
+
+  // Native hashing, encoding and uuid modules for user functions,
+  // so they do not implement md5/base64/uuid in JS or require libs for it.
+  //
+  //   hash.md5(data[, enc])
+  //   hash.sha1(data[, enc])
+  //   hash.sha256(data[, enc])
+  //   hash.hmac(alg, key, data[, enc])    - alg is md5, sha1 or sha256
+  //   hash.crc32(data)                     - unsigned number
+  //
+  //   encoding.base64Encode(data)
+  //   encoding.base64Decode(str[, enc])
+  //   encoding.hexEncode(data)
+  //   encoding.hexDecode(str[, enc])
+  //
+  //   uuid.v4()
+  //   uuid.v7()                            - time ordered
+  //
+  // data is a string (hashed as utf-8) or an ArrayBuffer / typed array,
+  // which is read in place. enc of the result is hex (digests) or
+  // utf8 (decoded data) by default, "base64" or "buffer" for an ArrayBuffer.
+  //
+  // Digests and hmac use OpenSSL, which picks SHA-NI/AVX2 code at runtime,
+  // crc32 uses zlib.
+  class NativeCrypto {
+  public:
+
+    // add `hash`, `encoding` and `uuid` objects to the global template
+    static void install(v8::Isolate* isolate, v8::Local<v8::ObjectTemplate> global);
+
+    static std::string base64Encode(const uint8_t* data, std::size_t size);
+    static bool base64Decode(const char* data, std::size_t size, std::string& res);
+    static std::string hexEncode(const uint8_t* data, std::size_t size);
+    static bool hexDecode(const char* data, std::size_t size, std::string& res);
+    // false if there are no random bytes
+    static bool uuid(int version, std::string& res);
+
+  private:
+
+    // bytes of a string or an ArrayBuffer(View) argument, without a copy for buffers
+    class Bytes {
+    public:
+      bool read(v8::Local<v8::Value> value);
+      const uint8_t* data() const { return this->_data; }
+      std::size_t size() const { return this->_size; }
+    private:
+      std::string _str;
+      const uint8_t* _data = nullptr;
+      std::size_t _size = 0;
+    };
+
+    static void _md5(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void _sha1(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void _sha256(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void _hmac(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void _crc32(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void _base64Encode(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void _base64Decode(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void _hexEncode(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void _hexDecode(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void _uuidV4(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void _uuidV7(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+    static void _digest(const v8::FunctionCallbackInfo<v8::Value>& args, const char* alg);
+    static void _setResult(const v8::FunctionCallbackInfo<v8::Value>& args,
+                           const uint8_t* data,
+                           std::size_t size,
+                           const std::string& enc);
+    static std::string _stringArg(const v8::FunctionCallbackInfo<v8::Value>& args,
+                                  int i,
+                                  const std::string& defaultValue);
+    static void _throw(v8::Isolate* isolate, const std::string& message);
+  };
+
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef PB_NATIVE_DATE_H
+#define PB_NATIVE_DATE_H
+
+#include <string>
+#include <memory>
+#include <unordered_map>
+
+#include <v8.h>
+
+#include <unicode/smpdtfmt.h>
+#include <unicode/calendar.h>
+#include <unicode/timezone.h>
+
+namespace pb {
+
+  // Native `date` module for user functions, backed by ICU,
+  // so they do not need require('libs/moment.js') to work with dates.
+  // Dates are numbers (milliseconds since epoch, as Date.now()).
+  //
+  //   date.now()
+  //   date.parse(str[, pattern[, tz]])
+  //   date.format(ms[, pattern[, tz[, locale]]])
+  //   date.add(ms, amount, unit[, tz])
+  //   date.diff(ms1, ms2, unit[, tz])    - whole units between ms2 and ms1
+  //   date.startOf(ms, unit[, tz])
+  //   date.offset(ms, tz)                - UTC offset of tz in minutes
+  //
+  // pattern is ICU (SimpleDateFormat) pattern, ISO 8601 by default,
+  // tz is an Olson id ("Europe/Kiev"), UTC by default,
+  // unit is one of years/months/weeks/days/hours/minutes/seconds/milliseconds
+  // or moment's short forms (y, M, w, d, h, m, s, ms).
+  class NativeDate {
+  public:
+
+    // ICU objects are not thread safe, but an isolate is used by one
+    // thread at a time, so every isolate gets its own cache
+    class Cache {
+    public:
+      icu::SimpleDateFormat* formatter(const std::string& pattern,
+                                       const std::string& tz,
+                                       const std::string& locale,
+                                       UErrorCode& status);
+      icu::Calendar* calendar(const std::string& tz, UErrorCode& status);
+      const icu::TimeZone* timeZone(const std::string& tz, UErrorCode& status);
+
+    private:
+      // cached objects are dropped all together when there are too many
+      static const std::size_t MAX_SIZE = 256;
+
+      std::unordered_map<std::string, std::unique_ptr<icu::SimpleDateFormat>> _formatters;
+      std::unordered_map<std::string, std::unique_ptr<icu::Calendar>> _calendars;
+      std::unordered_map<std::string, std::unique_ptr<icu::TimeZone>> _timeZones;
+    };
+
+    // add `date` object to the global template,
+    // the cache must outlive contexts created from the template
+    static void install(v8::Isolate* isolate,
+                        v8::Local<v8::ObjectTemplate> global,
+                        Cache* cache);
+
+  private:
+
+    static void _now(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void _parse(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void _format(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void _add(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void _diff(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void _startOf(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void _offset(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+    static Cache* _cache(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static std::string _stringArg(const v8::FunctionCallbackInfo<v8::Value>& args,
+                                  int i,
+                                  const std::string& defaultValue);
+    static bool _numberArg(const v8::FunctionCallbackInfo<v8::Value>& args, int i, double& value);
+    static bool _unit(const std::string& name, UCalendarDateFields& field);
+    static void _throw(v8::Isolate* isolate, const std::string& message);
+  };
+
+}
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef PB_RESULT_CACHE_H
+#define PB_RESULT_CACHE_H
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <vector>
+#include <unordered_map>
+
+namespace pb {
+
+  // Results of pure functions by their input, for pairs which opted in.
+  //
+  // An entry is keyed by (conv, node, input). The key is hashed once to pick
+  // a shard, every shard is an LRU list with its own mutex and its share of
+  // the memory budget, so runs of different inputs rarely wait for each other.
+  // Entries of a pair are dropped when it is compiled again or removed.
+  class ResultCache {
+  public:
+
+    struct Statistics {
+      uint64_t hits = 0;
+      uint64_t misses = 0;
+      uint64_t evictions = 0;
+      uint64_t expired = 0;
+      std::size_t entries = 0;
+      std::size_t bytes = 0;
+      std::size_t budgetBytes = 0;
+    };
+
+    explicit ResultCache(const std::size_t& budgetBytes = 64 * 1024 * 1024,
+                         const std::size_t& shardsCount = 16);
+
+    // ttlMs: 0 - entries live until they are evicted or invalidated
+    void enable(const std::string& conv, const std::string& node, const std::size_t& ttlMs);
+    // and drop entries of the pair
+    void disable(const std::string& conv, const std::string& node);
+    bool enabled(const std::string& conv, const std::string& node) const;
+    // amount of opted-in pairs, lock-free
+    std::size_t pairsCount() const;
+
+    // false on a miss (or if the pair did not opt in)
+    bool get(const std::string& conv, const std::string& node, const std::string& input, std::string& result);
+    void put(const std::string& conv, const std::string& node, const std::string& input, const std::string& result);
+
+    // drop entries of the pair, it keeps its opt-in
+    void invalidate(const std::string& conv, const std::string& node);
+    void clear();
+
+    // entries over the new budget are evicted right away
+    void setBudget(const std::size_t& budgetBytes);
+    Statistics statistics() const;
+
+  private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Entry {
+      // conv \0 node \0 input
+      std::string key;
+      std::string result;
+      Clock::time_point expiresAt;
+      std::size_t bytes;
+    };
+
+    struct Shard {
+      std::mutex mutex;
+      // the most recently used first
+      std::list<Entry> lru;
+      // views into keys of the entries
+      std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+      std::size_t bytes = 0;
+    };
+
+    static std::string _pairKey(const std::string& conv, const std::string& node);
+    static std::string _key(const std::string& conv, const std::string& node, const std::string& input);
+
+    Shard& _shard(const std::string& key);
+    // called under the shard mutex
+    void _erase(Shard& shard, std::list<Entry>::iterator it);
+    void _evict(Shard& shard, const std::size_t& budget);
+    void _invalidate(const std::string& prefix);
+
+    std::vector<std::unique_ptr<Shard>> _shards;
+    std::atomic<std::size_t> _budgetBytes;
+
+    // pair -> ttl (ms), read by every run of a process with opted-in pairs
+    mutable std::shared_mutex _pairsMutex;
+    std::unordered_map<std::string, std::size_t> _pairs;
+    std::atomic<std::size_t> _pairsCount;
+
+    std::atomic<uint64_t> _hits;
+    std::atomic<uint64_t> _misses;
+    std::atomic<uint64_t> _evictions;
+    std::atomic<uint64_t> _expired;
+  };
+
+}
+
+#endif
@@ -7,20 +7,97 @@
 #include <vector>
 #include <list>
 #include <queue>
+#include <map>
 #include <functional>
 #include <condition_variable>
+#include <shared_mutex>
 #include <atomic>
 #include <memory>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "histogram.h"
 
 namespace pb {
 namespace concurrent {
 
+  // Jobs are spread over shards (one per worker slot), every shard has a
+  // queue per priority level under its own mutex, so submits and dequeues of
+  // different shards do not contend.
+  // Within a level jobs go by the earliest deadline, then first in first out.
+  // With aging a job gains a level for every agingMs it waits, so a stream
+  // of high priority jobs can not starve the lower levels.
+  // Every shard publishes the job it would give next. A worker takes the
+  // most urgent of them by the same rules (aged priority, then deadline, then
+  // the time it was queued), so the order holds across shards, not only
+  // within one. Its own shard wins only a full tie, so it steals only when
+  // its own shard has nothing as urgent.
   template <typename F>
   class ThreadPool {
 
+    struct QueueItem {
+      int group;
+      // order of the submit within the shard
+      uint64_t seq;
+      std::chrono::steady_clock::time_point queued;
+      std::chrono::steady_clock::time_point deadline;
+      F job;
+      F expired;
+    };
+
+    // the top is the earliest deadline, then the first queued
+    struct QueueItemCompare {
+      bool operator()(const QueueItem& n1, const QueueItem& n2) const {
+        if (n1.deadline != n2.deadline) {
+          return n1.deadline > n2.deadline;
+        }
+        return n1.seq > n2.seq;
+      }
+    };
+
+    // a heap over a vector: the top is moved out, not copied (jobs may be
+    // move-only), and a warmed up level keeps its capacity, so it does not allocate
+    struct Level {
+      std::vector<QueueItem> queue;
+      pb::concurrent::Histogram waitUs;
+    };
+
+    // a cache line each, workers of neighbour shards do not share one
+    struct alignas(64) Shard {
+      std::mutex mutex;
+      // by priority, empty levels are kept
+      std::map<int, Level> levels;
+      uint64_t seq = 0;
+      // read without the mutex to pick a shard
+      std::atomic<std::size_t> size {0};
+      // the job pop would take: its priority, deadline and queued time
+      // (ns of steady_clock), published under the mutex, read without it
+      std::atomic<int> topPriority {0};
+      std::atomic<int64_t> topDeadline {0};
+      std::atomic<int64_t> topQueued {0};
+      // group of the worker with the same number, -1 - none
+      int group = -1;
+    };
+
+    // attempts to find a job before a worker parks, adapted per worker
+    static constexpr std::size_t MIN_SPINS = 16;
+    static constexpr std::size_t MAX_SPINS = 1024;
+
     void process(const std::size_t& threadNum) {
-      while(!this->stop) {
-        auto job = next_job();
+      std::size_t spins = MIN_SPINS;
+
+      while(!this->stop && !this->retired(threadNum)) {
+        F job;
+        if (!this->next_job(threadNum, spins, job)) {
+          continue;
+        }
         this->busyThreads += 1;
         job(threadNum);
         this->busyThreads -= 1;
@@ -34,40 +111,294 @@ namespace concurrent {
       }
     }
 
-    F next_job() {
-      F res;
-      std::unique_lock<std::mutex> job_lock(this->jobsMutex);
+    // false when the worker has to stop or retire
+    bool next_job(const std::size_t& threadNum, std::size_t& spins, F& res) {
+      for (std::size_t spin = 0; ; spin++) {
+        if (this->stop || threadNum >= this->activeThreads) {
+          return false;
+        }
+
+        if (this->queuedJobs > 0 && this->take(threadNum, res)) {
+          // jobs come in bursts, spin longer next time
+          if (spin > 0) {
+            spins = std::min(spins * 2, MAX_SPINS);
+          }
+          return true;
+        }
 
-      jobAvailableVar.wait(job_lock, [this] { return this->jobs.size() || this->stop; });
+        if (spin < spins) {
+          std::this_thread::yield();
+          continue;
+        }
 
-      if(!this->stop) {
-        res = this->jobs.top().second;
-        this->jobs.pop();
+        spins = std::max(spins / 2, MIN_SPINS);
+
+        // addJob checks sleepers after it counts the job, so either it
+        // sees this worker parked or the worker sees the job
+        std::unique_lock<std::mutex> lock(this->parkMutex);
+        this->sleepers += 1;
+        jobAvailableVar.wait(lock, [this, &threadNum] {
+          return this->queuedJobs > 0 || this->stop || threadNum >= this->activeThreads;
+        });
+        this->sleepers -= 1;
+        spin = 0;
       }
-      else {
-        res = [](std::size_t){};
-        this->jobsLeft += 1;
-        this->jobsDone -= 1;
+    }
+
+    // shards of the own group (or without one) first, then any shard
+    bool take(const std::size_t& threadNum, F& res) {
+      const std::size_t count = this->shards.size();
+      const std::size_t home = threadNum % count;
+      const int group = threadNum < this->threadGroups.size() ? this->threadGroups[threadNum] : -1;
+
+      for (int pass = 0; pass < 2; pass++) {
+        while (true) {
+          // scanned from the own shard, so it wins a full tie
+          Shard* best = nullptr;
+          for (std::size_t i = 0; i < count; i++) {
+            auto& shard = *this->shards[(home + i) % count];
+            if (shard.size == 0) {
+              continue;
+            }
+            if (pass == 0 && group >= 0 && shard.group >= 0 && shard.group != group) {
+              continue;
+            }
+            if (!best || this->before(shard, *best)) {
+              best = &shard;
+            }
+          }
+
+          if (!best) {
+            break;
+          }
+
+          int jobGroup = -1;
+          if (this->pop(*best, res, jobGroup)) {
+            if (jobGroup >= 0 && jobGroup != group) {
+              this->jobsStolen += 1;
+            }
+            return true;
+          }
+          // another worker emptied it meanwhile
+        }
       }
-      return res;
+
+      return false;
+    }
+
+    bool pop(Shard& shard, F& res, int& jobGroup) {
+      std::lock_guard<std::mutex> guard(shard.mutex);
+
+      if (shard.size == 0) {
+        return false;
+      }
+
+      const auto now = std::chrono::steady_clock::now();
+
+      auto& level = this->topLevel(shard)->second;
+      auto& queue = level.queue;
+      std::pop_heap(queue.begin(), queue.end(), QueueItemCompare());
+      auto& item = queue.back();
+      const auto waitUs = std::chrono::duration_cast<std::chrono::microseconds>(now - item.queued).count();
+      this->queueWaitUs.record(waitUs);
+      level.waitUs.record(waitUs);
+      if (item.deadline <= now) {
+        // nobody waits for its result anymore, only tell about it
+        if (item.expired) {
+          res = std::move(item.expired);
+        } else {
+          res = [](std::size_t){};
+        }
+        this->jobsExpired += 1;
+      } else {
+        res = std::move(item.job);
+      }
+      jobGroup = item.group;
+
+      queue.pop_back();
+      shard.size -= 1;
+      this->updateTop(shard);
+      this->queuedJobs -= 1;
+      return true;
+    }
+
+    static int64_t nanoseconds(const std::chrono::steady_clock::time_point& point) {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(point.time_since_epoch()).count();
+    }
+
+    // aged priority of a job in ns: a level is worth agingMs of wait.
+    // Waits of jobs grow alike, so it is taken against the queued time, not now
+    static int64_t agedScore(int priority, int64_t queuedNs, int64_t agingNs) {
+      return priority * agingNs - queuedNs;
+    }
+
+    // the level pop takes from, called under the shard mutex of a shard with jobs:
+    // the highest priority, raised by the wait of its top with aging,
+    // the longer wait on a tie
+    typename std::map<int, Level>::iterator topLevel(Shard& shard) {
+      const int64_t agingNs = this->agingMs * 1000000;
+
+      auto best = shard.levels.end();
+      int64_t bestScore = 0;
+      int64_t bestQueued = 0;
+      for (auto it = shard.levels.begin(); it != shard.levels.end(); ++it) {
+        if (it->second.queue.empty()) {
+          continue;
+        }
+        const int64_t queued = nanoseconds(it->second.queue.front().queued);
+        const int64_t score = agingNs ? agedScore(it->first, queued, agingNs) : it->first;
+        if (best == shard.levels.end() || score > bestScore ||
+            (score == bestScore && queued < bestQueued)) {
+          best = it;
+          bestScore = score;
+          bestQueued = queued;
+        }
+      }
+      return best;
+    }
+
+    // called under the shard mutex
+    void updateTop(Shard& shard) {
+      if (shard.size == 0) {
+        return;
+      }
+      const auto level = this->topLevel(shard);
+      const auto& top = level->second.queue.front();
+      shard.topPriority = level->first;
+      shard.topDeadline = nanoseconds(top.deadline);
+      shard.topQueued = nanoseconds(top.queued);
+    }
+
+    // the top of a goes first, by the rules of pop within a shard.
+    // Read without the mutexes, pop checks again. After setAging a shard
+    // may publish the top of another level till its next push or pop
+    bool before(const Shard& a, const Shard& b) const {
+      const int aPriority = a.topPriority;
+      const int bPriority = b.topPriority;
+      const int64_t aQueued = a.topQueued;
+      const int64_t bQueued = b.topQueued;
+
+      if (aPriority != bPriority) {
+        const int64_t agingNs = this->agingMs * 1000000;
+        if (!agingNs) {
+          return aPriority > bPriority;
+        }
+        const int64_t aScore = agedScore(aPriority, aQueued, agingNs);
+        const int64_t bScore = agedScore(bPriority, bQueued, agingNs);
+        return aScore != bScore ? aScore > bScore : aQueued < bQueued;
+      }
+
+      // first in first out across shards for equal deadlines
+      const int64_t aDeadline = a.topDeadline;
+      const int64_t bDeadline = b.topDeadline;
+      return aDeadline != bDeadline ? aDeadline < bDeadline : aQueued < bQueued;
+    }
+
+    // a worker above the active size leaves, its number can be reused by resize
+    bool retired(const std::size_t& threadNum) {
+      if (threadNum < this->activeThreads) {
+        return false;
+      }
+      std::lock_guard<std::mutex> guard(this->resizeMutex);
+      if (threadNum < this->activeThreads) {
+        return false;
+      }
+      this->running[threadNum] = false;
+      return true;
+    }
+
+    // called under resizeMutex
+    void startThread(const std::size_t& threadNum) {
+      if (this->threads[threadNum].joinable()) {
+        // it has already left process()
+        this->threads[threadNum].join();
+      }
+      this->running[threadNum] = true;
+      this->threads[threadNum] = std::thread([this, threadNum] {
+        this->setupThread(threadNum);
+        this->process(threadNum);
+      });
+    }
+
+    // pin the calling worker to cpus[threadNum % cpus.size()] and
+    // change its nice value (linux applies nice per thread)
+    void setupThread(const std::size_t& threadNum) {
+      if (!this->cpus.empty()) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(this->cpus[threadNum % this->cpus.size()], &cpuset);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+      }
+
+      if (this->niceness != 0) {
+        setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), this->niceness);
+      }
+    }
+
+    // wake workers parked in next_job
+    void wakeAll() {
+      {
+        // a worker between its check and the wait holds parkMutex
+        std::lock_guard<std::mutex> guard(this->parkMutex);
+      }
+      this->jobAvailableVar.notify_all();
     }
 
   public:
-    ThreadPool(const std::size_t& threadCount, const size_t& _maxQueueSize)
+    // threadGroups - group (e.g. NUMA node) of each worker.
+    // Jobs of a group go to shards of its workers, a worker prefers
+    // them and steals jobs of other groups only when there is nothing else.
+    ThreadPool(const std::size_t& threadCount,
+               const size_t& _maxQueueSize,
+               const std::vector<int>& _cpus = std::vector<int>(),
+               const int& _niceness = 0,
+               const std::vector<int>& _threadGroups = std::vector<int>())
       : jobsPerThread(threadCount)
       , maxQueueSize(_maxQueueSize)
+      , cpus(_cpus)
+      , niceness(_niceness)
+      , threadGroups(_threadGroups)
+      , nextShard(0)
+      , queuedJobs(0)
+      , sleepers(0)
+      , jobsStolen(0)
+      , jobsExpired(0)
+      , agingMs(0)
       , jobsLeft(0)
       , jobsDone(0)
       , busyThreads(0)
+      , activeThreads(threadCount)
       , stop(false)
       , finished(false)
     {
+      // threadGroups cover every worker the pool may grow to,
+      // workers above the shards count share them
+      const std::size_t shardsCount = std::max<std::size_t>({
+        1,
+        threadCount,
+        _threadGroups.size()
+      });
+
+      for (std::size_t i = 0; i < shardsCount; i++) {
+        this->shards.push_back(std::make_unique<Shard>());
+        this->shards[i]->group = i < _threadGroups.size() ? _threadGroups[i] : -1;
+
+        const int group = this->shards[i]->group;
+        if (group >= 0) {
+          if (this->groupShards.size() <= static_cast<std::size_t>(group)) {
+            this->groupShards.resize(group + 1);
+          }
+          this->groupShards[group].push_back(i);
+        }
+      }
+
+      std::lock_guard<std::mutex> guard(this->resizeMutex);
+
+      this->threads.resize(threadCount);
+      this->running.resize(threadCount, false);
+
       for (std::size_t i = 0; i < threadCount; i++) {
-        this->threads.push_back(std::move(
-          std::thread([this, i] {
-            this->process(i);
-          })
-        ));
+        this->startThread(i);
       }
     }
 
@@ -75,21 +406,95 @@ namespace concurrent {
       this->joinAll();
     }
 
-    bool addJob(int priority, F job) {
+    // Jobs of the same priority are taken by the earliest deadline,
+    // then in the order they were added.
+    // A job dequeued after its deadline is not executed, expired is
+    // called instead (if any) with the same thread num.
+    // Jobs are moved from only when they are accepted.
+    bool addJob(int priority, F&& job, int group = -1,
+                std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max(),
+                F&& expired = F()) {
       // to prevent blow up memory
       if (this->jobsLeft >= std::atomic_int(this->maxQueueSize)) {
         return false;
       }
 
-      std::lock_guard<std::mutex> guard(this->jobsMutex);
-      this->jobs.push(std::make_pair(priority, std::bind(job, std::placeholders::_1))); // _1 for thread num
+      // before it is visible: a worker may finish it right away
       this->jobsLeft += 1;
-      this->jobAvailableVar.notify_one();
+
+      // a group without workers is no group
+      if (group >= 0 && (static_cast<std::size_t>(group) >= this->groupShards.size() ||
+                         this->groupShards[group].empty())) {
+        group = -1;
+      }
+
+      auto& shard = this->shardOf(group);
+      {
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        // a new level is created once and kept
+        auto& queue = shard.levels[priority].queue;
+        queue.push_back(QueueItem {
+          group,
+          shard.seq++,
+          std::chrono::steady_clock::now(),
+          deadline,
+          std::move(job),
+          std::move(expired)
+        });
+        std::push_heap(queue.begin(), queue.end(), QueueItemCompare());
+        shard.size += 1;
+        this->updateTop(shard);
+      }
+
+      this->queuedJobs += 1;
+      if (this->sleepers > 0) {
+        std::lock_guard<std::mutex> guard(this->parkMutex);
+        this->jobAvailableVar.notify_one();
+      }
       return true;
     }
 
     int size() const {
-      return this->threads.size();
+      return this->activeThreads;
+    }
+
+    // Workers are numbered [0, threadCount): shrinking retires the highest
+    // numbers once they finish their current job, growing reuses them.
+    // Thread numbers passed to jobs stay below the largest size ever set.
+    void resize(const std::size_t& threadCount) {
+      std::lock_guard<std::mutex> guard(this->resizeMutex);
+
+      if (this->stop || threadCount == 0) {
+        return;
+      }
+
+      if (threadCount > this->threads.size()) {
+        this->threads.resize(threadCount);
+        this->running.resize(threadCount, false);
+
+        std::unique_lock<std::shared_mutex> lock(this->jobsPerThreadMutex);
+        this->jobsPerThread.resize(threadCount);
+      }
+
+      {
+        // under parkMutex, so a parking worker can not miss the change
+        std::lock_guard<std::mutex> parkGuard(this->parkMutex);
+        this->activeThreads = threadCount;
+      }
+
+      // a retiring worker which has not left yet just keeps working
+      for (std::size_t i = 0; i < threadCount; i++) {
+        if (!this->running[i]) {
+          this->startThread(i);
+        }
+      }
+
+      this->jobAvailableVar.notify_all();
+    }
+
+    // time jobs spent in the queue, in microseconds
+    pb::concurrent::Histogram::Snapshot getQueueWait() const {
+      return this->queueWaitUs.snapshot();
     }
 
     int getBusyThreads() const {
@@ -104,6 +509,45 @@ namespace concurrent {
       return this->jobsLeft;
     }
 
+    // jobs executed by a worker from another group
+    int getJobsStolen() const {
+      return this->jobsStolen;
+    }
+
+    // jobs dropped at dequeue because their deadline had passed
+    int getJobsExpired() const {
+      return this->jobsExpired;
+    }
+
+    // a waiting job gains one priority level every agingMs, 0 - strict priorities
+    void setAging(const std::size_t& agingMs) {
+      this->agingMs = agingMs;
+    }
+
+    std::size_t getAging() const {
+      return this->agingMs;
+    }
+
+    struct LevelStatistics {
+      std::size_t queued = 0;
+      // time jobs of the level spent in the queue, in microseconds
+      pb::concurrent::Histogram::Snapshot waitUs;
+    };
+
+    // by priority, every level which has ever had a job
+    std::map<int, LevelStatistics> getLevels() {
+      std::map<int, LevelStatistics> res;
+      for (auto& shard: this->shards) {
+        std::lock_guard<std::mutex> guard(shard->mutex);
+        for (const auto& kv: shard->levels) {
+          auto& level = res[kv.first];
+          level.queued += kv.second.queue.size();
+          level.waitUs.merge(kv.second.waitUs.snapshot());
+        }
+      }
+      return res;
+    }
+
     std::vector<int> getJobsPerThread() {
       std::unique_lock<std::shared_mutex> lock(this->jobsPerThreadMutex);
       return this->jobsPerThread;
@@ -116,17 +560,23 @@ namespace concurrent {
           this->waitAll();
         }
 
-        this->stop = true;
-        this->jobAvailableVar.notify_all();
+        // join without resizeMutex: a retiring worker may be waiting for it
+        std::vector<std::thread> threads;
+        {
+          std::lock_guard<std::mutex> guard(this->resizeMutex);
+          this->stop = true;
+          threads.swap(this->threads);
+        }
+
+        this->wakeAll();
 
-        for(auto &thread : this->threads) {
+        for(auto &thread : threads) {
           if(thread.joinable()) {
             thread.join();
           }
         }
 
         this->finished = true;
-        this->threads.clear();
       }
     }
 
@@ -139,35 +589,57 @@ namespace concurrent {
 
   private:
 
-    typedef std::pair<int, F> queueItem;
+    // round robin over shards of the group, or over shards of active
+    // workers for jobs without group (or of a group without workers)
+    Shard& shardOf(int group) {
+      const std::size_t next = this->nextShard++;
 
-    struct QueueItemCompare {
-      bool operator()(const queueItem& n1, const queueItem& n2) {
-        return n1.first < n2.first;
+      if (group >= 0) {
+        const auto& own = this->groupShards[group];
+        return *this->shards[own[next % own.size()]];
       }
-    };
 
+      const std::size_t active = std::min<std::size_t>(this->activeThreads, this->shards.size());
+      return *this->shards[next % std::max<std::size_t>(active, 1)];
+    }
+
+    // threads[i] runs worker i, running[i] - it has not left process() yet
     std::vector<std::thread> threads;
-    std::priority_queue<
-      queueItem,
-      std::deque<queueItem>,
-      QueueItemCompare
-    > jobs;
+    std::vector<bool> running;
 
     std::vector<int> jobsPerThread;
     const std::size_t maxQueueSize;
+    const std::vector<int> cpus;
+    const int niceness;
+    const std::vector<int> threadGroups;
+
+    // fixed after construction, so they are read without a lock
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::vector<std::vector<std::size_t>> groupShards;
+    std::atomic_size_t nextShard;
+
+    // jobs in all shards and workers parked waiting for them
+    std::atomic_int queuedJobs;
+    std::atomic_int sleepers;
+    std::atomic_int jobsStolen;
+    std::atomic_int jobsExpired;
+    std::atomic_size_t agingMs;
 
     std::atomic_int jobsLeft;
     std::atomic_int jobsDone;
     std::atomic_int busyThreads;
+    std::atomic_size_t activeThreads;
     std::atomic_bool stop;
     std::atomic_bool finished;
 
     std::condition_variable jobAvailableVar;
     std::condition_variable waitVar;
 
+    pb::concurrent::Histogram queueWaitUs;
+
     std::mutex waitMutex;
-    std::mutex jobsMutex;
+    std::mutex parkMutex;
+    std::mutex resizeMutex;
     std::shared_mutex jobsPerThreadMutex;
   };
 
@@ -0,0 +1,127 @@
+#ifndef PB_TOPOLOGY_H
+#define PB_TOPOLOGY_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <algorithm>
+
+#include <pthread.h>
+#include <sched.h>
+
+namespace pb {
+
+  // NUMA layout of the host: list of cpus for every node.
+  // Read from sysfs, falls back to a single node with all cpus.
+  class Topology {
+  public:
+
+    static Topology detect() {
+      Topology topology;
+
+      for (int node = 0; ; node++) {
+        std::ifstream cpulist(
+          "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        if (!cpulist) {
+          break;
+        }
+
+        std::string line;
+        std::getline(cpulist, line);
+
+        auto cpus = Topology::parseCpuList(line);
+        if (!cpus.empty()) {
+          topology.nodes.push_back(cpus);
+        }
+      }
+
+      if (topology.nodes.empty()) {
+        std::vector<int> cpus;
+        const int cpusCount = std::max(1u, std::thread::hardware_concurrency());
+        for (int cpu = 0; cpu < cpusCount; cpu++) {
+          cpus.push_back(cpu);
+        }
+        topology.nodes.push_back(cpus);
+      }
+
+      return topology;
+    }
+
+    std::size_t nodesCount() const {
+      return this->nodes.size();
+    }
+
+    const std::vector<int>& cpus(const std::size_t& node) const {
+      return this->nodes[node % this->nodes.size()];
+    }
+
+    // workers (and isolates) are spread over nodes round robin:
+    // i-th worker lives on node i % nodesCount
+    int workerNode(const std::size_t& threadNum) const {
+      return threadNum % this->nodes.size();
+    }
+
+    // one dedicated cpu per worker, cpus inside a node are taken in order
+    std::vector<int> workerCpus(const std::size_t& threadsCount) const {
+      std::vector<int> res;
+      for (std::size_t i = 0; i < threadsCount; i++) {
+        const auto& nodeCpus = this->cpus(this->workerNode(i));
+        res.push_back(nodeCpus[(i / this->nodes.size()) % nodeCpus.size()]);
+      }
+      return res;
+    }
+
+    std::vector<int> workerNodes(const std::size_t& threadsCount) const {
+      std::vector<int> res;
+      for (std::size_t i = 0; i < threadsCount; i++) {
+        res.push_back(this->workerNode(i));
+      }
+      return res;
+    }
+
+    // restrict the calling thread to the cpus of the node,
+    // so memory it touches first is allocated on that node
+    void pinCurrentThreadToNode(const std::size_t& node) const {
+      cpu_set_t cpuset;
+      CPU_ZERO(&cpuset);
+      for (auto cpu: this->cpus(node)) {
+        CPU_SET(cpu, &cpuset);
+      }
+      pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+    }
+
+  private:
+
+    // "0-3,8-11" -> 0 1 2 3 8 9 10 11
+    static std::vector<int> parseCpuList(const std::string& list) {
+      std::vector<int> cpus;
+      std::istringstream ranges(list);
+      std::string range;
+
+      while (std::getline(ranges, range, ',')) {
+        if (range.empty()) {
+          continue;
+        }
+        try {
+          auto dash = range.find('-');
+          const int from = std::stoi(range.substr(0, dash));
+          const int to = dash == std::string::npos ? from : std::stoi(range.substr(dash + 1));
+          for (int cpu = from; cpu <= to; cpu++) {
+            cpus.push_back(cpu);
+          }
+        } catch (const std::exception&) {
+          continue;
+        }
+      }
+
+      return cpus;
+    }
+
+    std::vector<std::vector<int>> nodes;
+  };
+
+}
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef V8_PLATFORM_H
+#define V8_PLATFORM_H
+
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <chrono>
+
+#include <libplatform/libplatform.h>
+#include <v8.h>
+#include <v8-version.h>
+
+#include "threadpool.h"
+#include "inlinetask.h"
+#include "histogram.h"
+
+// CallOnWorkerThread and task runners replaced CallOnBackgroundThread in 6.7
+#define PB_V8_WORKER_THREADS_API \
+  (V8_MAJOR_VERSION > 6 || (V8_MAJOR_VERSION == 6 && V8_MINOR_VERSION >= 7))
+
+namespace pb {
+
+  // v8::Platform which runs V8 background work (concurrent marking,
+  // parallel scavenge, off-thread compilation) on our own bounded ThreadPool
+  // instead of the default platform worker threads.
+  // Foreground tasks, tracing and time are delegated to the default platform.
+  class V8Platform : public v8::Platform {
+
+  public:
+
+    struct Options {
+      // amount of background threads for V8 work
+      std::size_t backgroundThreadsCount = 2;
+      // cpus to pin background threads to, empty - no pinning
+      std::vector<int> cpus;
+      // nice value of background threads, so request threads always win
+      int backgroundNiceness = 10;
+    };
+
+    struct Statistics {
+      std::size_t backgroundThreadsCount;
+      std::size_t tasksPosted;
+      std::size_t blockingTasksPosted;
+      std::size_t longRunningTasksPosted;
+      std::size_t tasksQueued;
+      std::size_t tasksDone;
+      pb::concurrent::Histogram::Snapshot queueWaitUs;
+      pb::concurrent::Histogram::Snapshot runTimeUs;
+    };
+
+    explicit V8Platform(const Options& options);
+    ~V8Platform();
+
+    Statistics getStatistics();
+
+    size_t NumberOfAvailableBackgroundThreads() override;
+
+    void CallOnBackgroundThread(v8::Task* task, ExpectedRuntime expected_runtime) override;
+
+    void CallOnForegroundThread(v8::Isolate* isolate, v8::Task* task) override;
+
+    void CallDelayedOnForegroundThread(v8::Isolate* isolate,
+                                       v8::Task* task,
+                                       double delay_in_seconds) override;
+
+    void CallIdleOnForegroundThread(v8::Isolate* isolate, v8::IdleTask* task) override;
+
+    bool IdleTasksEnabled(v8::Isolate* isolate) override;
+
+    double MonotonicallyIncreasingTime() override;
+
+    v8::TracingController* GetTracingController() override;
+
+#if PB_V8_WORKER_THREADS_API
+    int NumberOfWorkerThreads() override;
+
+    void CallOnWorkerThread(std::unique_ptr<v8::Task> task) override;
+
+    void CallBlockingTaskOnWorkerThread(std::unique_ptr<v8::Task> task) override;
+
+    std::shared_ptr<v8::TaskRunner> GetForegroundTaskRunner(v8::Isolate* isolate) override;
+
+    std::shared_ptr<v8::TaskRunner> GetWorkerThreadsTaskRunner(v8::Isolate* isolate) override;
+
+    double CurrentClockTimeMillis() override;
+#endif
+
+  private:
+
+    // higher value - served first
+    enum PRIORITY {
+      LONG_RUNNING = 0,
+      SHORT_RUNNING = 1,
+      BLOCKING = 2
+    };
+
+#if PB_V8_WORKER_THREADS_API
+    class WorkerTaskRunner : public v8::TaskRunner {
+    public:
+      WorkerTaskRunner(V8Platform* platform, const std::shared_ptr<v8::TaskRunner>& delayed):
+        _platform(platform), _delayed(delayed) {}
+
+      void PostTask(std::unique_ptr<v8::Task> task) override {
+        _platform->_post(std::move(task), PRIORITY::SHORT_RUNNING);
+      }
+      // there is no timer in our pool, let the default platform wait
+      void PostDelayedTask(std::unique_ptr<v8::Task> task, double delay_in_seconds) override {
+        _delayed->PostDelayedTask(std::move(task), delay_in_seconds);
+      }
+      void PostIdleTask(std::unique_ptr<v8::IdleTask> task) override {
+        _delayed->PostIdleTask(std::move(task));
+      }
+      bool IdleTasksEnabled() override { return false; }
+    private:
+      V8Platform* _platform;
+      std::shared_ptr<v8::TaskRunner> _delayed;
+    };
+#endif
+
+    // V8 hands over the ownership of a task, the job keeps it as is
+    typedef pb::concurrent::InlineTask<void(std::size_t)> Job;
+    typedef pb::concurrent::ThreadPool<Job> ThreadPool;
+
+    void _post(std::unique_ptr<v8::Task> task, PRIORITY priority);
+
+    std::unique_ptr<v8::Platform> _default;
+    std::unique_ptr<ThreadPool> _pool;
+
+    std::size_t _backgroundThreadsCount;
+
+    std::atomic<std::size_t> _tasksPosted;
+    std::atomic<std::size_t> _blockingTasksPosted;
+    std::atomic<std::size_t> _longRunningTasksPosted;
+
+    pb::concurrent::Histogram _queueWaitUs;
+    pb::concurrent::Histogram _runTimeUs;
+  };
+
+}
+
+#endif
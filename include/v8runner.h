@@ -6,6 +6,7 @@
 #include <map>
 #include <unordered_map>
 #include <mutex>
+#include <condition_variable>
 #include <chrono>
 #include <atomic>
 #include <thread>
@@ -15,8 +16,11 @@
 #include <sstream>
 #include <functional>
 #include <queue>
+#include <deque>
 #include <algorithm>
 #include <set>
+#include <array>
+#include <cstring>
 
 #include <experimental/filesystem>
 namespace fs = std::experimental::filesystem;
@@ -24,6 +28,17 @@ namespace fs = std::experimental::filesystem;
 #include <libplatform/libplatform.h>
 #include <v8.h>
 
+#include "histogram.h"
+#include "v8platform.h"
+#include "topology.h"
+#include "journal.h"
+#include "nativedate.h"
+#include "nativecrypto.h"
+#include "kvstore.h"
+#include "datasets.h"
+#include "libcache.h"
+#include "resultcache.h"
+
 #define ERR_CODE 0
 #define DATA 1
 
@@ -42,7 +57,20 @@ namespace pb {
       BAD_INPUT_ERR = 5,
       SCRIPT_RUNTIME_ERR = 6,
       SCRIPT_TERMINATED_ERR = 7,
-      CACHED_REQUIRE_FILE_ERR = 8
+      CACHED_REQUIRE_FILE_ERR = 8,
+      JOURNAL_ERR = 9,
+      KV_ERR = 10,
+      DATASETS_ERR = 11
+    };
+
+    // how functions are spread over isolates
+    enum ISOLATE_MODE {
+      // a conv lives in one isolate, any pool thread runs it there
+      CONV_ISOLATES = 0,
+      // the i-th pool thread owns the i-th isolate and every function
+      // is compiled in all of them: more memory, no routing and no
+      // locker contention between threads
+      THREAD_ISOLATES = 1
     };
 
     typedef std::string Conv;
@@ -55,16 +83,112 @@ namespace pb {
       double mallocedMemMb;
     };
 
+    enum GC_KIND {
+      GC_SCAVENGE = 0,
+      GC_MARK_COMPACT = 1,
+      GC_INCREMENTAL = 2,
+      GC_WEAK_CALLBACKS = 3,
+      GC_KINDS_COUNT = 4
+    };
+
+    // timing breakdown of a single run
+    struct RunTrace {
+      std::size_t execTimeUs = 0;
+      std::size_t gcPauseUs = 0;
+      std::size_t gcCount = 0;
+    };
+
+    typedef std::map<std::string, pb::concurrent::Histogram::Snapshot> GCStatistics;
+
+    // run a freshly compiled function before it goes live,
+    // so the first real runs do not pay for tiering up
+    struct WarmUp {
+      // JSON input, empty - reuse a recent real input of the pair
+      std::string sample;
+      // 0 - no warm-up
+      std::size_t runs = 0;
+
+      // filled by compile
+      std::size_t doneRuns = 0;
+      std::size_t timeUs = 0;
+    };
+
+    // startup phases, times are in microseconds since the constructor was called
+    struct StartupStatistics {
+      std::size_t libsCount = 0;
+      std::size_t libsUs = 0;
+      // isolates created so far and libraries compiled in them
+      std::size_t isolatesCount = 0;
+      std::size_t precompiledLibs = 0;
+      std::size_t slowestIsolateUs = 0;
+      std::size_t firstIsolateUs = 0;
+      // the constructor returned, the first readyIsolates can serve
+      std::size_t readyUs = 0;
+      // 0 - isolates are still being created
+      std::size_t allIsolatesUs = 0;
+    };
+
+    // hot convs (conv mode): a conv whose runs wait for its isolate longer
+    // than lockWaitUs on average is compiled into one more isolate, up to
+    // maxReplicas, and its runs go to the least busy copy. Replicas are
+    // dropped one per interval when the wait falls under lockWaitUs / 4
+    struct HotConvs {
+      // 0 - off
+      std::size_t maxReplicas = 0;
+      std::size_t lockWaitUs = 2000;
+      std::size_t intervalMs = 1000;
+      // runs of the conv per interval to be considered
+      std::size_t minRuns = 100;
+    };
+
+    // sizes of the conv/function maps, they shrink back as convs go away
+    struct RegistryStatistics {
+      std::size_t convs = 0;
+      std::size_t functions = 0;
+      std::size_t sources = 0;
+      std::size_t buckets = 0;
+      std::size_t compactions = 0;
+    };
+
+    // one node of compile_bulk, code/data/skipped are filled by compileBulk
+    struct BulkNode {
+      Node node;
+      std::string src;
+
+      int code = STATUS::NO_ERR;
+      std::string data;
+      // same source as the live function, nothing was compiled
+      bool skipped = false;
+    };
+
     V8Runner(int argc,
              char* argv[],
              const fs::path& pathToLibs,
              const std::size_t& maxExecutionTime,
              const std::size_t& maxRAMAvailable,
              const std::size_t& timeCheckerSleepTime,
-             const std::size_t& threadsCount = 1);
+             const std::size_t& threadsCount = 1,
+             const V8Platform::Options& platformOptions = V8Platform::Options(),
+             const std::shared_ptr<Topology>& topology = nullptr,
+             const std::size_t& readyIsolates = 0,
+             const ISOLATE_MODE& isolateMode = CONV_ISOLATES);
     ~V8Runner();
 
-    std::unordered_map<std::string, std::string> loadLibs();
+    // isolates are created in parallel, the constructor returns
+    // as soon as readyIsolates of them are (0 - all), the rest are
+    // created in background. Wait for them to be all there
+    void waitForIsolates();
+    StartupStatistics getStartupStatistics();
+
+    // add or retire isolates (at least one is kept), returns the new amount.
+    // Convs of a retired isolate are compiled again in the remaining ones,
+    // an isolate is kept if one of its functions does not compile there.
+    // Call it before the pool gets more threads: _timing grows with isolates
+    std::size_t resizeIsolates(const std::size_t& count);
+
+    // map libraries for require() and watch the directory for changes,
+    // returns the amount of libraries
+    std::size_t loadLibs();
 
     std::tuple<int, std::string> checkCode(
       const char* src,
@@ -74,29 +198,125 @@ namespace pb {
     std::tuple<int, std::string> compile(
       const char* conv_id,
       const char* node_id,
-      const char* src);
+      const char* src,
+      const std::size_t& threadId = 0,
+      WarmUp* warmUp = nullptr);
+
+    // compile nodes of the conv with one isolate lock entry per isolate and
+    // publish them at once: runs see either the old functions or all new ones.
+    // Nothing is published if any node fails (in any isolate in thread mode),
+    // the first failure is returned
+    std::tuple<int, std::string> compileBulk(
+      const char* conv_id,
+      std::vector<BulkNode>& nodes,
+      const bool& skipUnchanged = false);
 
     std::tuple<int, std::string> remove(
       const char* conv_id,
       const char* node_id);
 
+    // make the previous version of the pair live again, the live one is dropped.
+    // Kept versions stay compiled, so it takes no compile, except in isolates
+    // added since. If one of them fails (a hot replica aside) the version stays
+    // and the live one keeps serving. DATA is the version
+    std::tuple<int, std::string> rollback(
+      const char* conv_id,
+      const char* node_id);
+
+    // drop all functions of the conv, its contexts and every trace of it
+    // in one step (the conv is compiled into a new isolate next time)
+    std::tuple<int, std::string> removeConv(const char* conv_id);
+
+    // maxExecutionTime (ms) caps the watchdog limit of this run, e.g. by
+    // what is left till the deadline of the request (0 - the common limit)
     std::tuple<int, std::string> run(
       const char* conv_id,
       const char* node_id,
       const char* data,
-      const std::size_t& threadId = 0);
+      const std::size_t& threadId = 0,
+      RunTrace* trace = nullptr,
+      const std::size_t& maxExecutionTime = 0);
 
     void cleanData();
 
+    // restore functions from the journal (compiling every isolate's share
+    // in parallel) and journal every compile/remove from now on.
+    // Call it before accepting traffic.
+    std::tuple<int, std::string> openJournal(const fs::path& path);
+
+    // shared lookup data for kv.get(ns, key), DATA is the new store version
+    std::tuple<int, std::string> kvPut(const std::string& ns,
+                                       const std::string& key,
+                                       const std::string& value);
+    std::tuple<int, std::string> kvLoadFile(const std::string& ns, const std::string& path);
+    uint64_t getKVVersion() const;
+
+    // bind every <name>.json of the directory as a frozen global `name`,
+    // reloadDatasets rereads the same directory. DATA is the new version
+    std::tuple<int, std::string> loadDatasets(const fs::path& dir);
+    std::tuple<int, std::string> reloadDatasets();
+
+    // GC pauses (in microseconds) of all isolates grouped by GC kind
+    GCStatistics getGCStatistics();
+
+    // V8 background tasks executed by our platform
+    V8Platform::Statistics getPlatformStatistics();
+
     void setMaxExecutionTime(const std::size_t& maxExecutionTime);
     std::size_t getMaxExecutionTime();
 
+    // limits (milliseconds) of top-level code of compile and check_code,
+    // maxExecutionTime by default
+    void setMaxCompileTime(const std::size_t& maxCompileTime);
+    std::size_t getMaxCompileTime();
+
+    void setMaxCheckCodeTime(const std::size_t& maxCheckCodeTime);
+    std::size_t getMaxCheckCodeTime();
+
     void setTimeCheckerSleepTime(const std::size_t& watchDogSleepTime);
     std::size_t getTimeCheckerSleepTime();
 
     std::size_t isolates_count();
     std::size_t convs_count();
     std::size_t nodes_count();
+    RegistryStatistics getRegistryStatistics();
+
+    // NUMA node of the isolate which serves the conv,
+    // -1 if topology-aware mode is off or conv is unknown
+    int getConvNode(const char* conv_id);
+    bool isTopologyAware() const;
+
+    ISOLATE_MODE getIsolateMode() const;
+
+    // conv mode: every conv created from now on gets its own context
+    // in its isolate instead of the shared one
+    void setConvContexts(const bool& enabled);
+    bool getConvContexts() const;
+
+    // memoize results of the pair by input, for pure functions only.
+    // ttlMs: 0 - no expiry. Results are dropped when the pair is compiled
+    // again, the opt-in goes away with the pair
+    void setMemoization(const char* conv_id,
+                        const char* node_id,
+                        const bool& enabled,
+                        const std::size_t& ttlMs = 0);
+    // some pair opted in, lock-free: a run is not decoded up front otherwise
+    bool isMemoizationEnabled() const;
+    // false if there is no memoized result of the input
+    bool getMemoized(const char* conv_id, const char* node_id, const char* data, std::string& result);
+    void setMemoizationBudget(const std::size_t& budgetBytes);
+    ResultCache::Statistics getMemoizationStatistics();
+
+    // replaced versions kept per pair for rollback (1 by default), 0 - none
+    void setKeptVersions(const std::size_t& count);
+    std::size_t getKeptVersions();
+
+    void setHotConvs(const HotConvs& options);
+    HotConvs getHotConvsOptions();
+    // conv -> amount of its replicas, replicated convs only
+    std::map<Conv, std::size_t> getHotConvs();
+    // one step of the background rebalancing
+    void rebalanceHotConvs();
 
     static std::tuple<int, std::string> updateRequireCache(const std::string& fileName);
     static std::tuple<int, std::string> getRequireCachedFile(const std::string& fileName);
@@ -104,16 +324,15 @@ namespace pb {
   private:
 
     static fs::path _pathToLibs;
-    static std::shared_mutex _requireCacheMutex;
 
-    static std::unordered_map<std::string, std::string> _requireCache;
+    static LibCache _libs;
 
-    v8::Platform *_platform;
+    V8Platform *_platform;
     v8::Isolate::CreateParams _create_params;
 
     typedef v8::Persistent<v8::ObjectTemplate, v8::CopyablePersistentTraits<v8::ObjectTemplate>> PersistentObjectTemplate;
     typedef v8::Persistent<v8::Context, v8::CopyablePersistentTraits<v8::Context>> PersistentContext;
-    typedef v8::Persistent<v8::Function, v8::CopyablePersistentTraits<v8::Function>> PersistentFunction;
+    typedef v8::Global<v8::Function> PersistentFunction;
 
     typedef std::tuple<v8::Isolate*,
                        PersistentObjectTemplate,
@@ -121,19 +340,118 @@ namespace pb {
                        PersistentFunction
                       > V8Instance;
 
+    typedef std::array<pb::concurrent::Histogram, GC_KINDS_COUNT> GCPauses;
+
+    // datasets version bound to a context and its global names,
+    // reached from the context (CONTEXT_DATASETS_SLOT)
+    struct DatasetsBinding {
+      uint64_t version = 0;
+      std::set<std::string> names;
+    };
+
     class IsolateRelatedData {
     public:
-      IsolateRelatedData(const PersistentObjectTemplate& template_, const PersistentContext& context):
-        _template(template_), _context(context) {}
+      IsolateRelatedData(const PersistentObjectTemplate& template_,
+                         const PersistentContext& context,
+                         const std::shared_ptr<GCPauses>& gcPauses,
+                         const std::shared_ptr<NativeDate::Cache>& dateCache):
+        _template(template_), _context(context), _gcPauses(gcPauses), _dateCache(dateCache) {}
     public:
       PersistentContext getPContext() const { return _context; }
+      PersistentObjectTemplate getPTemplate() const { return _template; }
       void clean() {
         _template.Reset();
         _context.Reset();
       }
+
+      // GC callbacks are called on the thread which holds the isolate locker,
+      // so the per-run counters do not need any synchronization
+      void gcPrologue(GC_KIND kind) {
+        _gcStarted[kind] = std::chrono::steady_clock::now();
+      }
+      void gcEpilogue(GC_KIND kind) {
+        const auto pause = std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - _gcStarted[kind]).count();
+        (*_gcPauses)[kind].record(pause);
+        _runGCPauseUs += pause;
+        _runGCCount += 1;
+      }
+      // user code sees one version of the kv store per call: the snapshot
+      // is taken on the first kv.get and dropped when its KVScope is left
+      const KVStore::Snapshot& kvSnapshot(const KVStore& kv) {
+        if (!_kvSnapshot) {
+          _kvSnapshot = kv.snapshot();
+        }
+        return *_kvSnapshot;
+      }
+
+      // held around every call into user code (a run, a warm-up, top-level
+      // code of a compile, check or replay), so nothing pins a stale version
+      class KVScope {
+      public:
+        explicit KVScope(v8::Isolate* isolate):
+          _data(static_cast<IsolateRelatedData*>(isolate->GetData(ISOLATE_DATA_SLOT))) {
+          if (_data) {
+            _data->_kvSnapshot.reset();
+          }
+        }
+        ~KVScope() {
+          if (_data) {
+            _data->_kvSnapshot.reset();
+          }
+        }
+        KVScope(const KVScope&) = delete;
+        KVScope& operator=(const KVScope&) = delete;
+      private:
+        IsolateRelatedData* _data;
+      };
+
+      // datasets of the shared context
+      DatasetsBinding& datasets() { return _datasets; }
+
+      void resetRunGC() {
+        _runGCPauseUs = 0;
+        _runGCCount = 0;
+      }
+      std::size_t getRunGCPauseUs() const { return _runGCPauseUs; }
+      std::size_t getRunGCCount() const { return _runGCCount; }
+
+      // runs waiting for or holding the isolate
+      std::atomic<int> users{0};
     private:
       PersistentObjectTemplate _template;
       PersistentContext _context;
+
+      std::shared_ptr<GCPauses> _gcPauses;
+      std::array<std::chrono::steady_clock::time_point, GC_KINDS_COUNT> _gcStarted;
+      std::size_t _runGCPauseUs = 0;
+      std::size_t _runGCCount = 0;
+
+      // used by `date` functions of the context, lives as long as the isolate
+      std::shared_ptr<NativeDate::Cache> _dateCache;
+
+      std::shared_ptr<const KVStore::Snapshot> _kvSnapshot;
+
+      DatasetsBinding _datasets;
+    };
+
+    // isolate slot which keeps a raw pointer to IsolateRelatedData
+    static const uint32_t ISOLATE_DATA_SLOT = 0;
+    // context slot which keeps a raw pointer to its DatasetsBinding
+    static const int CONTEXT_DATASETS_SLOT = 1;
+
+    // own context of a conv in one of its isolates (conv contexts mode),
+    // globals of a conv are not seen by others and go away with the context
+    struct ConvContext {
+      PersistentContext context;
+      DatasetsBinding datasets;
+    };
+
+    // an isolate a compile builds the new version in
+    struct BuildTarget {
+      v8::Isolate* isolate;
+      std::shared_ptr<IsolateRelatedData> isolateData;
+      PersistentContext context;
     };
 
     template <typename Key>
@@ -148,26 +466,63 @@ namespace pb {
       }
     };
 
+    // user code watched by the time checker, each kind has its own limit
+    enum EXECUTION_KIND {
+      EXEC_RUN = 0,
+      // top-level code of compile (and of journal replay, replication)
+      EXEC_COMPILE = 1,
+      EXEC_CHECK_CODE = 2
+    };
+
     struct ScriptWorkTime {
       std::atomic<bool> isWorking;
       v8::Isolate* isolate;
       std::chrono::milliseconds started;
+      EXECUTION_KIND kind;
+      // ms, 0 - the limit of its kind
+      std::size_t limit;
 
       ScriptWorkTime(
         bool isWorking,
         v8::Isolate* isolate,
-        const std::chrono::milliseconds& started
+        const std::chrono::milliseconds& started,
+        const EXECUTION_KIND& kind = EXEC_RUN,
+        const std::size_t& limit = 0
       ) {
         this->isWorking = isWorking;
         this->isolate = isolate;
         this->started = started;
+        this->kind = kind;
+        this->limit = limit;
       }
     };
 
     std::tuple<v8::Isolate*, std::shared_ptr<IsolateRelatedData>> makeNewIsolate();
     v8::Isolate* getIsolate();
 
+    // compile (but do not run) every library in the isolate,
+    // so require() finds it in the compilation cache, returns amount of compiled ones
+    std::size_t _precompileLibs(v8::Isolate* isolate, const std::shared_ptr<IsolateRelatedData>& isolateData);
+
+    // library source as a V8 string, ASCII ones are not copied
+    static v8::Local<v8::String> _libSource(v8::Isolate* isolate,
+                                            const std::shared_ptr<const LibCache::File>& file);
+
+    const ISOLATE_MODE _isolateMode;
+
+    // ordered by creation index (_isolateIndexes), see _addIsolate
     std::vector<v8::Isolate*> _isolates;
+    std::vector<std::size_t> _isolateIndexes;
+
+    // topology-aware mode: i-th isolate is created (first-touched)
+    // on node i % nodesCount, same as i-th pool worker
+    std::shared_ptr<Topology> _topology;
+    std::unordered_map<v8::Isolate*, int> _isolateNodes;
+
+    // NUMA node of the isolate of every conv, read by the receive thread.
+    // Under its own lock, so an exclusive _compileMutex does not stall it
+    std::unordered_map<Conv, int> _convPlacement;
+    std::shared_mutex _convPlacementMutex;
 
     std::map<
       v8::Isolate*,
@@ -188,6 +543,129 @@ namespace pb {
     // to kill long running script
     std::vector<std::shared_ptr<ScriptWorkTime>> _timing;
 
+    // top-level code of compile and check_code, which may run on any thread
+    // (or several at once) and does not fit into the per-thread slots
+    std::vector<std::shared_ptr<ScriptWorkTime>> _compileTiming;
+
+    // GC pauses shared by all isolates (including check_code ones)
+    std::shared_ptr<GCPauses> _gcPauses;
+
+    // thread mode: i-th function is compiled in _isolates[i],
+    // a slot is replaced under the locker of its isolate
+    std::unordered_map<
+      ConvNodePair,
+      std::vector<PersistentFunction>,
+      Hash<ConvNodePair>
+    > _replicas;
+
+    // serializes publishing compiles, removes, new isolates and changes
+    // of hot conv replicas, taken before _compileMutex
+    std::mutex _replicaMutex;
+
+    // compiles build a version without _replicaMutex and hold it shared,
+    // so the isolates they build in are not retired meanwhile.
+    // Taken before _replicaMutex
+    std::shared_mutex _retireMutex;
+
+    // bumped under _replicaMutex when isolates, conv bindings or hot replicas
+    // change: a compile which built its version meanwhile builds it again
+    uint64_t _layoutVersion;
+
+    // source of every live function, to compile it again in another isolate
+    // when its isolate is retired
+    std::unordered_map<
+      ConvNodePair,
+      std::string,
+      Hash<ConvNodePair>
+    > _sources;
+
+    // load of a conv-mode conv and isolates which have its copy,
+    // counters are updated under the shared _compileMutex
+    struct ConvLoad {
+      std::atomic<uint64_t> runs{0};
+      std::atomic<uint64_t> lockWaitUs{0};
+      // counters at the last rebalance, under _replicaMutex
+      uint64_t lastRuns = 0;
+      uint64_t lastLockWaitUs = 0;
+
+      std::vector<v8::Isolate*> replicas;
+      std::atomic<std::size_t> next{0};
+    };
+
+    std::unordered_map<
+      Conv,
+      std::unique_ptr<ConvLoad>
+    > _convLoads;
+
+    // convs created in conv contexts mode, with their context in every
+    // isolate which has the conv. Changed under _replicaMutex, runs reach
+    // a context through the creation context of the function
+    std::unordered_map<
+      Conv,
+      std::unordered_map<v8::Isolate*, std::unique_ptr<ConvContext>>
+    > _convContexts;
+    std::atomic<bool> _convContextsEnabled;
+
+    // nodes with a function (or a replica) of every conv: a conv is released
+    // when its last node is removed. Changed under _replicaMutex
+    std::unordered_map<
+      Conv,
+      std::set<Node>
+    > _convNodes;
+
+    // a replaced version of a pair, kept compiled in the isolates which
+    // served it (a copy is reset when its isolate is retired)
+    struct FunctionVersion {
+      uint64_t version = 0;
+      std::string src;
+      std::vector<std::pair<v8::Isolate*, PersistentFunction>> functions;
+    };
+
+    struct PairVersions {
+      // live version and the last one given out
+      uint64_t current = 0;
+      uint64_t last = 0;
+      // the oldest first
+      std::deque<FunctionVersion> previous;
+    };
+
+    // changed under _replicaMutex and the unique _compileMutex
+    std::unordered_map<
+      ConvNodePair,
+      PairVersions,
+      Hash<ConvNodePair>
+    > _versions;
+    std::atomic<std::size_t> _keptVersions;
+
+    // rehashes of the maps above after removals
+    std::size_t _compactions;
+
+    // functions of hot convs in their replica isolates
+    std::unordered_map<
+      ConvNodePair,
+      std::unordered_map<v8::Isolate*, PersistentFunction>,
+      Hash<ConvNodePair>
+    > _hotFunctions;
+
+    // every N-th run of a thread stores its input as a warm-up sample
+    static const std::size_t INPUT_SAMPLE_RATE = 64;
+    static const std::size_t INPUT_SAMPLE_MAX_SIZE = 64 * 1024;
+
+    std::unordered_map<
+      ConvNodePair,
+      std::string,
+      Hash<ConvNodePair>
+    > _recentInputs;
+
+    // nullptr - journal is off
+    std::unique_ptr<Journal> _journal;
+
+    KVStore _kv;
+    Datasets _datasets;
+
+    // memoized results of opted-in pairs
+    ResultCache _results;
+
     std::tuple<int, std::string> _checkCode(
       const char* src,
       const char* data,
@@ -196,46 +674,202 @@ namespace pb {
     std::tuple<int, std::string> _compile(
       const char* conv_id,
       const char* node_id,
-      const char* src);
+      const char* src,
+      const std::size_t& threadId,
+      WarmUp* warmUp);
+
+    std::tuple<int, std::string> _compileBulk(
+      const char* conv_id,
+      std::vector<BulkNode>& nodes,
+      const bool& skipUnchanged);
+
+    // isolate must not be locked by the caller
+    void _warmUp(
+      v8::Isolate* isolate,
+      const std::shared_ptr<IsolateRelatedData>& isolateData,
+      const PersistentFunction& pFunc,
+      const std::string& sample,
+      const std::size_t& threadId,
+      WarmUp* warmUp);
+
+    // keep a recent real input of the pair for warm-ups
+    void _sampleInput(const ConvNodePair& pair, const char* data);
+
+    // compile journal entries of one isolate, returns amount of restored functions
+    std::size_t _replay(
+      v8::Isolate* isolate,
+      const std::vector<const Journal::Entry*>& entries,
+      std::mutex& functionsMutex,
+      std::atomic<std::size_t>& cacheRejected);
 
     std::tuple<int, std::string> _remove(
       const char* conv_id,
       const char* node_id);
 
+    std::tuple<int, std::string> _removeConv(const char* conv_id);
+
+    std::tuple<int, std::string> _rollback(const char* conv_id, const char* node_id);
+
+    // the next three are called under _replicaMutex and the unique _compileMutex:
+    // drop the pair everywhere, true if it had a function
+    bool _erasePair(const ConvNodePair& key);
+    // a conv without nodes gives up its isolate, contexts and map entries
+    void _releaseConv(const Conv& conv);
+    void _compactRegistry();
+
+    // context to compile the conv in (isolate is locked, under _replicaMutex):
+    // its own one in conv contexts mode, created on first use, or the shared one
+    v8::Local<v8::Context> _convContext(const Conv& conv,
+                                        v8::Isolate* isolate,
+                                        const std::shared_ptr<IsolateRelatedData>& isolateData);
+    // drop contexts of the conv (or only the one in the isolate), under _replicaMutex
+    void _dropConvContexts(const Conv& conv, v8::Isolate* isolate = nullptr);
+
+    // thread mode versions of compile and remove
+    std::tuple<int, std::string> _compileReplicated(
+      const char* conv_id,
+      const char* node_id,
+      const char* src,
+      const std::size_t& threadId,
+      WarmUp* warmUp);
+
+    std::tuple<int, std::string> _removeReplicated(
+      const char* conv_id,
+      const char* node_id);
+
+    // compile src in the context (entered, isolate is locked) and keep
+    // the function it evaluates to
+    std::tuple<int, std::string> _compileFunction(
+      v8::Isolate* isolate,
+      v8::Local<v8::Context> context,
+      const char* src,
+      PersistentFunction& function,
+      std::string* codeCache = nullptr);
+
     std::tuple<int, std::string> _run(
       const char* conv_id,
       const char* node_id,
       const char* data,
-      const std::size_t& threadId);
-
-    void _setIsolates(const std::size_t& N);
+      const std::size_t& threadId,
+      RunTrace* trace,
+      const std::size_t& maxExecutionTime);
+
+    // returns when the first readyCount isolates are created
+    void _setIsolates(const std::size_t& N, const std::size_t& readyCount);
+    void _startupFunc();
+    // create, precompile and publish an isolate on the calling thread
+    void _addIsolate(const std::size_t& index);
+    // called under the unique _retireMutex and _replicaMutex for the last isolate:
+    // compiles functions of its convs in the remaining ones, then publishes the move
+    // under the unique _compileMutex. False (and nothing changed) if one does not compile
+    bool _retireIsolate(v8::Isolate* isolate);
+    std::size_t _sinceStartupUs() const;
 
     void _timeCheckerFunc();
 
+    // register top-level code in _compileTiming for the time checker,
+    // unwatch it before the isolate is disposed
+    std::shared_ptr<ScriptWorkTime> _watch(v8::Isolate* isolate, const EXECUTION_KIND& kind);
+    void _unwatch(const std::shared_ptr<ScriptWorkTime>& timing);
+
+    void _hotConvsFunc();
+    // compile the conv into the least busy isolate which has no copy of it,
+    // called under _replicaMutex
+    void _addConvReplica(const Conv& conv, std::unordered_map<v8::Isolate*, uint64_t>& isolateRuns);
+    // called under _replicaMutex and the unique _compileMutex
+    void _dropConvReplica(const Conv& conv, v8::Isolate* replica);
+    // isolates of the conv (its own one first, then the hot replicas) with
+    // the context to compile in, under _replicaMutex. The build does not
+    // touch the registry, _resetBuild drops what it made
+    std::vector<BuildTarget> _buildTargets(const Conv& conv,
+                                           v8::Isolate* isolate,
+                                           const std::shared_ptr<IsolateRelatedData>& isolateData);
+    void _resetBuild(std::vector<BuildTarget>& targets,
+                     std::vector<std::pair<v8::Isolate*, PersistentFunction>>& functions);
+    // keep the NUMA node of the conv isolate for getConvNode, nullptr - the conv
+    // is gone. Called under the unique _compileMutex, topology-aware mode only
+    void _placeConv(const Conv& conv, v8::Isolate* isolate);
+    // isolate of the conv (the next one for a new conv), under _replicaMutex
+    void _bindConv(const Conv& conv,
+                   v8::Isolate*& isolate,
+                   std::shared_ptr<IsolateRelatedData>& isolateData);
+    // make functions (the conv isolate first in conv mode) the live version of
+    // the pair, the replaced one is kept if keepLive. Called under _replicaMutex
+    // and the unique _compileMutex, so runs see the old or the new version only
+    void _publishVersion(const ConvNodePair& key,
+                         const std::string& src,
+                         std::vector<std::pair<v8::Isolate*, PersistentFunction>>& functions,
+                         const std::string& codeCache,
+                         const bool& keepLive = true);
+    // reset the oldest versions down to kept
+    void _trimVersions(PairVersions& versions, const std::size_t& kept);
+    // take a handle out of the registry under the unique _compileMutex without
+    // locking its isolate, where a compile may run top-level code meanwhile
+    void _displace(v8::Isolate* isolate, PersistentFunction& function);
+    void _displace(v8::Isolate* isolate, std::unique_ptr<ConvContext>& context);
+    // reset displaced handles (of the isolate only, if given) under their
+    // lockers, called without _replicaMutex and _compileMutex
+    void _resetDisplaced(v8::Isolate* isolate = nullptr);
+    // route a run of a replicated conv, called under the shared _compileMutex
+    void _pickReplica(const ConvNodePair& key,
+                      ConvLoad& load,
+                      v8::Isolate*& isolate,
+                      const PersistentFunction*& function);
+
     static void _Print(const v8::FunctionCallbackInfo<v8::Value>& args);
 
     static void _Require(const v8::FunctionCallbackInfo<v8::Value>& args);
 
-    static std::string _makeTryCatchError(const v8::TryCatch& try_catch);
+    static void _KVGet(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void _KVVersion(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+    // called under the isolate locker inside the context
+    void _syncDatasets(v8::Isolate* isolate, v8::Local<v8::Context> context);
+    static void _deepFreeze(v8::Local<v8::Context> context, v8::Local<v8::Value> value);
+
+    static void _GCPrologue(v8::Isolate* isolate, v8::GCType type, v8::GCCallbackFlags flags);
+    static void _GCEpilogue(v8::Isolate* isolate, v8::GCType type, v8::GCCallbackFlags flags);
+    static GC_KIND _gcKind(v8::GCType type);
 
-    static std::tuple<int, std::string> _getRequireFile(const std::string& fileName);
+    static std::string _makeTryCatchError(const v8::TryCatch& try_catch);
 
     // Stringify V8 value to JSON
     // return empty string for empty value
     static std::string _jsonStr(v8::Isolate* isolate, v8::Handle<v8::Value> value);
 
-    static std::string _readFile(const std::string& filename); // maybe boost ?
-
   private:
 
     std::shared_mutex _compileMutex;
     std::shared_mutex _timeCheckerMutex;
+    std::mutex _recentInputsMutex;
+
+    // handles waiting for _resetDisplaced
+    std::mutex _displacedMutex;
+    std::vector<std::pair<v8::Isolate*, PersistentFunction>> _displacedFunctions;
+    std::vector<std::pair<v8::Isolate*, std::unique_ptr<ConvContext>>> _displacedContexts;
 
     std::thread _timeChecker;
 
+    HotConvs _hotConvsOptions;
+    std::thread _hotConvsThread;
+    std::mutex _hotConvsMutex;
+    std::condition_variable _hotConvsVar;
+    bool _hotConvsStop;
+
+    // isolate creation, see _setIsolates
+    std::vector<std::thread> _startupThreads;
+    std::condition_variable_any _isolatesCreated;
+    std::atomic<std::size_t> _nextIsolate;
+    std::atomic<bool> _startupStop;
+    std::size_t _isolatesExpected;
+    std::chrono::steady_clock::time_point _startupStarted;
+    StartupStatistics _startup;
+
     bool _timeCheckerWatch;
 
     std::size_t _maxExecutionTime;
+    std::size_t _maxCompileTime;
+    std::size_t _maxCheckCodeTime;
     std::size_t _maxRAMAvailable;
     std::size_t _timeCheckerSleepTime;
     std::size_t _threadsCount;
@@ -41,9 +41,21 @@ FILES = {
     'tests': 'tests',
     'libv8runner': 'libv8runner.so',
     'ov8runner': 'v8runner.o',
+    'ov8platform': 'v8platform.o',
+    'ojournal': 'journal.o',
+    'onativedate': 'nativedate.o',
+    'onativecrypto': 'nativecrypto.o',
+    'okvstore': 'kvstore.o',
+    'odatasets': 'datasets.o',
+    'olibcache': 'libcache.o',
+    'oresultcache': 'resultcache.o',
     'libgtest': 'libgtest.a',
     'parallelTest': 'parallel_test',
-    'parallelTestTp': 'parallel_test_tp'
+    'parallelTestTp': 'parallel_test_tp',
+    'soakTest': 'soak_test',
+    'poolBench': 'pool_bench',
+    'inlineTaskTest': 'inline_task_test',
+    'cryptoBench': 'crypto_bench'
 }
 
 DIRS = {key: fullPath(value) for key, value in DIRS.iteritems()}
@@ -96,9 +108,17 @@ def cnode(v8Path):
     VARS['compiler'] = COMPILER
 
     commands = [
-        '{compiler} -c -o {obj}/{ov8runner} -fpic {src}/v8runner.cpp -I{include} -I{v8}/include/ -Wall -Werror -std=c++17'.format(**VARS),
-        '{compiler} -shared -o {lib}/{libv8runner} {obj}/{ov8runner} {v8}/out.gn/x64.release/obj/v8_libplatform/*.o {v8}/out.gn/x64.release/obj/v8_libbase/*.o -L{build}/lib -L{v8}/out.gn/x64.release -lpthread -licuuc -licui18n -licuio -licudata -Wall -Werror -std=c++17'.format(**VARS),
-        '{compiler} -o {bin}/{cnode} -I{include} -I{v8}/include/ -I{erlangInclude} -L{build}/lib -L{lib} -L{v8}/out.gn/x64.release/ -L{erlangLibs} cnode_main.cpp {src}/cnode.cpp -lerl_interface -lei -lnsl -lpthread -licuuc -licui18n -licuio -licudata {lib}/{libv8runner} -lv8 -std=c++17 -lstdc++fs -Wall -Werror -Wno-write-strings -Wl,-rpath-link,{v8}/out.gn/x64.release/'.format(**VARS),
+        '{compiler} -c -o {obj}/{ov8runner} -fpic {src}/v8runner.cpp -I{include} -I{build}/include -I{v8}/include/ -Wall -Werror -std=c++17'.format(**VARS),
+        '{compiler} -c -o {obj}/{ov8platform} -fpic {src}/v8platform.cpp -I{include} -I{v8}/include/ -Wall -Werror -std=c++17'.format(**VARS),
+        '{compiler} -c -o {obj}/{ojournal} -fpic {src}/journal.cpp -I{include} -Wall -Werror -std=c++17'.format(**VARS),
+        '{compiler} -c -o {obj}/{onativedate} -fpic {src}/nativedate.cpp -I{include} -I{build}/include -I{v8}/include/ -Wall -Werror -std=c++17'.format(**VARS),
+        '{compiler} -c -o {obj}/{onativecrypto} -fpic {src}/nativecrypto.cpp -I{include} -I{v8}/include/ -Wall -Werror -std=c++17'.format(**VARS),
+        '{compiler} -c -o {obj}/{okvstore} -fpic {src}/kvstore.cpp -I{include} -Wall -Werror -Wno-deprecated-declarations -std=c++17'.format(**VARS),
+        '{compiler} -c -o {obj}/{odatasets} -fpic {src}/datasets.cpp -I{include} -Wall -Werror -Wno-deprecated-declarations -std=c++17'.format(**VARS),
+        '{compiler} -c -o {obj}/{olibcache} -fpic {src}/libcache.cpp -I{include} -Wall -Werror -std=c++17'.format(**VARS),
+        '{compiler} -c -o {obj}/{oresultcache} -fpic {src}/resultcache.cpp -I{include} -Wall -Werror -std=c++17'.format(**VARS),
+        '{compiler} -shared -o {lib}/{libv8runner} {obj}/{ov8runner} {obj}/{ov8platform} {obj}/{ojournal} {obj}/{onativedate} {obj}/{onativecrypto} {obj}/{okvstore} {obj}/{odatasets} {obj}/{olibcache} {obj}/{oresultcache} {v8}/out.gn/x64.release/obj/v8_libplatform/*.o {v8}/out.gn/x64.release/obj/v8_libbase/*.o -L{build}/lib -L{v8}/out.gn/x64.release -lpthread -lstdc++fs -lcrypto -lz -licuuc -licui18n -licuio -licudata -Wall -Werror -std=c++17'.format(**VARS),
+        '{compiler} -o {bin}/{cnode} -I{include} -I{build}/include -I{v8}/include/ -I{erlangInclude} -L{build}/lib -L{lib} -L{v8}/out.gn/x64.release/ -L{erlangLibs} cnode_main.cpp {src}/cnode.cpp -lerl_interface -lei -lnsl -lpthread -licuuc -licui18n -licuio -licudata {lib}/{libv8runner} -lv8 -std=c++17 -lstdc++fs -Wall -Werror -Wno-write-strings -Wl,-rpath-link,{v8}/out.gn/x64.release/'.format(**VARS),
     ]
 
     for command in commands:
@@ -129,11 +149,23 @@ def tests(v8Path):
     VARS['compiler'] = COMPILER
 
     commands = [
-        '{compiler} -c -o {obj}/{ov8runner} -fpic {src}/v8runner.cpp -I{include} -I{v8}/include/ -Wall -Werror -std=c++17'.format(**VARS),
-        '{compiler} -shared -o {lib}/{libv8runner} {obj}/{ov8runner} {v8}/out.gn/x64.release/obj/v8_libplatform/*.o {v8}/out.gn/x64.release/obj/v8_libbase/*.o -L{build}/lib -L{v8}/out.gn/x64.release -lpthread -licuuc -licui18n -licuio -licudata -Wall -Werror -std=c++17'.format(**VARS),
-        "{compiler} -fopenmp -o {bin}/{tests} -I{include} -I{v8}/include/ -I{gtest}/include -L{build}/lib -L{lib} -L{v8}/out.gn/x64.release/ {tests}/test.cpp {lib}/{libgtest} -lpthread -licuuc -licui18n -licuio -licudata {lib}/{libv8runner} -lv8 -std=c++17 -lstdc++fs -Wl,-rpath-link,{v8}/out.gn/x64.release/".format(**VARS),
-        "{compiler} -fopenmp -o {bin}/{parallelTest} -I{include} -I{v8}/include/ -I{gtest}/include -L{build}/lib -L{lib} -L{v8}/out.gn/x64.release/ {tests}/parallel_test.cpp -lpthread -licuuc -licui18n -licuio -licudata {lib}/{libv8runner} -lv8 -std=c++17 -lstdc++fs -Wl,-rpath-link,{v8}/out.gn/x64.release/".format(**VARS),
-        "{compiler} -fopenmp -o {bin}/{parallelTestTp} -I{include} -I{v8}/include/ -I{gtest}/include -L{build}/lib -L{lib} -L{v8}/out.gn/x64.release/ {tests}/parallel_test_using_tp.cpp -lpthread -licuuc -licui18n -licuio -licudata {lib}/{libv8runner} -lv8 -std=c++17 -lstdc++fs -Wl,-rpath-link,{v8}/out.gn/x64.release/".format(**VARS),
+        '{compiler} -c -o {obj}/{ov8runner} -fpic {src}/v8runner.cpp -I{include} -I{build}/include -I{v8}/include/ -Wall -Werror -std=c++17'.format(**VARS),
+        '{compiler} -c -o {obj}/{ov8platform} -fpic {src}/v8platform.cpp -I{include} -I{v8}/include/ -Wall -Werror -std=c++17'.format(**VARS),
+        '{compiler} -c -o {obj}/{ojournal} -fpic {src}/journal.cpp -I{include} -Wall -Werror -std=c++17'.format(**VARS),
+        '{compiler} -c -o {obj}/{onativedate} -fpic {src}/nativedate.cpp -I{include} -I{build}/include -I{v8}/include/ -Wall -Werror -std=c++17'.format(**VARS),
+        '{compiler} -c -o {obj}/{onativecrypto} -fpic {src}/nativecrypto.cpp -I{include} -I{v8}/include/ -Wall -Werror -std=c++17'.format(**VARS),
+        '{compiler} -c -o {obj}/{okvstore} -fpic {src}/kvstore.cpp -I{include} -Wall -Werror -Wno-deprecated-declarations -std=c++17'.format(**VARS),
+        '{compiler} -c -o {obj}/{odatasets} -fpic {src}/datasets.cpp -I{include} -Wall -Werror -Wno-deprecated-declarations -std=c++17'.format(**VARS),
+        '{compiler} -c -o {obj}/{olibcache} -fpic {src}/libcache.cpp -I{include} -Wall -Werror -std=c++17'.format(**VARS),
+        '{compiler} -c -o {obj}/{oresultcache} -fpic {src}/resultcache.cpp -I{include} -Wall -Werror -std=c++17'.format(**VARS),
+        '{compiler} -shared -o {lib}/{libv8runner} {obj}/{ov8runner} {obj}/{ov8platform} {obj}/{ojournal} {obj}/{onativedate} {obj}/{onativecrypto} {obj}/{okvstore} {obj}/{odatasets} {obj}/{olibcache} {obj}/{oresultcache} {v8}/out.gn/x64.release/obj/v8_libplatform/*.o {v8}/out.gn/x64.release/obj/v8_libbase/*.o -L{build}/lib -L{v8}/out.gn/x64.release -lpthread -lstdc++fs -lcrypto -lz -licuuc -licui18n -licuio -licudata -Wall -Werror -std=c++17'.format(**VARS),
+        "{compiler} -fopenmp -o {bin}/{tests} -I{include} -I{build}/include -I{v8}/include/ -I{gtest}/include -L{build}/lib -L{lib} -L{v8}/out.gn/x64.release/ {tests}/test.cpp {lib}/{libgtest} -lpthread -licuuc -licui18n -licuio -licudata {lib}/{libv8runner} -lv8 -std=c++17 -lstdc++fs -Wl,-rpath-link,{v8}/out.gn/x64.release/".format(**VARS),
+        "{compiler} -fopenmp -o {bin}/{parallelTest} -I{include} -I{build}/include -I{v8}/include/ -I{gtest}/include -L{build}/lib -L{lib} -L{v8}/out.gn/x64.release/ {tests}/parallel_test.cpp -lpthread -licuuc -licui18n -licuio -licudata {lib}/{libv8runner} -lv8 -std=c++17 -lstdc++fs -Wl,-rpath-link,{v8}/out.gn/x64.release/".format(**VARS),
+        "{compiler} -fopenmp -o {bin}/{parallelTestTp} -I{include} -I{build}/include -I{v8}/include/ -I{gtest}/include -L{build}/lib -L{lib} -L{v8}/out.gn/x64.release/ {tests}/parallel_test_using_tp.cpp -lpthread -licuuc -licui18n -licuio -licudata {lib}/{libv8runner} -lv8 -std=c++17 -lstdc++fs -Wl,-rpath-link,{v8}/out.gn/x64.release/".format(**VARS),
+        "{compiler} -o {bin}/{soakTest} -I{include} -I{build}/include -I{v8}/include/ -L{build}/lib -L{lib} -L{v8}/out.gn/x64.release/ {tests}/soak_test.cpp -lpthread -licuuc -licui18n -licuio -licudata {lib}/{libv8runner} -lv8 -std=c++17 -lstdc++fs -Wl,-rpath-link,{v8}/out.gn/x64.release/".format(**VARS),
+        "{compiler} -O2 -o {bin}/{poolBench} -I{include} {tests}/pool_bench.cpp -lpthread -std=c++17".format(**VARS),
+        "{compiler} -o {bin}/{inlineTaskTest} -I{include} -I{gtest}/include {tests}/inline_task_test.cpp {lib}/{libgtest} -lpthread -std=c++17".format(**VARS),
+        "{compiler} -o {bin}/{cryptoBench} -I{include} -I{build}/include -I{v8}/include/ -L{build}/lib -L{lib} -L{v8}/out.gn/x64.release/ {tests}/crypto_bench.cpp -lpthread -licuuc -licui18n -licuio -licudata {lib}/{libv8runner} -lv8 -std=c++17 -lstdc++fs -Wl,-rpath-link,{v8}/out.gn/x64.release/".format(**VARS),
     ];
 
     for command in commands:
@@ -3,8 +3,113 @@
 CNode::CNode(
   const std::shared_ptr<pb::V8Runner>& v8,
   const std::size_t& maxDiffTime,
-  ThreadPool& pool
-):_v8(v8), _maxDiffTime(maxDiffTime), _pool(pool) {}
+  ThreadPool& pool,
+  const PoolScaling& scaling /* = PoolScaling() */
+):_v8(v8), _maxDiffTime(maxDiffTime), _pool(pool), _scaling(scaling),
+  _scalingChanged(true), _scalingStop(false),
+  _runCoalescing(false) {
+
+  if (this->_scaling.maxThreads == 0) {
+    this->_scaling.minThreads = this->_scaling.maxThreads = this->_pool.size();
+  }
+  this->_scaling.minThreads = std::max<std::size_t>(1, std::min(this->_scaling.minThreads, this->_scaling.maxThreads));
+
+  this->_scaler = std::thread(&CNode::scalingFunc, this);
+}
+
+CNode::~CNode() {
+  {
+    std::lock_guard<std::mutex> guard(this->_scalingMutex);
+    this->_scalingStop = true;
+  }
+  this->_scalingVar.notify_one();
+  this->_scaler.join();
+}
+
+void CNode::scalingFunc() {
+  const auto tick = std::chrono::milliseconds(100);
+
+  auto lastQueueWait = this->_pool.getQueueWait();
+  std::size_t busySamples = 0;
+  double busyRatioSum = 0;
+  auto lastDecision = std::chrono::steady_clock::now();
+
+  std::unique_lock<std::mutex> lock(this->_scalingMutex);
+
+  while (!this->_scalingStop) {
+    this->_scalingVar.wait_for(lock, tick, [this] { return this->_scalingStop || this->_scalingChanged; });
+    if (this->_scalingStop) {
+      break;
+    }
+
+    const std::size_t size = this->_pool.size();
+
+    busyRatioSum += static_cast<double>(this->_pool.getBusyThreads()) / size;
+    busySamples += 1;
+
+    const auto now = std::chrono::steady_clock::now();
+    const bool decide = now - lastDecision >= std::chrono::milliseconds(this->_scaling.intervalMs);
+
+    if (!decide && !this->_scalingChanged) {
+      continue;
+    }
+
+    // new bounds first
+    std::size_t target = std::min(std::max(size, this->_scaling.minThreads), this->_scaling.maxThreads);
+
+    if (decide) {
+      const auto queueWait = this->_pool.getQueueWait();
+      const auto waitP99 = queueWait.since(lastQueueWait).percentile(99);
+      const double busyRatio = busyRatioSum / busySamples;
+
+      if (waitP99 > this->_scaling.growQueueWaitUs && target < this->_scaling.maxThreads) {
+        target += 1;
+      } else if (busyRatio < this->_scaling.shrinkBusyRatio &&
+                 waitP99 <= this->_scaling.growQueueWaitUs / 4 &&
+                 target > this->_scaling.minThreads) {
+        target -= 1;
+      }
+
+      lastQueueWait = queueWait;
+      busyRatioSum = 0;
+      busySamples = 0;
+      lastDecision = now;
+    }
+
+    this->_scalingChanged = false;
+
+    // retiring isolates takes a while, commands read the bounds meanwhile
+    lock.unlock();
+    this->resizePool(target);
+    lock.lock();
+  }
+}
+
+void CNode::resizePool(const std::size_t& threadsCount) {
+  const std::size_t size = this->_pool.size();
+
+  if (threadsCount > size) {
+    // isolates (and _timing slots) must be there before threads with new numbers
+    this->_v8->resizeIsolates(threadsCount);
+    this->_pool.resize(threadsCount);
+    std::cout << "[scaling] pool grown to " << threadsCount << " threads" << std::endl;
+  } else if (threadsCount < size) {
+    this->_pool.resize(threadsCount);
+    this->_v8->resizeIsolates(threadsCount);
+    std::cout << "[scaling] pool shrunk to " << threadsCount << " threads" << std::endl;
+  } else if (this->_v8->isolates_count() > threadsCount) {
+    // a retire postponed by a warm-up
+    this->_v8->resizeIsolates(threadsCount);
+  }
+}
+
+void CNode::setRunCoalescing(const bool& enabled) {
+  this->_runCoalescing = enabled;
+}
+
+bool CNode::getRunCoalescing() const {
+  return this->_runCoalescing;
+}
 
 void CNode::process(int fd, ErlMessage*& emsg) {
 
@@ -16,13 +121,24 @@ void CNode::process(int fd, ErlMessage*& emsg) {
 
   const auto timestamp = ERL_LL_UVALUE(timestampTerm);
 
+  const auto received = std::chrono::steady_clock::now();
+
+  // optional {call, From, Request, TimeoutMs}: the deadline is taken on the
+  // monotonic clock at receive and replaces the check of the caller's timestamp
+  const bool hasDeadline = ERL_TUPLE_SIZE(emsg->msg) >= 4;
+  auto deadline = received + std::chrono::milliseconds(this->_maxDiffTime);
+  if (hasDeadline) {
+    ETERMptr timeoutTerm(erl_element(4, emsg->msg), ErlFreeTerm);
+    deadline = received + std::chrono::milliseconds(ERL_INT_UVALUE(timeoutTerm));
+  }
+
   const auto now = std::chrono::system_clock::now();
   const auto timeNow =
     std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch());
 
   std::size_t timeDiff = abs(static_cast<long long>(timeNow.count()) - static_cast<long long>(timestamp));
 
-  if (timeDiff > this->_maxDiffTime) {
+  if (!hasDeadline && timeDiff > this->_maxDiffTime) {
     auto resp = ETERMptr(erl_format("{cnode, ~i, ~b}", CNode::STATUS::SOCKET_TIMEOUT, "Socket queue timeout."), ErlFreeTerm);
     erl_send(fd, fromp.get(), resp.get());
     return;
@@ -30,8 +146,17 @@ void CNode::process(int fd, ErlMessage*& emsg) {
 
   if (strcmp(ERL_ATOM_PTR(func.get()), "get_statistics") == 0) {
     int poolThreadsCount = this->_pool.size();
+    long poolQueueWaitP99 = this->_pool.getQueueWait().percentile(99);
+    std::size_t poolMin;
+    std::size_t poolMax;
+    {
+      std::lock_guard<std::mutex> guard(this->_scalingMutex);
+      poolMin = this->_scaling.minThreads;
+      poolMax = this->_scaling.maxThreads;
+    }
     int threadsBusy = this->_pool.getBusyThreads();
     int jobsLeft = this->_pool.getJobsLeft();
+    int jobsStolen = this->_pool.getJobsStolen();
     std::size_t isolates_count = this->_v8->isolates_count();
 
     auto jobsPerThread = this->_pool.getJobsPerThread();
@@ -52,22 +177,176 @@ void CNode::process(int fd, ErlMessage*& emsg) {
       erl_free_term(arr[i]);
     }
 
+    ETERMptr gcTerm = this->makeGCStatisticsTerm();
+
+    auto platformStats = this->_v8->getPlatformStatistics();
+
+    ETERMptr platformTerm = ETERMptr(
+      erl_format("["
+                   "{background_threads, ~i},"
+                   "{tasks_posted, ~l},"
+                   "{blocking_tasks_posted, ~l},"
+                   "{long_running_tasks_posted, ~l},"
+                   "{tasks_queued, ~l},"
+                   "{tasks_done, ~l},"
+                   "{queue_wait_p99_us, ~l},"
+                   "{run_time_p99_us, ~l}"
+                 "]",
+                 static_cast<int>(platformStats.backgroundThreadsCount),
+                 static_cast<long>(platformStats.tasksPosted),
+                 static_cast<long>(platformStats.blockingTasksPosted),
+                 static_cast<long>(platformStats.longRunningTasksPosted),
+                 static_cast<long>(platformStats.tasksQueued),
+                 static_cast<long>(platformStats.tasksDone),
+                 static_cast<long>(platformStats.queueWaitUs.percentile(99)),
+                 static_cast<long>(platformStats.runTimeUs.percentile(99))),
+      ErlFreeTerm);
+
+    auto startup = this->_v8->getStartupStatistics();
+    ETERMptr startupTerm = ETERMptr(
+      erl_format("["
+                   "{libs, ~i},"
+                   "{libs_us, ~l},"
+                   "{isolates, ~i},"
+                   "{precompiled_libs, ~i},"
+                   "{first_isolate_us, ~l},"
+                   "{slowest_isolate_us, ~l},"
+                   "{ready_us, ~l},"
+                   "{all_isolates_us, ~l}"
+                 "]",
+                 static_cast<int>(startup.libsCount),
+                 static_cast<long>(startup.libsUs),
+                 static_cast<int>(startup.isolatesCount),
+                 static_cast<int>(startup.precompiledLibs),
+                 static_cast<long>(startup.firstIsolateUs),
+                 static_cast<long>(startup.slowestIsolateUs),
+                 static_cast<long>(startup.readyUs),
+                 static_cast<long>(startup.allIsolatesUs)),
+      ErlFreeTerm);
+
+    auto hotConvs = this->_v8->getHotConvs();
+    std::shared_ptr<ETERM*> hotConvs_e = make_shared_array<ETERM*>(hotConvs.size());
+    {
+      auto arr = hotConvs_e.get();
+      int i = 0;
+      for (const auto& hot: hotConvs) {
+        arr[i++] = erl_format("{~b, ~i}", hot.first.c_str(), static_cast<int>(hot.second));
+      }
+    }
+
+    ETERMptr hotConvsTerm(erl_mk_list(hotConvs_e.get(), hotConvs.size()), ErlFreeTerm);
+
+    for (std::size_t i = 0; i < hotConvs.size(); ++i) {
+      erl_free_term(hotConvs_e.get()[i]);
+    }
+
+    // share of runs answered by a run in flight, in percent
+    const auto coalescing = this->_inFlightRuns.statistics();
+    ETERMptr coalescingTerm = ETERMptr(
+      erl_format("["
+                   "{enabled, ~i},"
+                   "{runs, ~l},"
+                   "{coalesced, ~l},"
+                   "{hit_rate_pct, ~i}"
+                 "]",
+                 this->_runCoalescing ? 1 : 0,
+                 static_cast<long>(coalescing.runs),
+                 static_cast<long>(coalescing.coalesced),
+                 coalescing.runs ? static_cast<int>(coalescing.coalesced * 100 / coalescing.runs) : 0),
+      ErlFreeTerm);
+
+    const auto memo = this->_v8->getMemoizationStatistics();
+    const uint64_t memoLookups = memo.hits + memo.misses;
+    ETERMptr memoTerm = ETERMptr(
+      erl_format("["
+                   "{hits, ~l},"
+                   "{misses, ~l},"
+                   "{hit_rate_pct, ~i},"
+                   "{evictions, ~l},"
+                   "{expired, ~l},"
+                   "{entries, ~l},"
+                   "{bytes, ~l},"
+                   "{budget_bytes, ~l}"
+                 "]",
+                 static_cast<long>(memo.hits),
+                 static_cast<long>(memo.misses),
+                 memoLookups ? static_cast<int>(memo.hits * 100 / memoLookups) : 0,
+                 static_cast<long>(memo.evictions),
+                 static_cast<long>(memo.expired),
+                 static_cast<long>(memo.entries),
+                 static_cast<long>(memo.bytes),
+                 static_cast<long>(memo.budgetBytes)),
+      ErlFreeTerm);
+
+    // queued jobs and their wait per priority level of the pool
+    auto levels = this->_pool.getLevels();
+    std::shared_ptr<ETERM*> levels_e = make_shared_array<ETERM*>(levels.size());
+    {
+      auto arr = levels_e.get();
+      int i = 0;
+      for (const auto& level: levels) {
+        arr[i++] = erl_format("{~i, ["
+                                "{queued, ~i},"
+                                "{wait_p50_us, ~l},"
+                                "{wait_p99_us, ~l},"
+                                "{wait_max_us, ~l}"
+                              "]}",
+                              level.first,
+                              static_cast<int>(level.second.queued),
+                              static_cast<long>(level.second.waitUs.percentile(50)),
+                              static_cast<long>(level.second.waitUs.percentile(99)),
+                              static_cast<long>(level.second.waitUs.max));
+      }
+    }
+
+    ETERMptr levelsTerm(erl_mk_list(levels_e.get(), levels.size()), ErlFreeTerm);
+
+    for (std::size_t i = 0; i < levels.size(); ++i) {
+      erl_free_term(levels_e.get()[i]);
+    }
+
     ETERMptr resp = ETERMptr(
       erl_format("{cnode, ~i,"
                  "["
                    "{pool_threads_count, ~i},"
+                   "{pool_min, ~i},"
+                   "{pool_max, ~i},"
+                   "{pool_queue_wait_p99_us, ~l},"
                    "{isolates_count, ~i},"
                    "{theads_busy, ~i},"
                    "{jobs_left, ~i},"
-                   "{jobs_per_threads, ~w}"
+                   "{jobs_stolen, ~i},"
+                   "{jobs_expired, ~i},"
+                   "{priority_aging_ms, ~i},"
+                   "{priority_levels, ~w},"
+                   "{jobs_per_threads, ~w},"
+                   "{gc, ~w},"
+                   "{platform, ~w},"
+                   "{startup, ~w},"
+                   "{hot_convs, ~w},"
+                   "{run_coalescing, ~w},"
+                   "{memoization, ~w}"
                  "]"
                  "}",
                   CNode::STATUS::OK,
                   poolThreadsCount,
+                  static_cast<int>(poolMin),
+                  static_cast<int>(poolMax),
+                  poolQueueWaitP99,
                   isolates_count,
                   threadsBusy,
                   jobsLeft,
-                  jobsPerThreadTerm.get()),
+                  jobsStolen,
+                  this->_pool.getJobsExpired(),
+                  static_cast<int>(this->_pool.getAging()),
+                  levelsTerm.get(),
+                  jobsPerThreadTerm.get(),
+                  gcTerm.get(),
+                  platformTerm.get(),
+                  startupTerm.get(),
+                  hotConvsTerm.get(),
+                  coalescingTerm.get(),
+                  memoTerm.get()),
       ErlFreeTerm);
 
     erl_send(fd, fromp.get(), resp.get());
@@ -97,6 +376,80 @@ void CNode::process(int fd, ErlMessage*& emsg) {
 
     auto resp = ETERMptr(erl_format("{cnode, ~i, ~i}", CNode::STATUS::OK, this->_v8->getMaxExecutionTime()), ErlFreeTerm);
     erl_send(fd, fromp.get(), resp.get());
+  } else if (strcmp(ERL_ATOM_PTR(func.get()), "set_max_time_compile_threshold") == 0) {
+
+    ETERMptr time_e(erl_element(3, tuplep.get()), ErlFreeTerm);
+
+    const std::size_t compileTime = ERL_INT_UVALUE(time_e);
+    this->_v8->setMaxCompileTime(compileTime);
+
+    auto resp = ETERMptr(erl_format("{cnode, ~i, ~i}", CNode::STATUS::OK, compileTime), ErlFreeTerm);
+    erl_send(fd, fromp.get(), resp.get());
+  } else if (strcmp(ERL_ATOM_PTR(func.get()), "get_max_time_compile_threshold") == 0) {
+
+    auto resp = ETERMptr(erl_format("{cnode, ~i, ~i}", CNode::STATUS::OK, this->_v8->getMaxCompileTime()), ErlFreeTerm);
+    erl_send(fd, fromp.get(), resp.get());
+  } else if (strcmp(ERL_ATOM_PTR(func.get()), "set_max_time_check_code_threshold") == 0) {
+
+    ETERMptr time_e(erl_element(3, tuplep.get()), ErlFreeTerm);
+
+    const std::size_t checkCodeTime = ERL_INT_UVALUE(time_e);
+    this->_v8->setMaxCheckCodeTime(checkCodeTime);
+
+    auto resp = ETERMptr(erl_format("{cnode, ~i, ~i}", CNode::STATUS::OK, checkCodeTime), ErlFreeTerm);
+    erl_send(fd, fromp.get(), resp.get());
+  } else if (strcmp(ERL_ATOM_PTR(func.get()), "get_max_time_check_code_threshold") == 0) {
+
+    auto resp = ETERMptr(erl_format("{cnode, ~i, ~i}", CNode::STATUS::OK, this->_v8->getMaxCheckCodeTime()), ErlFreeTerm);
+    erl_send(fd, fromp.get(), resp.get());
+  } else if (strcmp(ERL_ATOM_PTR(func.get()), "set_memoization") == 0) {
+
+    ETERMptr conv_id_term(erl_element(3, tuplep.get()), ErlFreeTerm);
+    ETERMptr node_id_term(erl_element(4, tuplep.get()), ErlFreeTerm);
+    ETERMptr enabled_e(erl_element(5, tuplep.get()), ErlFreeTerm);
+
+    CharPtr conv_id_c = CharPtr(erl_iolist_to_string(conv_id_term.get()), ErlFree);
+    CharPtr node_id_c = CharPtr(erl_iolist_to_string(node_id_term.get()), ErlFree);
+
+    const bool enabled = ERL_INT_VALUE(enabled_e) == 1;
+
+    // optional: time to live of results in milliseconds
+    std::size_t ttlMs = 0;
+    if (ERL_TUPLE_SIZE(tuplep.get()) >= 6) {
+      ETERMptr ttl_e(erl_element(6, tuplep.get()), ErlFreeTerm);
+      ttlMs = ERL_INT_UVALUE(ttl_e);
+    }
+
+    this->_v8->setMemoization(conv_id_c.get(), node_id_c.get(), enabled, ttlMs);
+
+    auto resp = ETERMptr(erl_format("{cnode, ~i, ~i}", CNode::STATUS::OK, enabled ? 1 : 0), ErlFreeTerm);
+    erl_send(fd, fromp.get(), resp.get());
+  } else if (strcmp(ERL_ATOM_PTR(func.get()), "set_memoization_budget") == 0) {
+
+    ETERMptr budget_e(erl_element(3, tuplep.get()), ErlFreeTerm);
+
+    const std::size_t budgetMb = ERL_INT_UVALUE(budget_e);
+    this->_v8->setMemoizationBudget(budgetMb * 1024 * 1024);
+
+    auto resp = ETERMptr(erl_format("{cnode, ~i, ~i}", CNode::STATUS::OK, budgetMb), ErlFreeTerm);
+    erl_send(fd, fromp.get(), resp.get());
+  } else if (strcmp(ERL_ATOM_PTR(func.get()), "set_run_coalescing") == 0) {
+
+    ETERMptr enabled_e(erl_element(3, tuplep.get()), ErlFreeTerm);
+
+    const bool enabled = ERL_INT_VALUE(enabled_e) == 1;
+    this->setRunCoalescing(enabled);
+
+    auto resp = ETERMptr(erl_format("{cnode, ~i, ~i}", CNode::STATUS::OK, enabled ? 1 : 0), ErlFreeTerm);
+    erl_send(fd, fromp.get(), resp.get());
+  } else if (strcmp(ERL_ATOM_PTR(func.get()), "get_run_coalescing") == 0) {
+
+    auto resp = ETERMptr(erl_format("{cnode, ~i, ~i}", CNode::STATUS::OK, this->_runCoalescing ? 1 : 0), ErlFreeTerm);
+    erl_send(fd, fromp.get(), resp.get());
+  } else if (strcmp(ERL_ATOM_PTR(func.get()), "get_kept_versions") == 0) {
+
+    auto resp = ETERMptr(erl_format("{cnode, ~i, ~i}", CNode::STATUS::OK, this->_v8->getKeptVersions()), ErlFreeTerm);
+    erl_send(fd, fromp.get(), resp.get());
   } else if (strcmp(ERL_ATOM_PTR(func.get()), "get_require_cache_file") == 0) {
 
       ETERMptr fileNameTerm(erl_element(3, tuplep.get()), ErlFreeTerm);
@@ -129,6 +482,34 @@ void CNode::process(int fd, ErlMessage*& emsg) {
         ErlFreeTerm);
 
       erl_send(fd, fromp.get(), resp.get());
+  } else if (strcmp(ERL_ATOM_PTR(func.get()), "set_pool_size") == 0) {
+
+    ETERMptr minTerm(erl_element(3, tuplep.get()), ErlFreeTerm);
+    ETERMptr maxTerm(erl_element(4, tuplep.get()), ErlFreeTerm);
+
+    std::size_t minThreads = ERL_INT_UVALUE(minTerm);
+    std::size_t maxThreads = ERL_INT_UVALUE(maxTerm);
+
+    ETERMptr resp;
+
+    if (minThreads == 0 || minThreads > maxThreads) {
+      resp = ETERMptr(erl_format("{cnode, ~i, ~b}", CNode::STATUS::ERR, "Expected 0 < Min =< Max."), ErlFreeTerm);
+    } else {
+      // applied by the scaling thread, isolates are not retired on this one
+      {
+        std::lock_guard<std::mutex> guard(this->_scalingMutex);
+        this->_scaling.minThreads = minThreads;
+        this->_scaling.maxThreads = maxThreads;
+        this->_scalingChanged = true;
+      }
+      this->_scalingVar.notify_one();
+
+      resp = ETERMptr(
+        erl_format("{cnode, ~i, {min, ~i}, {max, ~i}}", CNode::STATUS::OK, minThreads, maxThreads),
+        ErlFreeTerm);
+    }
+
+    erl_send(fd, fromp.get(), resp.get());
   } else if (strcmp(ERL_ATOM_PTR(func.get()), "get_priorities") == 0) {
 
     auto priorityMapSize = this->_priorityMap.size();
@@ -182,26 +563,76 @@ void CNode::process(int fd, ErlMessage*& emsg) {
       ErlFreeTerm
     );
 
+    erl_send(fd, fromp.get(), resp.get());
+  } else if (strcmp(ERL_ATOM_PTR(func.get()), "set_priority_aging") == 0) {
+
+    ETERMptr aging_e(erl_element(3, tuplep.get()), ErlFreeTerm);
+
+    const std::size_t agingMs = ERL_INT_UVALUE(aging_e);
+    this->_pool.setAging(agingMs);
+
+    auto resp = ETERMptr(erl_format("{cnode, ~i, ~i}", CNode::STATUS::OK, agingMs), ErlFreeTerm);
+    erl_send(fd, fromp.get(), resp.get());
+  } else if (strcmp(ERL_ATOM_PTR(func.get()), "get_priority_aging") == 0) {
+    auto resp = ETERMptr(erl_format("{cnode, ~i, ~i}", CNode::STATUS::OK, this->_pool.getAging()), ErlFreeTerm);
     erl_send(fd, fromp.get(), resp.get());
   } else {
 
-    const auto now = std::chrono::system_clock::now();
-    const auto timeWhenTaskHasBeenAdded =
-      std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch());
-
-    auto job = std::bind(
-      &CNode::processV8,
-      this,
-      fd,
-      fromp,
-      tuplep,
-      func,
-      timeWhenTaskHasBeenAdded,
-      std::placeholders::_1
-    ); // _1 for thread num
+    // a memoized result is sent right away, without the pool and isolates.
+    // Otherwise a duplicate of a run in flight gets its reply, no job is added:
+    // replies are fanned out by processV8, which runs on another thread.
+    // With both off the run is decoded by the worker only
+    pb::RunKey runKey;
+    const bool runCoalescing = this->_runCoalescing;
+    if (strcmp(ERL_ATOM_PTR(func.get()), "run") == 0 &&
+        (runCoalescing || this->_v8->isMemoizationEnabled())) {
+      ETERMptr conv_id_term(erl_element(3, tuplep.get()), ErlFreeTerm);
+      ETERMptr node_id_term(erl_element(4, tuplep.get()), ErlFreeTerm);
+      ETERMptr data_term(erl_element(5, tuplep.get()), ErlFreeTerm);
+
+      CharPtr conv_id_c = CharPtr(erl_iolist_to_string(conv_id_term.get()), ErlFree);
+      CharPtr node_id_c = CharPtr(erl_iolist_to_string(node_id_term.get()), ErlFree);
+      CharPtr data = CharPtr(erl_iolist_to_string(data_term.get()), ErlFree);
+
+      std::string result;
+      if (this->_v8->getMemoized(conv_id_c.get(), node_id_c.get(), data.get(), result)) {
+        auto resp = ETERMptr(
+          erl_format("{cnode, ~i, ~b}", pb::V8Runner::STATUS::NO_ERR, result.c_str()),
+          ErlFreeTerm);
+        erl_send(fd, fromp.get(), resp.get());
+        return;
+      }
+
+      if (runCoalescing) {
+        runKey = pb::RunKey(conv_id_c, node_id_c, data);
+        if (!this->_inFlightRuns.attach(runKey, fromp)) {
+          return;
+        }
+      }
+    }
+
+    // both keep runKey, its copies share the buffers and do not allocate
+    auto job = [this, fd, fromp, tuplep, func, deadline, hasDeadline, runKey](int threadNum) {
+      this->processV8(fd, fromp, tuplep, func, deadline, hasDeadline, runKey, threadNum);
+    };
+    auto expired = [this, fd, fromp, runKey](int threadNum) {
+      this->expireV8(fd, fromp, runKey, threadNum);
+    };
     int priority = this->_priorityMap[ERL_ATOM_PTR(func.get())];
 
-    if(!this->_pool.addJob(priority, job)) {
+    // topology-aware mode: keep the job on the NUMA node of the conv isolate
+    int group = -1;
+    if (this->_v8->isTopologyAware() && this->_convCommands.count(ERL_ATOM_PTR(func.get()))) {
+      ETERMptr conv_id_term(erl_element(3, tuplep.get()), ErlFreeTerm);
+      CharPtr conv_id_c = CharPtr(erl_iolist_to_string(conv_id_term.get()), ErlFree);
+      group = this->_v8->getConvNode(conv_id_c.get());
+    }
+
+    if(!this->_pool.addJob(priority, std::move(job), group, deadline, std::move(expired))) {
+      // duplicates are attached on this thread only, so nobody waits for it yet
+      if (!runKey.empty()) {
+        this->_inFlightRuns.complete(runKey);
+      }
       auto resp = ETERMptr(erl_format("{cnode, ~i, ~b}", CNode::STATUS::THREAD_POOL_EXHAUSTED, "Thread pool exhausted. Try later."), ErlFreeTerm);
       erl_send(fd, fromp.get(), resp.get());
     }
@@ -214,21 +645,24 @@ void CNode::processV8(
   ETERMptr fromp,
   ETERMptr tuplep,
   ETERMptr func,
-  std::chrono::milliseconds timeWhenTaskHasBeenAdded,
+  std::chrono::steady_clock::time_point deadline,
+  bool hasDeadline,
+  const pb::RunKey& runKey,
   int threadNum)
 {
 
   ETERMptr resp;
 
-  const auto now = std::chrono::system_clock::now();
-  const auto timeNow =
-    std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch());
-
-  auto timeDiff = std::size_t((timeNow - timeWhenTaskHasBeenAdded).count());
+  // a run may not outlive the caller's timeout, at least 1ms: 0 is the common limit.
+  // max_diff_time only bounds the wait in the queue
+  std::size_t maxExecutionTime = 0;
+  if (hasDeadline) {
+    const auto budget = std::chrono::duration_cast<std::chrono::milliseconds>(
+      deadline - std::chrono::steady_clock::now()).count();
+    maxExecutionTime = std::max<long long>(budget, 1);
+  }
 
-  if (timeDiff > this->_maxDiffTime) {
-    resp = ETERMptr(erl_format("{cnode, ~i, ~b}", CNode::STATUS::THREAD_POOL_TIMEOUT, "Threadpool queue timeout."), ErlFreeTerm);
-  } else if (strcmp(ERL_ATOM_PTR(func.get()), "check_code") == 0) {
+  if (strcmp(ERL_ATOM_PTR(func.get()), "check_code") == 0) {
 
     ETERMptr src_term(erl_element(3, tuplep.get()), ErlFreeTerm);
     ETERMptr data_term(erl_element(4, tuplep.get()), ErlFreeTerm);
@@ -256,12 +690,107 @@ void CNode::processV8(
     // if run - data is a json
     CharPtr data = CharPtr(erl_iolist_to_string(data_term.get()), ErlFree);
 
-    std::tuple<int, std::string> res = this->_v8->compile(conv_id_c.get(), node_id_c.get(), data.get());
+    // optional: number of warm-up runs and a sample input,
+    // without sample a recent real input of the pair is used
+    const int tupleSize = ERL_TUPLE_SIZE(tuplep.get());
+
+    if (tupleSize >= 6) {
+      pb::V8Runner::WarmUp warmUp;
+
+      ETERMptr runs_term(erl_element(6, tuplep.get()), ErlFreeTerm);
+      warmUp.runs = ERL_INT_UVALUE(runs_term);
+
+      if (tupleSize >= 7) {
+        ETERMptr sample_term(erl_element(7, tuplep.get()), ErlFreeTerm);
+        CharPtr sample = CharPtr(erl_iolist_to_string(sample_term.get()), ErlFree);
+        warmUp.sample = sample.get();
+      }
+
+      std::tuple<int, std::string> res =
+        this->_v8->compile(conv_id_c.get(), node_id_c.get(), data.get(), threadNum, &warmUp);
+
+      resp = ETERMptr(
+        erl_format("{cnode, ~i, ~b, "
+                   "["
+                     "{warm_up_runs, ~l},"
+                     "{warm_up_us, ~l}"
+                   "]"
+                   "}",
+                   std::get<ERR_CODE>(res),
+                   std::get<DATA>(res).c_str(),
+                   static_cast<long>(warmUp.doneRuns),
+                   static_cast<long>(warmUp.timeUs)),
+        ErlFreeTerm);
+    } else {
+      std::tuple<int, std::string> res =
+        this->_v8->compile(conv_id_c.get(), node_id_c.get(), data.get(), threadNum);
+
+      resp = ETERMptr(
+        erl_format("{cnode, ~i, ~b}",
+                   std::get<ERR_CODE>(res),
+                   std::get<DATA>(res).c_str()),
+        ErlFreeTerm);
+    }
+
+  } else if (strcmp(ERL_ATOM_PTR(func.get()), "compile_bulk") == 0) {
+
+    ETERMptr conv_id_term(erl_element(3, tuplep.get()), ErlFreeTerm);
+    ETERMptr nodes_term(erl_element(4, tuplep.get()), ErlFreeTerm);
+
+    CharPtr conv_id_c = CharPtr(erl_iolist_to_string(conv_id_term.get()), ErlFree);
+
+    // optional: 1 - do not compile nodes whose source is already live
+    bool skipUnchanged = false;
+    if (ERL_TUPLE_SIZE(tuplep.get()) >= 5) {
+      ETERMptr skip_term(erl_element(5, tuplep.get()), ErlFreeTerm);
+      skipUnchanged = ERL_INT_VALUE(skip_term) == 1;
+    }
+
+    // [{NodeId, Src}], heads and tails belong to the list and are not freed
+    std::vector<pb::V8Runner::BulkNode> nodes;
+    nodes.reserve(erl_length(nodes_term.get()));
+
+    for (ETERM* list = nodes_term.get(); ERL_IS_CONS(list); list = erl_tl(list)) {
+      ETERM* item = erl_hd(list);
+
+      ETERMptr node_id_term(erl_element(1, item), ErlFreeTerm);
+      ETERMptr src_term(erl_element(2, item), ErlFreeTerm);
+
+      CharPtr node_id_c = CharPtr(erl_iolist_to_string(node_id_term.get()), ErlFree);
+      CharPtr src = CharPtr(erl_iolist_to_string(src_term.get()), ErlFree);
+
+      pb::V8Runner::BulkNode node;
+      node.node = node_id_c.get();
+      node.src = src.get();
+      nodes.push_back(std::move(node));
+    }
+
+    std::tuple<int, std::string> res =
+      this->_v8->compileBulk(conv_id_c.get(), nodes, skipUnchanged);
+
+    // {NodeId, Code, Data} per node, skipped ones have data <<"skipped">>
+    std::shared_ptr<ETERM*> nodes_e = make_shared_array<ETERM*>(nodes.size());
+    {
+      auto arr = nodes_e.get();
+      for (std::size_t i = 0; i < nodes.size(); ++i) {
+        arr[i] = erl_format("{~b, ~i, ~b}",
+                            nodes[i].node.c_str(),
+                            nodes[i].code,
+                            nodes[i].skipped ? "skipped" : nodes[i].data.c_str());
+      }
+    }
+
+    ETERMptr nodesTerm(erl_mk_list(nodes_e.get(), nodes.size()), ErlFreeTerm);
+
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+      erl_free_term(nodes_e.get()[i]);
+    }
 
     resp = ETERMptr(
-      erl_format("{cnode, ~i, ~b}",
+      erl_format("{cnode, ~i, ~b, ~w}",
                  std::get<ERR_CODE>(res),
-                 std::get<DATA>(res).c_str()),
+                 std::get<DATA>(res).c_str(),
+                 nodesTerm.get()),
       ErlFreeTerm);
 
   } else if (strcmp(ERL_ATOM_PTR(func.get()), "remove") == 0) {
@@ -280,6 +809,45 @@ void CNode::processV8(
                  std::get<DATA>(res).c_str()),
       ErlFreeTerm);
 
+  } else if (strcmp(ERL_ATOM_PTR(func.get()), "rollback") == 0) {
+
+    ETERMptr conv_id_term(erl_element(3, tuplep.get()), ErlFreeTerm);
+    ETERMptr node_id_term(erl_element(4, tuplep.get()), ErlFreeTerm);
+
+    CharPtr conv_id_c = CharPtr(erl_iolist_to_string(conv_id_term.get()), ErlFree);
+    CharPtr node_id_c = CharPtr(erl_iolist_to_string(node_id_term.get()), ErlFree);
+
+    std::tuple<int, std::string> res = this->_v8->rollback(conv_id_c.get(), node_id_c.get());
+
+    resp = ETERMptr(
+      erl_format("{cnode, ~i, ~b}",
+                 std::get<ERR_CODE>(res),
+                 std::get<DATA>(res).c_str()),
+      ErlFreeTerm);
+
+  } else if (strcmp(ERL_ATOM_PTR(func.get()), "set_kept_versions") == 0) {
+
+    // trims kept versions of every pair, so it waits for compiles
+    ETERMptr count_term(erl_element(3, tuplep.get()), ErlFreeTerm);
+
+    const std::size_t count = ERL_INT_UVALUE(count_term);
+    this->_v8->setKeptVersions(count);
+
+    resp = ETERMptr(erl_format("{cnode, ~i, ~i}", CNode::STATUS::OK, count), ErlFreeTerm);
+
+  } else if (strcmp(ERL_ATOM_PTR(func.get()), "remove_conv") == 0) {
+
+    ETERMptr conv_id_term(erl_element(3, tuplep.get()), ErlFreeTerm);
+    CharPtr conv_id_c = CharPtr(erl_iolist_to_string(conv_id_term.get()), ErlFree);
+
+    std::tuple<int, std::string> res = this->_v8->removeConv(conv_id_c.get());
+
+    resp = ETERMptr(
+      erl_format("{cnode, ~i, ~b}",
+                 std::get<ERR_CODE>(res),
+                 std::get<DATA>(res).c_str()),
+      ErlFreeTerm);
+
   } else if (strcmp(ERL_ATOM_PTR(func.get()), "run") == 0) {
 
     ETERMptr conv_id_term(erl_element(3, tuplep.get()), ErlFreeTerm);
@@ -292,7 +860,82 @@ void CNode::processV8(
     // if run - data is a json
     CharPtr data = CharPtr(erl_iolist_to_string(data_term.get()), ErlFree);
 
-    std::tuple<int, std::string> res = this->_v8->run(conv_id_c.get(), node_id_c.get(), data.get(), threadNum);
+    std::tuple<int, std::string> res =
+      this->_v8->run(conv_id_c.get(), node_id_c.get(), data.get(), threadNum, nullptr, maxExecutionTime);
+
+    resp = ETERMptr(
+      erl_format("{cnode, ~i, ~b}",
+                 std::get<ERR_CODE>(res),
+                 std::get<DATA>(res).c_str()),
+      ErlFreeTerm);
+
+  } else if (strcmp(ERL_ATOM_PTR(func.get()), "run_traced") == 0) {
+
+    ETERMptr conv_id_term(erl_element(3, tuplep.get()), ErlFreeTerm);
+    ETERMptr node_id_term(erl_element(4, tuplep.get()), ErlFreeTerm);
+    ETERMptr data_term(erl_element(5, tuplep.get()), ErlFreeTerm);
+
+    CharPtr conv_id_c = CharPtr(erl_iolist_to_string(conv_id_term.get()), ErlFree);
+    CharPtr node_id_c = CharPtr(erl_iolist_to_string(node_id_term.get()), ErlFree);
+    CharPtr data = CharPtr(erl_iolist_to_string(data_term.get()), ErlFree);
+
+    pb::V8Runner::RunTrace trace;
+    std::tuple<int, std::string> res =
+      this->_v8->run(conv_id_c.get(), node_id_c.get(), data.get(), threadNum, &trace, maxExecutionTime);
+
+    resp = ETERMptr(
+      erl_format("{cnode, ~i, ~b, "
+                 "["
+                   "{exec_us, ~l},"
+                   "{gc_pause_us, ~l},"
+                   "{gc_count, ~l}"
+                 "]"
+                 "}",
+                 std::get<ERR_CODE>(res),
+                 std::get<DATA>(res).c_str(),
+                 static_cast<long>(trace.execTimeUs),
+                 static_cast<long>(trace.gcPauseUs),
+                 static_cast<long>(trace.gcCount)),
+      ErlFreeTerm);
+
+  } else if (strcmp(ERL_ATOM_PTR(func.get()), "kv_put") == 0) {
+
+    ETERMptr ns_term(erl_element(3, tuplep.get()), ErlFreeTerm);
+    ETERMptr key_term(erl_element(4, tuplep.get()), ErlFreeTerm);
+    ETERMptr value_term(erl_element(5, tuplep.get()), ErlFreeTerm);
+
+    CharPtr ns = CharPtr(erl_iolist_to_string(ns_term.get()), ErlFree);
+    CharPtr key = CharPtr(erl_iolist_to_string(key_term.get()), ErlFree);
+    CharPtr value = CharPtr(erl_iolist_to_string(value_term.get()), ErlFree);
+
+    std::tuple<int, std::string> res = this->_v8->kvPut(ns.get(), key.get(), value.get());
+
+    resp = ETERMptr(
+      erl_format("{cnode, ~i, ~b}",
+                 std::get<ERR_CODE>(res),
+                 std::get<DATA>(res).c_str()),
+      ErlFreeTerm);
+
+  } else if (strcmp(ERL_ATOM_PTR(func.get()), "kv_load_file") == 0) {
+
+    ETERMptr ns_term(erl_element(3, tuplep.get()), ErlFreeTerm);
+    ETERMptr path_term(erl_element(4, tuplep.get()), ErlFreeTerm);
+
+    CharPtr ns = CharPtr(erl_iolist_to_string(ns_term.get()), ErlFree);
+    CharPtr path = CharPtr(erl_iolist_to_string(path_term.get()), ErlFree);
+
+    // file is read and parsed on a pool thread, not on the receive one
+    std::tuple<int, std::string> res = this->_v8->kvLoadFile(ns.get(), path.get());
+
+    resp = ETERMptr(
+      erl_format("{cnode, ~i, ~b}",
+                 std::get<ERR_CODE>(res),
+                 std::get<DATA>(res).c_str()),
+      ErlFreeTerm);
+
+  } else if (strcmp(ERL_ATOM_PTR(func.get()), "reload_datasets") == 0) {
+
+    std::tuple<int, std::string> res = this->_v8->reloadDatasets();
 
     resp = ETERMptr(
       erl_format("{cnode, ~i, ~b}",
@@ -304,5 +947,64 @@ void CNode::processV8(
     resp = ETERMptr(erl_format("{cnode, ~i, ~b}", CNode::STATUS::ERR, "Unsupported command."), ErlFreeTerm);
   }
 
+  this->sendReply(fd, fromp, resp, runKey);
+}
+
+void CNode::expireV8(
+  int fd,
+  ETERMptr fromp,
+  const pb::RunKey& runKey,
+  int /* threadNum */)
+{
+  auto resp = ETERMptr(erl_format("{cnode, ~i, ~b}", CNode::STATUS::THREAD_POOL_TIMEOUT, "Threadpool queue timeout."), ErlFreeTerm);
+  this->sendReply(fd, fromp, resp, runKey);
+}
+
+void CNode::sendReply(int fd, const ETERMptr& fromp, const ETERMptr& resp, const pb::RunKey& runKey) {
   erl_send(fd, fromp.get(), resp.get());
+
+  // the same reply for duplicates, a run which comes after this is executed again
+  if (!runKey.empty()) {
+    const auto waiters = this->_inFlightRuns.complete(runKey);
+    for (const auto& waiter: waiters) {
+      erl_send(fd, waiter.get(), resp.get());
+    }
+  }
+}
+
+ETERMptr CNode::makeGCStatisticsTerm() {
+
+  auto gcStatistics = this->_v8->getGCStatistics();
+  auto gcStatisticsSize = gcStatistics.size();
+
+  std::shared_ptr<ETERM*> gc_e = make_shared_array<ETERM*>(gcStatisticsSize);
+  auto arr = gc_e.get();
+
+  {
+    int i = 0;
+    for (const auto& kv: gcStatistics) {
+      const auto& pauses = kv.second;
+      arr[i++] = erl_format("{~a, ["
+                              "{count, ~l},"
+                              "{total_us, ~l},"
+                              "{max_us, ~l},"
+                              "{p50_us, ~l},"
+                              "{p99_us, ~l}"
+                            "]}",
+                            kv.first.c_str(),
+                            static_cast<long>(pauses.count),
+                            static_cast<long>(pauses.sum),
+                            static_cast<long>(pauses.max),
+                            static_cast<long>(pauses.percentile(50)),
+                            static_cast<long>(pauses.percentile(99)));
+    }
+  }
+
+  ETERMptr gcTerm(erl_mk_list(arr, gcStatisticsSize), ErlFreeTerm);
+
+  for (std::size_t i = 0; i < gcStatisticsSize; ++i) {
+    erl_free_term(arr[i]);
+  }
+
+  return gcTerm;
 }
@@ -0,0 +1,71 @@
+#include <datasets.h>
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <json.hpp>
+
+using namespace pb;
+
+using json = nlohmann::json;
+
+Datasets::Datasets(): _current(std::make_shared<const Version>()) {}
+
+uint64_t Datasets::load(const fs::path& dir) {
+  std::lock_guard<std::mutex> guard(this->_loadMutex);
+
+  if (!fs::is_directory(dir)) {
+    throw std::runtime_error("Datasets directory does not exist: " + dir.string());
+  }
+
+  auto next = std::make_shared<Version>();
+  next->version = this->current()->version + 1;
+
+  for (fs::directory_iterator i(dir), end; i != end; ++i) {
+    if (fs::is_directory(i->path()) || i->path().extension() != ".json") {
+      continue;
+    }
+
+    std::ifstream file(i->path());
+    if (!file) {
+      throw std::runtime_error("Error opening file: " + i->path().string());
+    }
+
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+
+    // validate here, so isolates never get a half-broken version
+    try {
+      json::parse(buffer.str());
+    } catch (const std::exception& ex) {
+      throw std::runtime_error("Error parsing " + i->path().string() + ": " + ex.what());
+    }
+
+    next->files[i->path().stem().string()] = buffer.str();
+  }
+
+  this->_dir = dir;
+
+  std::atomic_store(&this->_current, std::shared_ptr<const Version>(next));
+
+  return next->version;
+}
+
+uint64_t Datasets::reload() {
+  fs::path dir;
+  {
+    std::lock_guard<std::mutex> guard(this->_loadMutex);
+    dir = this->_dir;
+  }
+
+  if (dir.empty()) {
+    throw std::runtime_error("Datasets directory is not configured.");
+  }
+
+  return this->load(dir);
+}
+
+std::shared_ptr<const Datasets::Version> Datasets::current() const {
+  return std::atomic_load(&this->_current);
+}
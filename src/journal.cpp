@@ -0,0 +1,319 @@
+#include <journal.h>
+
+#include <map>
+#include <iostream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace pb;
+
+Journal::Journal(const fs::path& path):
+  _path(path), _appended(0), _written(0), _stop(false),
+  _records(0), _compactAfter(0), _compactions(0) {}
+
+Journal::~Journal() {
+  {
+    std::lock_guard<std::mutex> guard(this->_mutex);
+    this->_stop = true;
+  }
+  this->_queuedVar.notify_one();
+
+  if (this->_writer.joinable()) {
+    this->_writer.join();
+  }
+}
+
+std::vector<Journal::Entry> Journal::open() {
+  std::vector<Entry> entries;
+
+  {
+    std::lock_guard<std::mutex> guard(this->_fileMutex);
+
+    entries = this->_load();
+
+    // start with a compact file, it also drops a torn tail
+    this->_rewrite(entries);
+  }
+
+  this->_writer = std::thread(&Journal::_writerFunc, this);
+
+  return entries;
+}
+
+void Journal::appendCompile(const std::string& conv,
+                            const std::string& node,
+                            const std::string& src,
+                            const std::string& codeCache) {
+  this->_append(Record{RECORD_TYPE::COMPILE, Entry{conv, node, src, codeCache}});
+}
+
+void Journal::appendRemove(const std::string& conv, const std::string& node) {
+  this->_append(Record{RECORD_TYPE::REMOVE, Entry{conv, node, "", ""}});
+}
+
+void Journal::_append(Record&& record) {
+  {
+    std::lock_guard<std::mutex> guard(this->_mutex);
+    this->_queue.push_back(std::move(record));
+    this->_appended += 1;
+  }
+  this->_queuedVar.notify_one();
+}
+
+void Journal::sync() {
+  std::unique_lock<std::mutex> lock(this->_mutex);
+  const uint64_t appended = this->_appended;
+  this->_writtenVar.wait(lock, [this, appended] {
+    return this->_written >= appended || !this->_writer.joinable();
+  });
+}
+
+std::size_t Journal::liveCount() {
+  this->sync();
+
+  std::lock_guard<std::mutex> guard(this->_fileMutex);
+  return this->_liveKeys.size();
+}
+
+std::size_t Journal::compactionsCount() {
+  this->sync();
+
+  std::lock_guard<std::mutex> guard(this->_fileMutex);
+  return this->_compactions;
+}
+
+void Journal::_writerFunc() {
+  std::unique_lock<std::mutex> lock(this->_mutex);
+
+  while (true) {
+    this->_queuedVar.wait(lock, [this] { return this->_stop || !this->_queue.empty(); });
+
+    // the queue is written out before it stops
+    if (this->_queue.empty()) {
+      break;
+    }
+
+    std::deque<Record> records;
+    records.swap(this->_queue);
+
+    lock.unlock();
+    {
+      std::lock_guard<std::mutex> guard(this->_fileMutex);
+      this->_write(records);
+    }
+    lock.lock();
+
+    this->_written += records.size();
+    this->_writtenVar.notify_all();
+  }
+}
+
+void Journal::_write(std::deque<Record>& records) {
+  for (auto& record: records) {
+    this->_pending.push_back(std::move(record));
+  }
+
+  if (this->_out.is_open()) {
+    for (const auto& record: this->_pending) {
+      Journal::_writeRecord(this->_out, record.type, record.entry);
+    }
+    this->_out.flush();
+
+    if (this->_out) {
+      for (const auto& record: this->_pending) {
+        this->_records += 1;
+        if (record.type == RECORD_TYPE::COMPILE) {
+          this->_liveKeys.insert(Journal::_key(record.entry.conv, record.entry.node));
+        } else {
+          this->_liveKeys.erase(Journal::_key(record.entry.conv, record.entry.node));
+        }
+      }
+      this->_pending.clear();
+
+      this->_maybeCompact();
+      return;
+    }
+  }
+
+  // disk full or the like, the tail may be torn now: rebuild the file
+  // from what it holds and the pending records, they stay till it works
+  this->_out.close();
+  try {
+    this->_rewrite(this->_load(this->_pending));
+    this->_pending.clear();
+  } catch(const std::exception& ex) {
+    std::cerr << "[ERROR] [journal] "
+              << this->_pending.size() << " records are not written yet: " << ex.what()
+              << std::endl;
+  }
+}
+
+void Journal::_maybeCompact() {
+  if (this->_records < 2 * this->_liveKeys.size() + Journal::COMPACT_MIN_RECORDS ||
+      this->_records < this->_compactAfter) {
+    return;
+  }
+
+  this->_out.close();
+  try {
+    this->_rewrite(this->_load());
+    this->_compactions += 1;
+  } catch(const std::exception& ex) {
+    std::cerr << "[ERROR] [journal] "
+              << "Compaction failed, the journal is kept as it is: " << ex.what()
+              << std::endl;
+    // keep appending to the old file, try again a while later
+    this->_out.open(this->_path, std::ios::binary | std::ios::app);
+    this->_compactAfter = this->_records + Journal::COMPACT_MIN_RECORDS;
+  }
+}
+
+std::vector<Journal::Entry> Journal::_load(const std::deque<Record>& records) {
+
+  // keep order of the first compile, the latest source wins
+  std::map<std::string, std::size_t> positions;
+  std::vector<Entry> entries;
+  std::vector<bool> removed;
+
+  auto add = [&positions, &entries, &removed](char type, Entry&& entry) {
+    const auto key = Journal::_key(entry.conv, entry.node);
+    auto it = positions.find(key);
+
+    if (type == RECORD_TYPE::COMPILE) {
+      if (it == positions.end()) {
+        positions[key] = entries.size();
+        entries.push_back(std::move(entry));
+        removed.push_back(false);
+      } else {
+        entries[it->second] = std::move(entry);
+        removed[it->second] = false;
+      }
+    } else if (type == RECORD_TYPE::REMOVE && it != positions.end()) {
+      removed[it->second] = true;
+    }
+  };
+
+  std::ifstream in(this->_path, std::ios::binary);
+
+  while (in) {
+    char type = 0;
+    Entry entry;
+
+    if (!in.get(type) ||
+        !Journal::_readField(in, entry.conv) ||
+        !Journal::_readField(in, entry.node) ||
+        !Journal::_readField(in, entry.src) ||
+        !Journal::_readField(in, entry.codeCache)) {
+      break;
+    }
+
+    add(type, std::move(entry));
+  }
+
+  for (const auto& record: records) {
+    add(record.type, Entry(record.entry));
+  }
+
+  std::vector<Entry> live;
+  for (std::size_t i = 0; i < entries.size(); i++) {
+    if (!removed[i]) {
+      live.push_back(std::move(entries[i]));
+    }
+  }
+
+  return live;
+}
+
+void Journal::_rewrite(const std::vector<Entry>& entries) {
+
+  auto tmpPath = this->_path;
+  tmpPath += ".tmp";
+
+  std::error_code ec;
+
+  {
+    std::ofstream tmp(tmpPath, std::ios::binary | std::ios::trunc);
+    for (const auto& entry: entries) {
+      Journal::_writeRecord(tmp, RECORD_TYPE::COMPILE, entry);
+    }
+    tmp.flush();
+    tmp.close();
+
+    // a short file must not replace the good one, neither may one
+    // which is not on the disk yet: the rename may reach it first
+    if (!tmp || !Journal::_sync(tmpPath)) {
+      fs::remove(tmpPath, ec);
+      throw std::runtime_error("Can not write " + tmpPath.string() + ".");
+    }
+  }
+
+  // atomic replace, a crash leaves either the old or the new journal
+  fs::rename(tmpPath, this->_path, ec);
+  if (ec) {
+    const auto error = "Can not replace " + this->_path.string() + ": " + ec.message() + ".";
+    fs::remove(tmpPath, ec);
+    throw std::runtime_error(error);
+  }
+
+  // the rename itself is durable once the directory is
+  auto dir = this->_path.parent_path();
+  if (dir.empty()) {
+    dir = ".";
+  }
+  if (!Journal::_sync(dir)) {
+    std::cerr << "[ERROR] [journal] "
+              << "Can not sync " << dir.string() << ", the replace may be lost on power loss."
+              << std::endl;
+  }
+
+  this->_records = entries.size();
+  this->_compactAfter = 0;
+  this->_liveKeys.clear();
+  for (const auto& entry: entries) {
+    this->_liveKeys.insert(Journal::_key(entry.conv, entry.node));
+  }
+
+  this->_out.open(this->_path, std::ios::binary | std::ios::app);
+  if (!this->_out) {
+    throw std::runtime_error("Can not open " + this->_path.string() + ".");
+  }
+}
+
+void Journal::_writeRecord(std::ofstream& out, RECORD_TYPE type, const Entry& entry) {
+  out.put(static_cast<char>(type));
+  Journal::_writeField(out, entry.conv);
+  Journal::_writeField(out, entry.node);
+  Journal::_writeField(out, entry.src);
+  Journal::_writeField(out, entry.codeCache);
+}
+
+void Journal::_writeField(std::ofstream& out, const std::string& field) {
+  const uint32_t size = field.size();
+  out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+  out.write(field.data(), size);
+}
+
+bool Journal::_readField(std::ifstream& in, std::string& field) {
+  uint32_t size = 0;
+  if (!in.read(reinterpret_cast<char*>(&size), sizeof(size))) {
+    return false;
+  }
+  field.resize(size);
+  return static_cast<bool>(in.read(&field[0], size));
+}
+
+bool Journal::_sync(const fs::path& path) {
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  const bool synced = ::fsync(fd) == 0;
+  ::close(fd);
+  return synced;
+}
+
+std::string Journal::_key(const std::string& conv, const std::string& node) {
+  return conv + '\0' + node;
+}
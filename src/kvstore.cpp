@@ -0,0 +1,108 @@
+#include <kvstore.h>
+
+#include <fstream>
+#include <stdexcept>
+
+#include <json.hpp>
+
+using namespace pb;
+
+using json = nlohmann::json;
+
+const std::string* KVStore::Snapshot::get(const std::string& ns, const std::string& key) const {
+  auto nsIt = this->namespaces.find(ns);
+  if (nsIt == this->namespaces.end()) {
+    return nullptr;
+  }
+
+  auto it = nsIt->second->find(key);
+  if (it == nsIt->second->end()) {
+    return nullptr;
+  }
+
+  return &it->second;
+}
+
+KVStore::KVStore(): _snapshot(std::make_shared<const Snapshot>()) {}
+
+std::shared_ptr<const KVStore::Snapshot> KVStore::snapshot() const {
+  return std::atomic_load(&this->_snapshot);
+}
+
+uint64_t KVStore::version() const {
+  return this->snapshot()->version;
+}
+
+uint64_t KVStore::put(const std::string& ns, const std::string& key, const std::string& value) {
+  try {
+    json::parse(value);
+  } catch (const std::exception& ex) {
+    throw std::invalid_argument("Value of " + ns + "/" + key + " is not JSON: " + ex.what());
+  }
+
+  std::lock_guard<std::mutex> guard(this->_writeMutex);
+
+  auto current = this->snapshot();
+  auto it = current->namespaces.find(ns);
+
+  auto values = it == current->namespaces.end()
+    ? std::make_shared<Namespace>()
+    : std::make_shared<Namespace>(*it->second);
+
+  (*values)[key] = value;
+
+  return this->_publish(ns, values);
+}
+
+uint64_t KVStore::loadFile(const std::string& ns, const std::string& path) {
+  std::ifstream file(path);
+  if (!file) {
+    throw std::runtime_error("Error opening file: " + path);
+  }
+
+  json data;
+  try {
+    file >> data;
+  } catch (const std::exception& ex) {
+    throw std::runtime_error("Error parsing " + path + ": " + ex.what());
+  }
+
+  if (!data.is_object()) {
+    throw std::runtime_error("Top level of " + path + " is not an object.");
+  }
+
+  // parsed and split before taking the lock, readers keep the old version meanwhile
+  auto values = std::make_shared<Namespace>();
+  values->reserve(data.size());
+  for (auto it = data.begin(); it != data.end(); ++it) {
+    (*values)[it.key()] = it.value().dump();
+  }
+
+  std::lock_guard<std::mutex> guard(this->_writeMutex);
+  return this->_publish(ns, values);
+}
+
+uint64_t KVStore::removeNamespace(const std::string& ns) {
+  std::lock_guard<std::mutex> guard(this->_writeMutex);
+  return this->_publish(ns, nullptr);
+}
+
+// called under _writeMutex, null values drop the namespace
+uint64_t KVStore::_publish(const std::string& ns, std::shared_ptr<const Namespace> values) {
+  auto current = this->snapshot();
+
+  // namespaces are shared between versions, only the changed one is new
+  auto next = std::make_shared<Snapshot>();
+  next->version = current->version + 1;
+  next->namespaces = current->namespaces;
+
+  if (values) {
+    next->namespaces[ns] = values;
+  } else {
+    next->namespaces.erase(ns);
+  }
+
+  std::atomic_store(&this->_snapshot, std::shared_ptr<const Snapshot>(next));
+
+  return next->version;
+}
@@ -0,0 +1,264 @@
+#include <libcache.h>
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+using namespace pb;
+
+LibCache::File::File(const fs::path& path): _oneByte(true) {
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw std::runtime_error("Error opening file: " + path.string());
+  }
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    ::close(fd);
+    throw std::runtime_error("Error reading file: " + path.string());
+  }
+
+  // the size is a hint only, the file may change meanwhile: read till EOF
+  this->_data.resize(st.st_size);
+  std::size_t size = 0;
+
+  while (true) {
+    if (size == this->_data.size()) {
+      this->_data.resize(std::max<std::size_t>(2 * size, 4096));
+    }
+
+    const ssize_t len = ::read(fd, &this->_data[size], this->_data.size() - size);
+    if (len < 0) {
+      ::close(fd);
+      throw std::runtime_error("Error reading file: " + path.string());
+    }
+    if (len == 0) {
+      break;
+    }
+    size += len;
+  }
+
+  ::close(fd);
+
+  this->_data.resize(size);
+  this->_data.shrink_to_fit();
+
+  for (std::size_t i = 0; i < size; i++) {
+    if (static_cast<unsigned char>(this->_data[i]) > 0x7f) {
+      this->_oneByte = false;
+      break;
+    }
+  }
+}
+
+LibCache::LibCache():
+  _files(std::make_shared<const Files>()),
+  _inotifyFd(-1),
+  _watching(false) {}
+
+LibCache::~LibCache() {
+  this->stopWatching();
+}
+
+std::size_t LibCache::load(const fs::path& dir) {
+
+  std::vector<fs::path> paths;
+  for (fs::recursive_directory_iterator i(dir), end; i != end; ++i) {
+    if (!fs::is_directory(i->path()) && i->path().extension() == ".js") {
+      paths.push_back(i->path());
+    }
+  }
+
+  // read (and scan for non-ASCII bytes) on every core,
+  // readers keep the old snapshot meanwhile
+  std::vector<std::shared_ptr<const File>> read(paths.size());
+  std::atomic<std::size_t> next(0);
+
+  auto readFunc = [&paths, &read, &next] {
+    for (std::size_t i = next++; i < paths.size(); i = next++) {
+      try {
+        read[i] = std::make_shared<const File>(paths[i]);
+      } catch (const std::exception& ex) {
+        std::cerr << "[ERROR] [LibCache::load] " << ex.what() << std::endl;
+      }
+    }
+  };
+
+  const std::size_t threadsCount =
+    std::min<std::size_t>(paths.size(), std::max(1u, std::thread::hardware_concurrency()));
+
+  std::vector<std::thread> readers;
+  for (std::size_t i = 1; i < threadsCount; i++) {
+    readers.push_back(std::thread(readFunc));
+  }
+  readFunc();
+  for (auto& reader: readers) {
+    reader.join();
+  }
+
+  auto files = std::make_shared<Files>();
+  for (std::size_t i = 0; i < paths.size(); i++) {
+    if (read[i]) {
+      (*files)[LibCache::key(paths[i])] = read[i];
+    }
+  }
+
+  std::lock_guard<std::mutex> guard(this->_writeMutex);
+  this->_dir = dir;
+  std::atomic_store(&this->_files, std::shared_ptr<const Files>(files));
+
+  return files->size();
+}
+
+void LibCache::reload(const std::string& name) {
+  fs::path dir;
+  {
+    std::lock_guard<std::mutex> guard(this->_writeMutex);
+    dir = this->_dir;
+  }
+
+  auto file = std::make_shared<const File>(dir / name);
+  this->_publish(name, file);
+}
+
+std::shared_ptr<const LibCache::Files> LibCache::files() const {
+  return std::atomic_load(&this->_files);
+}
+
+std::shared_ptr<const LibCache::File> LibCache::get(const std::string& name) const {
+  auto files = std::atomic_load(&this->_files);
+  auto it = files->find(name);
+  return it == files->end() ? nullptr : it->second;
+}
+
+bool LibCache::watch() {
+  std::lock_guard<std::mutex> guard(this->_writeMutex);
+
+  if (this->_watching || this->_dir.empty()) {
+    return this->_watching;
+  }
+
+  this->_inotifyFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (this->_inotifyFd < 0) {
+    std::cerr << "[ERROR] [LibCache::watch] inotify is not available." << std::endl;
+    return false;
+  }
+
+  this->_addWatches(this->_dir);
+
+  this->_watching = true;
+  this->_watcher = std::thread(&LibCache::_watchFunc, this);
+
+  return true;
+}
+
+void LibCache::stopWatching() {
+  if (!this->_watching.exchange(false)) {
+    return;
+  }
+
+  this->_watcher.join();
+
+  ::close(this->_inotifyFd);
+  this->_inotifyFd = -1;
+  this->_watches.clear();
+}
+
+// "<parent dir>/<file>", as libraries are required
+std::string LibCache::key(const fs::path& path) {
+  return (path.parent_path().filename() / path.filename()).string();
+}
+
+void LibCache::_publish(const std::string& name, const std::shared_ptr<const File>& file) {
+  std::lock_guard<std::mutex> guard(this->_writeMutex);
+
+  auto files = std::make_shared<Files>(*std::atomic_load(&this->_files));
+  (*files)[name] = file;
+
+  std::atomic_store(&this->_files, std::shared_ptr<const Files>(files));
+}
+
+// called under _writeMutex or from the watcher thread only
+void LibCache::_addWatches(const fs::path& dir) {
+  const uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR;
+
+  auto add = [this, mask](const fs::path& path) {
+    const int wd = ::inotify_add_watch(this->_inotifyFd, path.c_str(), mask);
+    if (wd >= 0) {
+      this->_watches[wd] = path;
+    }
+  };
+
+  add(dir);
+  for (fs::recursive_directory_iterator i(dir), end; i != end; ++i) {
+    if (fs::is_directory(i->path())) {
+      add(i->path());
+    }
+  }
+}
+
+void LibCache::_watchFunc() {
+  alignas(struct inotify_event) char buffer[16 * 1024];
+
+  while (this->_watching) {
+    pollfd pfd = { this->_inotifyFd, POLLIN, 0 };
+
+    // wake up from time to time to notice stopWatching
+    if (::poll(&pfd, 1, 500) <= 0) {
+      continue;
+    }
+
+    const ssize_t len = ::read(this->_inotifyFd, buffer, sizeof(buffer));
+    if (len <= 0) {
+      continue;
+    }
+
+    for (ssize_t offset = 0; offset < len; ) {
+      const auto event = reinterpret_cast<const struct inotify_event*>(buffer + offset);
+      offset += sizeof(struct inotify_event) + event->len;
+
+      auto dir = this->_watches.find(event->wd);
+      if (event->len == 0 || dir == this->_watches.end()) {
+        continue;
+      }
+
+      const fs::path path = dir->second / event->name;
+
+      if (event->mask & IN_ISDIR) {
+        if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+          try {
+            this->_addWatches(path);
+
+            // files which got there before the watch was added
+            for (fs::recursive_directory_iterator i(path), end; i != end; ++i) {
+              if (!fs::is_directory(i->path()) && i->path().extension() == ".js") {
+                this->_publish(LibCache::key(i->path()), std::make_shared<const File>(i->path()));
+              }
+            }
+          } catch (const std::exception& ex) {
+            std::cerr << "[ERROR] [LibCache::watch] " << ex.what() << std::endl;
+          }
+        }
+        continue;
+      }
+
+      if (path.extension() != ".js" || !(event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))) {
+        continue;
+      }
+
+      // disk is read here, the snapshot swap is the only locked part
+      try {
+        this->_publish(LibCache::key(path), std::make_shared<const File>(path));
+      } catch (const std::exception& ex) {
+        std::cerr << "[ERROR] [LibCache::watch] " << ex.what() << std::endl;
+      }
+    }
+  }
+}
@@ -0,0 +1,441 @@
+#include <nativecrypto.h>
+
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <zlib.h>
+
+using namespace pb;
+
+namespace {
+
+  const char BASE64_ALPHABET[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+  const char HEX_ALPHABET[] = "0123456789abcdef";
+
+  // 0..63 for base64 chars (both standard and url safe), 64 for '=', 255 for the rest
+  struct Base64Table {
+    uint8_t values[256];
+
+    Base64Table() {
+      std::memset(values, 255, sizeof(values));
+      for (uint8_t i = 0; i < 64; i++) {
+        values[static_cast<uint8_t>(BASE64_ALPHABET[i])] = i;
+      }
+      values[static_cast<uint8_t>('-')] = 62;
+      values[static_cast<uint8_t>('_')] = 63;
+      values[static_cast<uint8_t>('=')] = 64;
+    }
+  };
+
+  const Base64Table BASE64_TABLE;
+
+  int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+  }
+
+}
+
+void NativeCrypto::install(v8::Isolate* isolate, v8::Local<v8::ObjectTemplate> global) {
+
+  auto hash = v8::ObjectTemplate::New(isolate);
+  hash->Set(v8::String::NewFromUtf8(isolate, "md5"),
+            v8::FunctionTemplate::New(isolate, NativeCrypto::_md5));
+  hash->Set(v8::String::NewFromUtf8(isolate, "sha1"),
+            v8::FunctionTemplate::New(isolate, NativeCrypto::_sha1));
+  hash->Set(v8::String::NewFromUtf8(isolate, "sha256"),
+            v8::FunctionTemplate::New(isolate, NativeCrypto::_sha256));
+  hash->Set(v8::String::NewFromUtf8(isolate, "hmac"),
+            v8::FunctionTemplate::New(isolate, NativeCrypto::_hmac));
+  hash->Set(v8::String::NewFromUtf8(isolate, "crc32"),
+            v8::FunctionTemplate::New(isolate, NativeCrypto::_crc32));
+
+  auto encoding = v8::ObjectTemplate::New(isolate);
+  encoding->Set(v8::String::NewFromUtf8(isolate, "base64Encode"),
+                v8::FunctionTemplate::New(isolate, NativeCrypto::_base64Encode));
+  encoding->Set(v8::String::NewFromUtf8(isolate, "base64Decode"),
+                v8::FunctionTemplate::New(isolate, NativeCrypto::_base64Decode));
+  encoding->Set(v8::String::NewFromUtf8(isolate, "hexEncode"),
+                v8::FunctionTemplate::New(isolate, NativeCrypto::_hexEncode));
+  encoding->Set(v8::String::NewFromUtf8(isolate, "hexDecode"),
+                v8::FunctionTemplate::New(isolate, NativeCrypto::_hexDecode));
+
+  auto uuid = v8::ObjectTemplate::New(isolate);
+  uuid->Set(v8::String::NewFromUtf8(isolate, "v4"),
+            v8::FunctionTemplate::New(isolate, NativeCrypto::_uuidV4));
+  uuid->Set(v8::String::NewFromUtf8(isolate, "v7"),
+            v8::FunctionTemplate::New(isolate, NativeCrypto::_uuidV7));
+
+  global->Set(v8::String::NewFromUtf8(isolate, "hash"), hash);
+  global->Set(v8::String::NewFromUtf8(isolate, "encoding"), encoding);
+  global->Set(v8::String::NewFromUtf8(isolate, "uuid"), uuid);
+}
+
+std::string NativeCrypto::base64Encode(const uint8_t* data, std::size_t size) {
+  std::string res;
+  res.reserve((size + 2) / 3 * 4);
+
+  std::size_t i = 0;
+  for (; i + 2 < size; i += 3) {
+    const uint32_t chunk = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+    res.push_back(BASE64_ALPHABET[(chunk >> 18) & 63]);
+    res.push_back(BASE64_ALPHABET[(chunk >> 12) & 63]);
+    res.push_back(BASE64_ALPHABET[(chunk >> 6) & 63]);
+    res.push_back(BASE64_ALPHABET[chunk & 63]);
+  }
+
+  if (i + 1 == size) {
+    const uint32_t chunk = data[i] << 16;
+    res.push_back(BASE64_ALPHABET[(chunk >> 18) & 63]);
+    res.push_back(BASE64_ALPHABET[(chunk >> 12) & 63]);
+    res.append("==");
+  } else if (i + 2 == size) {
+    const uint32_t chunk = (data[i] << 16) | (data[i + 1] << 8);
+    res.push_back(BASE64_ALPHABET[(chunk >> 18) & 63]);
+    res.push_back(BASE64_ALPHABET[(chunk >> 12) & 63]);
+    res.push_back(BASE64_ALPHABET[(chunk >> 6) & 63]);
+    res.push_back('=');
+  }
+
+  return res;
+}
+
+// accepts standard and url safe alphabets, padding is optional
+bool NativeCrypto::base64Decode(const char* data, std::size_t size, std::string& res) {
+  while (size > 0 && data[size - 1] == '=') {
+    size -= 1;
+  }
+  if (size % 4 == 1) {
+    return false;
+  }
+
+  res.clear();
+  res.reserve(size / 4 * 3 + 2);
+
+  uint32_t chunk = 0;
+  int bits = 0;
+
+  for (std::size_t i = 0; i < size; i++) {
+    const uint8_t value = BASE64_TABLE.values[static_cast<uint8_t>(data[i])];
+    if (value > 63) {
+      return false;
+    }
+    chunk = (chunk << 6) | value;
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      res.push_back(static_cast<char>((chunk >> bits) & 0xff));
+    }
+  }
+
+  return true;
+}
+
+std::string NativeCrypto::hexEncode(const uint8_t* data, std::size_t size) {
+  std::string res(size * 2, '0');
+  for (std::size_t i = 0; i < size; i++) {
+    res[2 * i] = HEX_ALPHABET[data[i] >> 4];
+    res[2 * i + 1] = HEX_ALPHABET[data[i] & 15];
+  }
+  return res;
+}
+
+bool NativeCrypto::hexDecode(const char* data, std::size_t size, std::string& res) {
+  if (size % 2 != 0) {
+    return false;
+  }
+
+  res.resize(size / 2);
+  for (std::size_t i = 0; i < size / 2; i++) {
+    const int high = hexValue(data[2 * i]);
+    const int low = hexValue(data[2 * i + 1]);
+    if (high < 0 || low < 0) {
+      return false;
+    }
+    res[i] = static_cast<char>((high << 4) | low);
+  }
+
+  return true;
+}
+
+// random (4) or unix time ordered (7) uuid, RFC 4122 layout.
+// False if OpenSSL has no random bytes (its pool is not seeded)
+bool NativeCrypto::uuid(int version, std::string& res) {
+  uint8_t bytes[16];
+  if (RAND_bytes(bytes, sizeof(bytes)) != 1) {
+    return false;
+  }
+
+  if (version == 7) {
+    using namespace std::chrono;
+    const uint64_t ms = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+    for (int i = 0; i < 6; i++) {
+      bytes[i] = static_cast<uint8_t>(ms >> (40 - 8 * i));
+    }
+  }
+
+  bytes[6] = static_cast<uint8_t>((bytes[6] & 0x0f) | (version << 4));
+  bytes[8] = static_cast<uint8_t>((bytes[8] & 0x3f) | 0x80);
+
+  const auto hex = NativeCrypto::hexEncode(bytes, sizeof(bytes));
+  res = hex.substr(0, 8) + '-' + hex.substr(8, 4) + '-' + hex.substr(12, 4) + '-' +
+    hex.substr(16, 4) + '-' + hex.substr(20);
+  return true;
+}
+
+bool NativeCrypto::Bytes::read(v8::Local<v8::Value> value) {
+  if (value.IsEmpty() || value->IsUndefined() || value->IsNull()) {
+    return false;
+  }
+
+  if (value->IsArrayBufferView()) {
+    auto view = value.As<v8::ArrayBufferView>();
+    auto contents = view->Buffer()->GetContents();
+    this->_data = static_cast<const uint8_t*>(contents.Data()) + view->ByteOffset();
+    this->_size = view->ByteLength();
+    return true;
+  }
+
+  if (value->IsArrayBuffer()) {
+    auto contents = value.As<v8::ArrayBuffer>()->GetContents();
+    this->_data = static_cast<const uint8_t*>(contents.Data());
+    this->_size = contents.ByteLength();
+    return true;
+  }
+
+  v8::String::Utf8Value str(value);
+  if (!*str) {
+    return false;
+  }
+  this->_str.assign(*str, str.length());
+  this->_data = reinterpret_cast<const uint8_t*>(this->_str.data());
+  this->_size = this->_str.size();
+  return true;
+}
+
+void NativeCrypto::_md5(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  NativeCrypto::_digest(args, "md5");
+}
+
+void NativeCrypto::_sha1(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  NativeCrypto::_digest(args, "sha1");
+}
+
+void NativeCrypto::_sha256(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  NativeCrypto::_digest(args, "sha256");
+}
+
+void NativeCrypto::_digest(const v8::FunctionCallbackInfo<v8::Value>& args, const char* alg) {
+  auto isolate = args.GetIsolate();
+
+  Bytes data;
+  if (!data.read(args[0])) {
+    NativeCrypto::_throw(isolate, std::string("hash.") + alg + ": data must be a string or a buffer.");
+    return;
+  }
+
+  uint8_t md[EVP_MAX_MD_SIZE];
+  unsigned int mdSize = 0;
+
+  if (!EVP_Digest(data.data(), data.size(), md, &mdSize, EVP_get_digestbyname(alg), nullptr)) {
+    NativeCrypto::_throw(isolate, std::string("hash.") + alg + ": digest failed.");
+    return;
+  }
+
+  NativeCrypto::_setResult(args, md, mdSize, NativeCrypto::_stringArg(args, 1, "hex"));
+}
+
+// hash.hmac(alg, key, data[, enc])
+void NativeCrypto::_hmac(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  auto isolate = args.GetIsolate();
+
+  const auto alg = NativeCrypto::_stringArg(args, 0, "");
+  const EVP_MD* md = nullptr;
+  if (alg == "md5" || alg == "sha1" || alg == "sha256") {
+    md = EVP_get_digestbyname(alg.c_str());
+  }
+
+  Bytes key;
+  Bytes data;
+  if (!md || !key.read(args[1]) || !data.read(args[2])) {
+    NativeCrypto::_throw(isolate, "hash.hmac: expected (md5|sha1|sha256, key, data[, enc]).");
+    return;
+  }
+
+  uint8_t res[EVP_MAX_MD_SIZE];
+  unsigned int resSize = 0;
+
+  if (!HMAC(md, key.data(), key.size(), data.data(), data.size(), res, &resSize)) {
+    NativeCrypto::_throw(isolate, "hash.hmac: hmac failed.");
+    return;
+  }
+
+  NativeCrypto::_setResult(args, res, resSize, NativeCrypto::_stringArg(args, 3, "hex"));
+}
+
+void NativeCrypto::_crc32(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  Bytes data;
+  if (!data.read(args[0])) {
+    NativeCrypto::_throw(args.GetIsolate(), "hash.crc32: data must be a string or a buffer.");
+    return;
+  }
+
+  // zlib takes uInt sizes, feed big buffers by parts
+  uLong crc = ::crc32(0L, Z_NULL, 0);
+  const uint8_t* data_ = data.data();
+  std::size_t left = data.size();
+  while (left > 0) {
+    const uInt part = static_cast<uInt>(std::min<std::size_t>(left, 1u << 30));
+    crc = ::crc32(crc, data_, part);
+    data_ += part;
+    left -= part;
+  }
+
+  args.GetReturnValue().Set(static_cast<uint32_t>(crc));
+}
+
+void NativeCrypto::_base64Encode(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  auto isolate = args.GetIsolate();
+
+  Bytes data;
+  if (!data.read(args[0])) {
+    NativeCrypto::_throw(isolate, "encoding.base64Encode: data must be a string or a buffer.");
+    return;
+  }
+
+  const auto res = NativeCrypto::base64Encode(data.data(), data.size());
+  NativeCrypto::_setResult(args, reinterpret_cast<const uint8_t*>(res.data()), res.size(), "utf8");
+}
+
+void NativeCrypto::_base64Decode(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  auto isolate = args.GetIsolate();
+
+  Bytes data;
+  std::string res;
+  if (!data.read(args[0]) ||
+      !NativeCrypto::base64Decode(reinterpret_cast<const char*>(data.data()), data.size(), res)) {
+    NativeCrypto::_throw(isolate, "encoding.base64Decode: bad base64 string.");
+    return;
+  }
+
+  NativeCrypto::_setResult(args,
+                           reinterpret_cast<const uint8_t*>(res.data()),
+                           res.size(),
+                           NativeCrypto::_stringArg(args, 1, "utf8"));
+}
+
+void NativeCrypto::_hexEncode(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  auto isolate = args.GetIsolate();
+
+  Bytes data;
+  if (!data.read(args[0])) {
+    NativeCrypto::_throw(isolate, "encoding.hexEncode: data must be a string or a buffer.");
+    return;
+  }
+
+  NativeCrypto::_setResult(args, data.data(), data.size(), "hex");
+}
+
+void NativeCrypto::_hexDecode(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  auto isolate = args.GetIsolate();
+
+  Bytes data;
+  std::string res;
+  if (!data.read(args[0]) ||
+      !NativeCrypto::hexDecode(reinterpret_cast<const char*>(data.data()), data.size(), res)) {
+    NativeCrypto::_throw(isolate, "encoding.hexDecode: bad hex string.");
+    return;
+  }
+
+  NativeCrypto::_setResult(args,
+                           reinterpret_cast<const uint8_t*>(res.data()),
+                           res.size(),
+                           NativeCrypto::_stringArg(args, 1, "utf8"));
+}
+
+void NativeCrypto::_uuidV4(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  auto isolate = args.GetIsolate();
+
+  std::string res;
+  if (!NativeCrypto::uuid(4, res)) {
+    NativeCrypto::_throw(isolate, "uuid.v4: no random bytes.");
+    return;
+  }
+
+  args.GetReturnValue().Set(v8::String::NewFromUtf8(isolate, res.c_str()));
+}
+
+void NativeCrypto::_uuidV7(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  auto isolate = args.GetIsolate();
+
+  std::string res;
+  if (!NativeCrypto::uuid(7, res)) {
+    NativeCrypto::_throw(isolate, "uuid.v7: no random bytes.");
+    return;
+  }
+
+  args.GetReturnValue().Set(v8::String::NewFromUtf8(isolate, res.c_str()));
+}
+
+// raw bytes -> hex, base64, utf8 string or a new ArrayBuffer
+void NativeCrypto::_setResult(const v8::FunctionCallbackInfo<v8::Value>& args,
+                              const uint8_t* data,
+                              std::size_t size,
+                              const std::string& enc) {
+  auto isolate = args.GetIsolate();
+
+  if (enc == "buffer") {
+    auto buffer = v8::ArrayBuffer::New(isolate, size);
+    std::memcpy(buffer->GetContents().Data(), data, size);
+    args.GetReturnValue().Set(buffer);
+    return;
+  }
+
+  std::string encoded;
+  const char* str = reinterpret_cast<const char*>(data);
+
+  if (enc == "hex") {
+    encoded = NativeCrypto::hexEncode(data, size);
+  } else if (enc == "base64") {
+    encoded = NativeCrypto::base64Encode(data, size);
+  } else if (enc != "utf8") {
+    NativeCrypto::_throw(isolate, "unknown encoding: " + enc);
+    return;
+  }
+
+  if (enc != "utf8") {
+    str = encoded.data();
+    size = encoded.size();
+  }
+
+  v8::Local<v8::String> res;
+  if (!v8::String::NewFromUtf8(isolate, str, v8::NewStringType::kNormal, size).ToLocal(&res)) {
+    NativeCrypto::_throw(isolate, "result is too big for a string.");
+    return;
+  }
+
+  args.GetReturnValue().Set(res);
+}
+
+std::string NativeCrypto::_stringArg(const v8::FunctionCallbackInfo<v8::Value>& args,
+                                  int i,
+                                  const std::string& defaultValue) {
+  if (args.Length() <= i || args[i]->IsUndefined() || args[i]->IsNull()) {
+    return defaultValue;
+  }
+  v8::String::Utf8Value str(args[i]);
+  return *str ? std::string(*str, str.length()) : defaultValue;
+}
+
+void NativeCrypto::_throw(v8::Isolate* isolate, const std::string& message) {
+  isolate->ThrowException(
+    v8::Exception::TypeError(v8::String::NewFromUtf8(isolate, message.c_str())));
+}
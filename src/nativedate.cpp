@@ -0,0 +1,442 @@
+#include <nativedate.h>
+
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#include <unicode/locid.h>
+#include <unicode/unistr.h>
+#include <unicode/parsepos.h>
+
+using namespace pb;
+
+namespace {
+
+  const char* const ISO_PATTERN = "yyyy-MM-dd'T'HH:mm:ss.SSSXXX";
+
+  // tried by parse one by one when pattern is not given
+  const std::vector<std::string> ISO_PATTERNS = {
+    "yyyy-MM-dd'T'HH:mm:ss.SSSXXX",
+    "yyyy-MM-dd'T'HH:mm:ssXXX",
+    "yyyy-MM-dd'T'HH:mm:ss.SSS",
+    "yyyy-MM-dd'T'HH:mm:ss",
+    "yyyy-MM-dd"
+  };
+
+  const char* const DEFAULT_TZ = "UTC";
+  const char* const DEFAULT_LOCALE = "en_US";
+
+  // units which do not depend on calendar, in milliseconds
+  bool absoluteUnit(const UCalendarDateFields& field, double& ms) {
+    switch (field) {
+      case UCAL_MILLISECOND: ms = 1; return true;
+      case UCAL_SECOND: ms = 1000; return true;
+      case UCAL_MINUTE: ms = 60 * 1000; return true;
+      case UCAL_HOUR_OF_DAY: ms = 60 * 60 * 1000; return true;
+      default: return false;
+    }
+  }
+
+}
+
+icu::SimpleDateFormat* NativeDate::Cache::formatter(const std::string& pattern,
+                                                    const std::string& tz,
+                                                    const std::string& locale,
+                                                    UErrorCode& status) {
+  const std::string key = pattern + '\0' + tz + '\0' + locale;
+
+  auto it = this->_formatters.find(key);
+  if (it != this->_formatters.end()) {
+    return it->second.get();
+  }
+
+  auto zone = this->timeZone(tz, status);
+  if (U_FAILURE(status)) {
+    return nullptr;
+  }
+
+  std::unique_ptr<icu::SimpleDateFormat> formatter(new icu::SimpleDateFormat(
+    icu::UnicodeString::fromUTF8(pattern),
+    icu::Locale(locale.c_str()),
+    status
+  ));
+  if (U_FAILURE(status)) {
+    return nullptr;
+  }
+
+  formatter->setTimeZone(*zone);
+  formatter->setLenient(false);
+
+  if (this->_formatters.size() >= Cache::MAX_SIZE) {
+    this->_formatters.clear();
+  }
+
+  return (this->_formatters[key] = std::move(formatter)).get();
+}
+
+icu::Calendar* NativeDate::Cache::calendar(const std::string& tz, UErrorCode& status) {
+  auto it = this->_calendars.find(tz);
+  if (it != this->_calendars.end()) {
+    return it->second.get();
+  }
+
+  auto zone = this->timeZone(tz, status);
+  if (U_FAILURE(status)) {
+    return nullptr;
+  }
+
+  std::unique_ptr<icu::Calendar> calendar(
+    icu::Calendar::createInstance(*zone, icu::Locale(DEFAULT_LOCALE), status));
+  if (U_FAILURE(status)) {
+    return nullptr;
+  }
+
+  if (this->_calendars.size() >= Cache::MAX_SIZE) {
+    this->_calendars.clear();
+  }
+
+  return (this->_calendars[tz] = std::move(calendar)).get();
+}
+
+const icu::TimeZone* NativeDate::Cache::timeZone(const std::string& tz, UErrorCode& status) {
+  auto it = this->_timeZones.find(tz);
+  if (it != this->_timeZones.end()) {
+    return it->second.get();
+  }
+
+  std::unique_ptr<icu::TimeZone> zone(
+    icu::TimeZone::createTimeZone(icu::UnicodeString::fromUTF8(tz)));
+
+  if (!zone || *zone == icu::TimeZone::getUnknown()) {
+    status = U_ILLEGAL_ARGUMENT_ERROR;
+    return nullptr;
+  }
+
+  if (this->_timeZones.size() >= Cache::MAX_SIZE) {
+    // formatters and calendars keep their own copies of time zones
+    this->_timeZones.clear();
+  }
+
+  return (this->_timeZones[tz] = std::move(zone)).get();
+}
+
+void NativeDate::install(v8::Isolate* isolate,
+                         v8::Local<v8::ObjectTemplate> global,
+                         Cache* cache) {
+
+  auto data = v8::External::New(isolate, cache);
+  auto date = v8::ObjectTemplate::New(isolate);
+
+  date->Set(v8::String::NewFromUtf8(isolate, "now"),
+            v8::FunctionTemplate::New(isolate, NativeDate::_now, data));
+  date->Set(v8::String::NewFromUtf8(isolate, "parse"),
+            v8::FunctionTemplate::New(isolate, NativeDate::_parse, data));
+  date->Set(v8::String::NewFromUtf8(isolate, "format"),
+            v8::FunctionTemplate::New(isolate, NativeDate::_format, data));
+  date->Set(v8::String::NewFromUtf8(isolate, "add"),
+            v8::FunctionTemplate::New(isolate, NativeDate::_add, data));
+  date->Set(v8::String::NewFromUtf8(isolate, "diff"),
+            v8::FunctionTemplate::New(isolate, NativeDate::_diff, data));
+  date->Set(v8::String::NewFromUtf8(isolate, "startOf"),
+            v8::FunctionTemplate::New(isolate, NativeDate::_startOf, data));
+  date->Set(v8::String::NewFromUtf8(isolate, "offset"),
+            v8::FunctionTemplate::New(isolate, NativeDate::_offset, data));
+
+  global->Set(v8::String::NewFromUtf8(isolate, "date"), date);
+}
+
+void NativeDate::_now(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  using namespace std::chrono;
+  const auto now = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  args.GetReturnValue().Set(static_cast<double>(now.count()));
+}
+
+// date.parse(str[, pattern[, tz]]) - NaN if str does not match, as Date.parse
+void NativeDate::_parse(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  auto isolate = args.GetIsolate();
+  auto cache = NativeDate::_cache(args);
+
+  const std::string str = NativeDate::_stringArg(args, 0, "");
+  const std::string tz = NativeDate::_stringArg(args, 2, DEFAULT_TZ);
+
+  std::vector<std::string> patterns = ISO_PATTERNS;
+  if (args.Length() > 1 && !args[1]->IsUndefined() && !args[1]->IsNull()) {
+    patterns = { NativeDate::_stringArg(args, 1, ISO_PATTERN) };
+  }
+
+  const auto input = icu::UnicodeString::fromUTF8(str);
+
+  for (const auto& pattern: patterns) {
+    UErrorCode status = U_ZERO_ERROR;
+    auto formatter = cache->formatter(pattern, tz, DEFAULT_LOCALE, status);
+    if (U_FAILURE(status)) {
+      NativeDate::_throw(isolate, "date.parse: bad pattern or time zone.");
+      return;
+    }
+
+    icu::ParsePosition position(0);
+    const UDate res = formatter->parse(input, position);
+
+    if (position.getErrorIndex() == -1 && position.getIndex() == input.length()) {
+      args.GetReturnValue().Set(static_cast<double>(res));
+      return;
+    }
+  }
+
+  args.GetReturnValue().Set(std::nan(""));
+}
+
+// date.format(ms[, pattern[, tz[, locale]]])
+void NativeDate::_format(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  auto isolate = args.GetIsolate();
+  auto cache = NativeDate::_cache(args);
+
+  double ms = 0;
+  if (!NativeDate::_numberArg(args, 0, ms)) {
+    NativeDate::_throw(isolate, "date.format: date must be a number or Date.");
+    return;
+  }
+
+  UErrorCode status = U_ZERO_ERROR;
+  auto formatter = cache->formatter(
+    NativeDate::_stringArg(args, 1, ISO_PATTERN),
+    NativeDate::_stringArg(args, 2, DEFAULT_TZ),
+    NativeDate::_stringArg(args, 3, DEFAULT_LOCALE),
+    status
+  );
+  if (U_FAILURE(status)) {
+    NativeDate::_throw(isolate, "date.format: bad pattern, time zone or locale.");
+    return;
+  }
+
+  icu::UnicodeString formatted;
+  formatter->format(static_cast<UDate>(ms), formatted);
+
+  std::string res;
+  formatted.toUTF8String(res);
+
+  args.GetReturnValue().Set(v8::String::NewFromUtf8(isolate, res.c_str()));
+}
+
+// date.add(ms, amount, unit[, tz]) - days and longer are added in tz calendar
+void NativeDate::_add(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  auto isolate = args.GetIsolate();
+  auto cache = NativeDate::_cache(args);
+
+  double ms = 0;
+  double amount = 0;
+  UCalendarDateFields field;
+
+  if (!NativeDate::_numberArg(args, 0, ms) ||
+      !NativeDate::_numberArg(args, 1, amount) ||
+      !NativeDate::_unit(NativeDate::_stringArg(args, 2, ""), field)) {
+    NativeDate::_throw(isolate, "date.add: expected (date, amount, unit[, tz]).");
+    return;
+  }
+
+  double unitMs = 0;
+  if (absoluteUnit(field, unitMs)) {
+    args.GetReturnValue().Set(ms + std::trunc(amount) * unitMs);
+    return;
+  }
+
+  UErrorCode status = U_ZERO_ERROR;
+  auto calendar = cache->calendar(NativeDate::_stringArg(args, 3, DEFAULT_TZ), status);
+  if (U_FAILURE(status)) {
+    NativeDate::_throw(isolate, "date.add: bad time zone.");
+    return;
+  }
+
+  calendar->setTime(static_cast<UDate>(ms), status);
+  calendar->add(field, static_cast<int32_t>(amount), status);
+  const UDate res = calendar->getTime(status);
+
+  if (U_FAILURE(status)) {
+    NativeDate::_throw(isolate, "date.add: date is out of range.");
+    return;
+  }
+
+  args.GetReturnValue().Set(static_cast<double>(res));
+}
+
+// date.diff(ms1, ms2, unit[, tz]) - whole units from ms2 to ms1, as moment(ms1).diff(ms2, unit)
+void NativeDate::_diff(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  auto isolate = args.GetIsolate();
+  auto cache = NativeDate::_cache(args);
+
+  double ms1 = 0;
+  double ms2 = 0;
+  UCalendarDateFields field;
+
+  if (!NativeDate::_numberArg(args, 0, ms1) ||
+      !NativeDate::_numberArg(args, 1, ms2) ||
+      !NativeDate::_unit(NativeDate::_stringArg(args, 2, ""), field)) {
+    NativeDate::_throw(isolate, "date.diff: expected (date1, date2, unit[, tz]).");
+    return;
+  }
+
+  double unitMs = 0;
+  if (absoluteUnit(field, unitMs)) {
+    args.GetReturnValue().Set(std::trunc((ms1 - ms2) / unitMs));
+    return;
+  }
+
+  UErrorCode status = U_ZERO_ERROR;
+  auto calendar = cache->calendar(NativeDate::_stringArg(args, 3, DEFAULT_TZ), status);
+  if (U_FAILURE(status)) {
+    NativeDate::_throw(isolate, "date.diff: bad time zone.");
+    return;
+  }
+
+  calendar->setTime(static_cast<UDate>(ms2), status);
+  const int32_t res = calendar->fieldDifference(static_cast<UDate>(ms1), field, status);
+
+  if (U_FAILURE(status)) {
+    NativeDate::_throw(isolate, "date.diff: dates are out of range.");
+    return;
+  }
+
+  args.GetReturnValue().Set(res);
+}
+
+// date.startOf(ms, unit[, tz])
+void NativeDate::_startOf(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  auto isolate = args.GetIsolate();
+  auto cache = NativeDate::_cache(args);
+
+  double ms = 0;
+  UCalendarDateFields field;
+
+  if (!NativeDate::_numberArg(args, 0, ms) ||
+      !NativeDate::_unit(NativeDate::_stringArg(args, 1, ""), field)) {
+    NativeDate::_throw(isolate, "date.startOf: expected (date, unit[, tz]).");
+    return;
+  }
+
+  UErrorCode status = U_ZERO_ERROR;
+  auto calendar = cache->calendar(NativeDate::_stringArg(args, 2, DEFAULT_TZ), status);
+  if (U_FAILURE(status)) {
+    NativeDate::_throw(isolate, "date.startOf: bad time zone.");
+    return;
+  }
+
+  calendar->setTime(static_cast<UDate>(ms), status);
+
+  // fall through: every unit also resets all smaller ones
+  switch (field) {
+    case UCAL_YEAR:
+      calendar->set(UCAL_MONTH, UCAL_JANUARY);
+      [[fallthrough]];
+    case UCAL_MONTH:
+      calendar->set(UCAL_DATE, 1);
+      [[fallthrough]];
+    case UCAL_DATE:
+      calendar->set(UCAL_HOUR_OF_DAY, 0);
+      [[fallthrough]];
+    case UCAL_HOUR_OF_DAY:
+      calendar->set(UCAL_MINUTE, 0);
+      [[fallthrough]];
+    case UCAL_MINUTE:
+      calendar->set(UCAL_SECOND, 0);
+      [[fallthrough]];
+    case UCAL_SECOND:
+      calendar->set(UCAL_MILLISECOND, 0);
+      break;
+    case UCAL_WEEK_OF_YEAR:
+      calendar->set(UCAL_DAY_OF_WEEK, calendar->getFirstDayOfWeek(status));
+      calendar->set(UCAL_HOUR_OF_DAY, 0);
+      calendar->set(UCAL_MINUTE, 0);
+      calendar->set(UCAL_SECOND, 0);
+      calendar->set(UCAL_MILLISECOND, 0);
+      break;
+    default:
+      break;
+  }
+
+  const UDate res = calendar->getTime(status);
+
+  if (U_FAILURE(status)) {
+    NativeDate::_throw(isolate, "date.startOf: date is out of range.");
+    return;
+  }
+
+  args.GetReturnValue().Set(static_cast<double>(res));
+}
+
+// date.offset(ms, tz) - offset from UTC in minutes, DST included
+void NativeDate::_offset(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  auto isolate = args.GetIsolate();
+  auto cache = NativeDate::_cache(args);
+
+  double ms = 0;
+  if (!NativeDate::_numberArg(args, 0, ms)) {
+    NativeDate::_throw(isolate, "date.offset: expected (date, tz).");
+    return;
+  }
+
+  UErrorCode status = U_ZERO_ERROR;
+  auto zone = cache->timeZone(NativeDate::_stringArg(args, 1, DEFAULT_TZ), status);
+  if (U_FAILURE(status)) {
+    NativeDate::_throw(isolate, "date.offset: bad time zone.");
+    return;
+  }
+
+  int32_t rawOffset = 0;
+  int32_t dstOffset = 0;
+  zone->getOffset(static_cast<UDate>(ms), false, rawOffset, dstOffset, status);
+
+  args.GetReturnValue().Set((rawOffset + dstOffset) / (60 * 1000));
+}
+
+NativeDate::Cache* NativeDate::_cache(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  return static_cast<Cache*>(args.Data().As<v8::External>()->Value());
+}
+
+std::string NativeDate::_stringArg(const v8::FunctionCallbackInfo<v8::Value>& args,
+                                   int i,
+                                   const std::string& defaultValue) {
+  if (args.Length() <= i || args[i]->IsUndefined() || args[i]->IsNull()) {
+    return defaultValue;
+  }
+  v8::String::Utf8Value str(args[i]);
+  return *str ? std::string(*str, str.length()) : defaultValue;
+}
+
+bool NativeDate::_numberArg(const v8::FunctionCallbackInfo<v8::Value>& args, int i, double& value) {
+  if (args.Length() <= i) {
+    return false;
+  }
+  if (args[i]->IsNumber()) {
+    value = args[i].As<v8::Number>()->Value();
+  } else if (args[i]->IsDate()) {
+    value = args[i].As<v8::Date>()->ValueOf();
+  } else {
+    return false;
+  }
+  return std::isfinite(value);
+}
+
+bool NativeDate::_unit(const std::string& name, UCalendarDateFields& field) {
+  static const std::unordered_map<std::string, UCalendarDateFields> units = {
+    {"years", UCAL_YEAR}, {"year", UCAL_YEAR}, {"y", UCAL_YEAR},
+    {"months", UCAL_MONTH}, {"month", UCAL_MONTH}, {"M", UCAL_MONTH},
+    {"weeks", UCAL_WEEK_OF_YEAR}, {"week", UCAL_WEEK_OF_YEAR}, {"w", UCAL_WEEK_OF_YEAR},
+    {"days", UCAL_DATE}, {"day", UCAL_DATE}, {"d", UCAL_DATE},
+    {"hours", UCAL_HOUR_OF_DAY}, {"hour", UCAL_HOUR_OF_DAY}, {"h", UCAL_HOUR_OF_DAY},
+    {"minutes", UCAL_MINUTE}, {"minute", UCAL_MINUTE}, {"m", UCAL_MINUTE},
+    {"seconds", UCAL_SECOND}, {"second", UCAL_SECOND}, {"s", UCAL_SECOND},
+    {"milliseconds", UCAL_MILLISECOND}, {"millisecond", UCAL_MILLISECOND}, {"ms", UCAL_MILLISECOND}
+  };
+
+  auto it = units.find(name);
+  if (it == units.end()) {
+    return false;
+  }
+  field = it->second;
+  return true;
+}
+
+void NativeDate::_throw(v8::Isolate* isolate, const std::string& message) {
+  isolate->ThrowException(
+    v8::Exception::TypeError(v8::String::NewFromUtf8(isolate, message.c_str())));
+}
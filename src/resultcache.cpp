@@ -0,0 +1,213 @@
+#include <resultcache.h>
+
+#include <functional>
+#include <algorithm>
+
+using namespace pb;
+
+ResultCache::ResultCache(const std::size_t& budgetBytes, const std::size_t& shardsCount):
+  _budgetBytes(budgetBytes),
+  _pairsCount(0),
+  _hits(0),
+  _misses(0),
+  _evictions(0),
+  _expired(0) {
+
+  for (std::size_t i = 0; i < std::max<std::size_t>(shardsCount, 1); i++) {
+    this->_shards.push_back(std::make_unique<Shard>());
+  }
+}
+
+void ResultCache::enable(const std::string& conv, const std::string& node, const std::size_t& ttlMs) {
+  std::unique_lock<std::shared_mutex> lock(this->_pairsMutex);
+  this->_pairs[ResultCache::_pairKey(conv, node)] = ttlMs;
+  this->_pairsCount = this->_pairs.size();
+}
+
+void ResultCache::disable(const std::string& conv, const std::string& node) {
+  {
+    std::unique_lock<std::shared_mutex> lock(this->_pairsMutex);
+    if (this->_pairs.erase(ResultCache::_pairKey(conv, node)) == 0) {
+      return;
+    }
+    this->_pairsCount = this->_pairs.size();
+  }
+
+  this->invalidate(conv, node);
+}
+
+bool ResultCache::enabled(const std::string& conv, const std::string& node) const {
+  if (this->_pairsCount == 0) {
+    return false;
+  }
+
+  std::shared_lock<std::shared_mutex> lock(this->_pairsMutex);
+  return this->_pairs.count(ResultCache::_pairKey(conv, node)) > 0;
+}
+
+std::size_t ResultCache::pairsCount() const {
+  return this->_pairsCount;
+}
+
+bool ResultCache::get(const std::string& conv, const std::string& node, const std::string& input, std::string& result) {
+  if (!this->enabled(conv, node)) {
+    return false;
+  }
+
+  const auto key = ResultCache::_key(conv, node, input);
+  auto& shard = this->_shard(key);
+
+  std::lock_guard<std::mutex> guard(shard.mutex);
+
+  auto it = shard.index.find(key);
+  if (it == shard.index.end()) {
+    this->_misses++;
+    return false;
+  }
+
+  if (it->second->expiresAt <= Clock::now()) {
+    this->_erase(shard, it->second);
+    this->_expired++;
+    this->_misses++;
+    return false;
+  }
+
+  shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+  result = it->second->result;
+
+  this->_hits++;
+  return true;
+}
+
+void ResultCache::put(const std::string& conv, const std::string& node, const std::string& input, const std::string& result) {
+  if (this->_pairsCount == 0) {
+    return;
+  }
+
+  std::size_t ttlMs = 0;
+  {
+    std::shared_lock<std::shared_mutex> lock(this->_pairsMutex);
+    auto pair = this->_pairs.find(ResultCache::_pairKey(conv, node));
+    if (pair == this->_pairs.end()) {
+      return;
+    }
+    ttlMs = pair->second;
+  }
+
+  Entry entry;
+  entry.key = ResultCache::_key(conv, node, input);
+  entry.result = result;
+  entry.expiresAt = ttlMs ? Clock::now() + std::chrono::milliseconds(ttlMs) : Clock::time_point::max();
+  // strings and roughly the list and index nodes
+  entry.bytes = entry.key.size() + entry.result.size() + sizeof(Entry) + 64;
+
+  const std::size_t budget = this->_budgetBytes / this->_shards.size();
+  if (entry.bytes > budget) {
+    return;
+  }
+
+  auto& shard = this->_shard(entry.key);
+
+  std::lock_guard<std::mutex> guard(shard.mutex);
+
+  // a run of the same input finished meanwhile
+  auto it = shard.index.find(entry.key);
+  if (it != shard.index.end()) {
+    this->_erase(shard, it->second);
+  }
+
+  shard.bytes += entry.bytes;
+  shard.lru.push_front(std::move(entry));
+  shard.index.emplace(std::string_view(shard.lru.front().key), shard.lru.begin());
+
+  this->_evict(shard, budget);
+}
+
+void ResultCache::invalidate(const std::string& conv, const std::string& node) {
+  this->_invalidate(ResultCache::_pairKey(conv, node));
+}
+
+void ResultCache::clear() {
+  {
+    std::unique_lock<std::shared_mutex> lock(this->_pairsMutex);
+    this->_pairs.clear();
+    this->_pairsCount = 0;
+  }
+
+  for (auto& shard: this->_shards) {
+    std::lock_guard<std::mutex> guard(shard->mutex);
+    shard->index.clear();
+    shard->lru.clear();
+    shard->bytes = 0;
+  }
+}
+
+void ResultCache::setBudget(const std::size_t& budgetBytes) {
+  this->_budgetBytes = budgetBytes;
+
+  const std::size_t budget = budgetBytes / this->_shards.size();
+  for (auto& shard: this->_shards) {
+    std::lock_guard<std::mutex> guard(shard->mutex);
+    this->_evict(*shard, budget);
+  }
+}
+
+ResultCache::Statistics ResultCache::statistics() const {
+  Statistics statistics;
+  statistics.hits = this->_hits;
+  statistics.misses = this->_misses;
+  statistics.evictions = this->_evictions;
+  statistics.expired = this->_expired;
+  statistics.budgetBytes = this->_budgetBytes;
+
+  for (auto& shard: this->_shards) {
+    std::lock_guard<std::mutex> guard(shard->mutex);
+    statistics.entries += shard->lru.size();
+    statistics.bytes += shard->bytes;
+  }
+
+  return statistics;
+}
+
+std::string ResultCache::_pairKey(const std::string& conv, const std::string& node) {
+  std::string key;
+  key.reserve(conv.size() + node.size() + 2);
+  key.append(conv).push_back('\0');
+  key.append(node).push_back('\0');
+  return key;
+}
+
+std::string ResultCache::_key(const std::string& conv, const std::string& node, const std::string& input) {
+  return ResultCache::_pairKey(conv, node) + input;
+}
+
+ResultCache::Shard& ResultCache::_shard(const std::string& key) {
+  return *this->_shards[std::hash<std::string>()(key) % this->_shards.size()];
+}
+
+void ResultCache::_erase(Shard& shard, std::list<Entry>::iterator it) {
+  shard.bytes -= it->bytes;
+  shard.index.erase(std::string_view(it->key));
+  shard.lru.erase(it);
+}
+
+void ResultCache::_evict(Shard& shard, const std::size_t& budget) {
+  while (shard.bytes > budget && !shard.lru.empty()) {
+    this->_erase(shard, std::prev(shard.lru.end()));
+    this->_evictions++;
+  }
+}
+
+// a pair is spread over all shards, recompiles and removes are rare
+void ResultCache::_invalidate(const std::string& prefix) {
+  for (auto& shard: this->_shards) {
+    std::lock_guard<std::mutex> guard(shard->mutex);
+    for (auto it = shard->lru.begin(); it != shard->lru.end(); ) {
+      auto next = std::next(it);
+      if (it->key.compare(0, prefix.size(), prefix) == 0) {
+        this->_erase(*shard, it);
+      }
+      it = next;
+    }
+  }
+}
@@ -0,0 +1,134 @@
+#include <v8platform.h>
+
+#include <climits>
+
+using namespace pb;
+
+V8Platform::V8Platform(const Options& options):
+  // the default platform still owns foreground queues and delayed tasks,
+  // one worker thread is enough for it
+  _default(v8::platform::CreateDefaultPlatform(1)),
+  _pool(new ThreadPool(options.backgroundThreadsCount,
+                       INT_MAX, // V8 tasks can not be rejected
+                       options.cpus,
+                       options.backgroundNiceness)),
+  _backgroundThreadsCount(options.backgroundThreadsCount),
+  _tasksPosted(0),
+  _blockingTasksPosted(0),
+  _longRunningTasksPosted(0) {}
+
+V8Platform::~V8Platform() {
+  // finish queued tasks before the default platform goes away
+  this->_pool->joinAll();
+}
+
+V8Platform::Statistics V8Platform::getStatistics() {
+  Statistics stats;
+  stats.backgroundThreadsCount = this->_backgroundThreadsCount;
+  stats.tasksPosted = this->_tasksPosted;
+  stats.blockingTasksPosted = this->_blockingTasksPosted;
+  stats.longRunningTasksPosted = this->_longRunningTasksPosted;
+  stats.tasksQueued = this->_pool->getJobsLeft();
+  stats.tasksDone = this->_pool->getAmountOfDoneJobs();
+  stats.queueWaitUs = this->_queueWaitUs.snapshot();
+  stats.runTimeUs = this->_runTimeUs.snapshot();
+  return stats;
+}
+
+void V8Platform::_post(std::unique_ptr<v8::Task> task, PRIORITY priority) {
+
+  this->_tasksPosted += 1;
+  if (priority == PRIORITY::BLOCKING) {
+    this->_blockingTasksPosted += 1;
+  } else if (priority == PRIORITY::LONG_RUNNING) {
+    this->_longRunningTasksPosted += 1;
+  }
+
+  const auto posted = std::chrono::steady_clock::now();
+
+  Job job([this, task = std::move(task), posted](std::size_t threadNum) {
+    using namespace std::chrono;
+
+    const auto started = steady_clock::now();
+    this->_queueWaitUs.record(duration_cast<microseconds>(started - posted).count());
+
+    task->Run();
+
+    this->_runTimeUs.record(duration_cast<microseconds>(steady_clock::now() - started).count());
+  });
+
+  // a rejected job is not moved from
+  if (!this->_pool->addJob(priority, std::move(job))) {
+    // never drop V8 work
+    job(0);
+  }
+}
+
+size_t V8Platform::NumberOfAvailableBackgroundThreads() {
+  return this->_backgroundThreadsCount;
+}
+
+void V8Platform::CallOnBackgroundThread(v8::Task* task, ExpectedRuntime expected_runtime) {
+  this->_post(
+    std::unique_ptr<v8::Task>(task),
+    expected_runtime == kLongRunningTask ? PRIORITY::LONG_RUNNING : PRIORITY::SHORT_RUNNING
+  );
+}
+
+void V8Platform::CallOnForegroundThread(v8::Isolate* isolate, v8::Task* task) {
+  this->_default->CallOnForegroundThread(isolate, task);
+}
+
+void V8Platform::CallDelayedOnForegroundThread(v8::Isolate* isolate,
+                                               v8::Task* task,
+                                               double delay_in_seconds) {
+  this->_default->CallDelayedOnForegroundThread(isolate, task, delay_in_seconds);
+}
+
+void V8Platform::CallIdleOnForegroundThread(v8::Isolate* isolate, v8::IdleTask* task) {
+  this->_default->CallIdleOnForegroundThread(isolate, task);
+}
+
+bool V8Platform::IdleTasksEnabled(v8::Isolate* isolate) {
+  return this->_default->IdleTasksEnabled(isolate);
+}
+
+double V8Platform::MonotonicallyIncreasingTime() {
+  return this->_default->MonotonicallyIncreasingTime();
+}
+
+v8::TracingController* V8Platform::GetTracingController() {
+  return this->_default->GetTracingController();
+}
+
+#if PB_V8_WORKER_THREADS_API
+
+int V8Platform::NumberOfWorkerThreads() {
+  return static_cast<int>(this->_backgroundThreadsCount);
+}
+
+void V8Platform::CallOnWorkerThread(std::unique_ptr<v8::Task> task) {
+  this->_post(std::move(task), PRIORITY::SHORT_RUNNING);
+}
+
+// V8 waits for these tasks on the main thread (e.g. parallel GC phases)
+void V8Platform::CallBlockingTaskOnWorkerThread(std::unique_ptr<v8::Task> task) {
+  this->_post(std::move(task), PRIORITY::BLOCKING);
+}
+
+std::shared_ptr<v8::TaskRunner> V8Platform::GetForegroundTaskRunner(v8::Isolate* isolate) {
+  return this->_default->GetForegroundTaskRunner(isolate);
+}
+
+std::shared_ptr<v8::TaskRunner> V8Platform::GetWorkerThreadsTaskRunner(v8::Isolate* isolate) {
+  return std::make_shared<WorkerTaskRunner>(
+    this,
+    this->_default->GetWorkerThreadsTaskRunner(isolate)
+  );
+}
+
+double V8Platform::CurrentClockTimeMillis() {
+  return this->_default->CurrentClockTimeMillis();
+}
+
+#endif
@@ -3,10 +3,50 @@
 using namespace pb;
 
 fs::path V8Runner::_pathToLibs;
-std::shared_mutex V8Runner::_requireCacheMutex;
-std::unordered_map<std::string, std::string> V8Runner::_requireCache;
+LibCache V8Runner::_libs;
 
-std::vector<std::string> splitString(const std::string& str, const auto& separator);
+namespace {
+
+  // lets V8 read a cached library in place, keeps its bytes alive
+  // as long as the string is
+  class LibResource: public v8::String::ExternalOneByteStringResource {
+  public:
+    explicit LibResource(const std::shared_ptr<const LibCache::File>& file):
+      _file(file) {}
+
+    const char* data() const override { return this->_file->data(); }
+    size_t length() const override { return this->_file->size(); }
+
+  private:
+    std::shared_ptr<const LibCache::File> _file;
+  };
+
+  // unordered maps keep their buckets after erase: give them back once
+  // the map fills less than a quarter of them, rehash sizes it to fit
+  template <typename Map>
+  bool compact(Map& map) {
+    if (map.bucket_count() <= 64 || map.size() * 4 >= map.bucket_count()) {
+      return false;
+    }
+    map.rehash(0);
+    return true;
+  }
+
+  // counts runs which wait for or hold an isolate
+  class IsolateUse {
+  public:
+    explicit IsolateUse(std::atomic<int>& users): _users(users) {
+      this->_users += 1;
+    }
+    ~IsolateUse() {
+      this->_users -= 1;
+    }
+
+  private:
+    std::atomic<int>& _users;
+  };
+
+}
 
 V8Runner::V8Runner(int argc,
                    char* argv[],
@@ -14,21 +54,32 @@ V8Runner::V8Runner(int argc,
                    const std::size_t& maxExecutionTime,
                    const std::size_t& maxRAMAvailable,
                    const std::size_t& timeCheckerSleepTime,
-                   const std::size_t& threadsCount /* = 1 */):
+                   const std::size_t& threadsCount /* = 1 */,
+                   const V8Platform::Options& platformOptions /* = V8Platform::Options() */,
+                   const std::shared_ptr<Topology>& topology /* = nullptr */,
+                   const std::size_t& readyIsolates /* = 0 */,
+                   const ISOLATE_MODE& isolateMode /* = CONV_ISOLATES */):
 
                    _platform(nullptr),
+                   _isolateMode(isolateMode),
+                   _topology(topology),
                    _timing(threadsCount),
+                   _gcPauses(std::make_shared<GCPauses>()),
                    _timeCheckerWatch(true),
                    _maxExecutionTime(maxExecutionTime),
+                   _maxCompileTime(maxExecutionTime),
+                   _maxCheckCodeTime(maxExecutionTime),
                    _maxRAMAvailable(maxRAMAvailable),
                    _timeCheckerSleepTime(timeCheckerSleepTime),
                    _threadsCount(threadsCount) {
 
+  this->_startupStarted = std::chrono::steady_clock::now();
+
   V8Runner::_pathToLibs = pathToLibs;
 
   v8::V8::InitializeICUDefaultLocation(argv[0]);
   v8::V8::InitializeExternalStartupData(argv[0]);
-  this->_platform = v8::platform::CreateDefaultPlatform();
+  this->_platform = new V8Platform(platformOptions);
 
   const uint64_t physical_memory = this->_maxRAMAvailable * 1024 * 1024 * 1024;
   const uint64_t virtual_memory_limit = 0;
@@ -48,20 +99,52 @@ V8Runner::V8Runner(int argc,
 
   this->_timeChecker = std::thread(&pb::V8Runner::_timeCheckerFunc, this);
 
+  this->_convContextsEnabled = false;
+  this->_layoutVersion = 0;
+  this->_compactions = 0;
+  this->_keptVersions = 1;
+
+  this->_hotConvsStop = false;
+  this->_hotConvsThread = std::thread(&pb::V8Runner::_hotConvsFunc, this);
+
+  // libraries first: every isolate precompiles them while it is created
+  this->_startup.libsCount = this->loadLibs();
+  this->_startup.libsUs = this->_sinceStartupUs();
+
   // the amount of isolates should be equal to threadsCount
-  this->_setIsolates(threadsCount);
+  this->_setIsolates(threadsCount, readyIsolates);
 
-  this->loadLibs();
+  const auto startup = this->getStartupStatistics();
+  std::cout << "startup: libs " << startup.libsCount << " in " << startup.libsUs << " us, "
+            << "ready " << startup.isolatesCount << "/" << threadsCount << " isolates "
+            << "in " << startup.readyUs << " us "
+            << "(first " << startup.firstIsolateUs << " us, "
+            << "slowest " << startup.slowestIsolateUs << " us)" << std::endl;
 
 }
 
 
 V8Runner::~V8Runner() {
 
+  this->_startupStop = true;
+  for (auto& thread: this->_startupThreads) {
+    thread.join();
+  }
+
+  V8Runner::_libs.stopWatching();
+
+  {
+    std::lock_guard<std::mutex> guard(this->_hotConvsMutex);
+    this->_hotConvsStop = true;
+  }
+  this->_hotConvsVar.notify_one();
+  this->_hotConvsThread.join();
+
   this->_timeCheckerWatch = false;
   this->_timeChecker.join();
 
   this->cleanData();
+  this->_resetDisplaced();
 
   // clean isolate related data
   for (auto& kv: this->_isolatesData) {
@@ -75,6 +158,7 @@ V8Runner::~V8Runner() {
 
   this->_isolatesData.clear();
   this->_isolates.clear();
+  this->_isolateNodes.clear();
 
   v8::V8::Dispose();
   v8::V8::ShutdownPlatform();
@@ -83,55 +167,468 @@ V8Runner::~V8Runner() {
   delete this->_create_params.array_buffer_allocator;
 }
 
-void V8Runner::_setIsolates(const std::size_t& N) {
-  std::unique_lock<std::shared_mutex> lock(this->_compileMutex);
+void V8Runner::_setIsolates(const std::size_t& N, const std::size_t& readyCount) {
 
-  for (uint i = 0 ; i < N; i++) {
-    auto isolateData = this->makeNewIsolate();
+  this->_nextIsolate = 0;
+  this->_startupStop = false;
+  this->_isolatesExpected = N;
 
-    auto isolate = std::get<0>(isolateData);
-    this->_isolatesData[isolate] = std::get<1>(isolateData);
+  // one creating thread per core, each one takes the next isolate index
+  const std::size_t threadsCount =
+    std::min<std::size_t>(N, std::max(1u, std::thread::hardware_concurrency()));
+
+  for (std::size_t i = 0; i < threadsCount; i++) {
+    this->_startupThreads.push_back(std::thread(&V8Runner::_startupFunc, this));
+  }
+
+  const std::size_t ready = readyCount == 0 ? N : std::min(readyCount, N);
+
+  std::unique_lock<std::shared_mutex> lock(this->_compileMutex);
+  this->_isolatesCreated.wait(lock, [this, ready] {
+    return this->_isolates.size() >= ready;
+  });
+
+  this->_startup.readyUs = this->_sinceStartupUs();
+}
 
-    this->_isolates.push_back(isolate);
+void V8Runner::_startupFunc() {
+  for (std::size_t i = this->_nextIsolate++; i < this->_isolatesExpected; i = this->_nextIsolate++) {
+    if (this->_startupStop) {
+      return;
+    }
+    this->_addIsolate(i);
   }
 }
 
-std::unordered_map<std::string, std::string> V8Runner::loadLibs() {
+void V8Runner::_addIsolate(const std::size_t& index) {
+  const auto started = std::chrono::steady_clock::now();
+
+  // create the isolate on a thread bound to its node,
+  // so the initial heap pages are allocated there (first touch)
+  const int node = this->_topology ? this->_topology->workerNode(index) : -1;
+  if (this->_topology) {
+    this->_topology->pinCurrentThreadToNode(node);
+  }
+
+  auto isolateData = this->makeNewIsolate();
+  auto isolate = std::get<0>(isolateData);
+
+  const auto precompiled = this->_precompileLibs(isolate, std::get<1>(isolateData));
 
-  std::unique_lock<std::shared_mutex> lock(V8Runner::_requireCacheMutex);
+  // thread isolates get every function before they serve,
+  // compiles of new functions wait meanwhile
+  std::unique_lock<std::mutex> replicaLock(this->_replicaMutex, std::defer_lock);
+  std::vector<std::pair<ConvNodePair, PersistentFunction>> replicas;
 
-  bool found = false;
-  for (fs::recursive_directory_iterator i(V8Runner::_pathToLibs), end; i != end; ++i) {
-    if (!fs::is_directory(i->path()) && i->path().extension() == ".js") {
+  if (this->_isolateMode == THREAD_ISOLATES) {
+    replicaLock.lock();
 
-      found = true;
+    std::vector<std::pair<ConvNodePair, std::string>> sources;
+    {
+      std::shared_lock<std::shared_mutex> lock(this->_compileMutex);
+      sources.assign(this->_sources.begin(), this->_sources.end());
+    }
 
-      auto requireFile = V8Runner::_getRequireFile(i->path().string());
+    v8::Locker locker(isolate);
+    v8::Isolate::Scope isolate_scope(isolate);
+    v8::HandleScope scope(isolate);
 
-      if (std::get<ERR_CODE>(requireFile) != STATUS::NO_ERR) {
+    auto context = v8::Local<v8::Context>::New(isolate, std::get<1>(isolateData)->getPContext());
+    v8::Context::Scope context_scope(context);
 
-        std::cerr << "[ERROR] [loadLibs] "
-                  << "Code: " << std::get<ERR_CODE>(requireFile) << ", "
-                  << "Message: " << std::get<DATA>(requireFile)
+    for (const auto& source: sources) {
+      PersistentFunction function;
+      auto res = this->_compileFunction(isolate, context, source.second.c_str(), function);
+      if (std::get<ERR_CODE>(res) != STATUS::NO_ERR) {
+        std::cerr << "[ERROR] [addIsolate] "
+                  << "Can not replicate (" << source.first.first << ", " << source.first.second << "): "
+                  << std::get<DATA>(res)
                   << std::endl;
         continue;
       }
+      replicas.emplace_back(source.first, std::move(function));
+    }
+  }
+
+  const std::size_t timeUs = std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - started).count();
+
+  {
+    std::unique_lock<std::shared_mutex> lock(this->_compileMutex);
+
+    // keep isolates in creation order, so the i-th pool thread
+    // ends up with the i-th isolate (and its node) in thread mode
+    const std::size_t position =
+      std::upper_bound(this->_isolateIndexes.begin(), this->_isolateIndexes.end(), index) -
+      this->_isolateIndexes.begin();
+
+    this->_isolatesData[isolate] = std::get<1>(isolateData);
+    this->_isolates.insert(this->_isolates.begin() + position, isolate);
+    this->_isolateIndexes.insert(this->_isolateIndexes.begin() + position, index);
+    if (this->_topology) {
+      this->_isolateNodes[isolate] = node;
+    }
+
+    if (this->_isolateMode == THREAD_ISOLATES) {
+      // broadcasts built before it lack a slot for it
+      this->_layoutVersion += 1;
+
+      // handles are moved in, no isolate is locked under the unique lock
+      for (auto& slots: this->_replicas) {
+        slots.second.insert(slots.second.begin() + position, PersistentFunction());
+      }
+      for (auto& replica: replicas) {
+        this->_replicas.at(replica.first)[position] = std::move(replica.second);
+      }
+    }
+
+    // isolates added by resizeIsolates are not a part of startup
+    auto& startup = this->_startup;
+    if (startup.allIsolatesUs == 0) {
+      startup.isolatesCount = this->_isolates.size();
+      startup.precompiledLibs += precompiled;
+      startup.slowestIsolateUs = std::max(startup.slowestIsolateUs, timeUs);
+      if (startup.isolatesCount == 1) {
+        startup.firstIsolateUs = this->_sinceStartupUs();
+      }
+      if (startup.isolatesCount == this->_isolatesExpected) {
+        startup.allIsolatesUs = this->_sinceStartupUs();
+      }
+    }
+  }
+
+  this->_isolatesCreated.notify_all();
+}
+
+std::size_t V8Runner::resizeIsolates(const std::size_t& count) {
+
+  // grow and shrink from a complete set only
+  this->waitForIsolates();
+
+  const std::size_t target = std::max<std::size_t>(count, 1);
+
+  std::size_t current = this->isolates_count();
+
+  if (target > current) {
+    // pool threads with new numbers may run right after we return
+    {
+      std::unique_lock<std::shared_mutex> lock(this->_timeCheckerMutex);
+      if (this->_timing.size() < target) {
+        this->_timing.resize(target);
+      }
+    }
+
+    // new isolates are created in parallel and without the lock,
+    // new convs start to land on them as soon as they are published
+    std::vector<std::thread> creators;
+    for (std::size_t i = current; i < target; i++) {
+      creators.push_back(std::thread(&V8Runner::_addIsolate, this, i));
+    }
+    for (auto& creator: creators) {
+      creator.join();
+    }
+  }
+
+  std::size_t resized = 0;
+  {
+    // compiles (and their warm-ups) in an isolate finish before it is retired,
+    // conv and replica changes are serialized by _replicaMutex
+    std::unique_lock<std::shared_mutex> retireLock(this->_retireMutex);
+    std::lock_guard<std::mutex> guard(this->_replicaMutex);
+
+    // a function which does not compile in its new isolate keeps
+    // the isolate, the next resize tries again
+    while (this->isolates_count() > target &&
+           this->_retireIsolate(this->_isolates.back())) {}
+
+    std::unique_lock<std::shared_mutex> lock(this->_compileMutex);
+
+    this->_isolatesExpected = this->_isolates.size();
+    resized = this->_isolates.size();
+  }
+
+  this->_resetDisplaced();
+
+  return resized;
+}
+
+bool V8Runner::_retireIsolate(v8::Isolate* isolate) {
+
+  // hot convs: drop replicas in the isolate and all replicas of its convs,
+  // they are made again if the conv is still hot
+  {
+    std::unique_lock<std::shared_mutex> lock(this->_compileMutex);
+    for (auto& load: this->_convLoads) {
+      auto& replicas = load.second->replicas;
+      const bool primary = this->_convs[load.first] == isolate;
+      while (!replicas.empty() &&
+             (primary || std::find(replicas.begin(), replicas.end(), isolate) != replicas.end())) {
+        this->_dropConvReplica(load.first, primary ? replicas.back() : isolate);
+      }
+    }
+  }
+
+  // convs, functions and sources change under _replicaMutex only,
+  // the set of isolates is read under the lock anyway
+  std::vector<v8::Isolate*> remaining;
+  std::unordered_map<v8::Isolate*, std::shared_ptr<IsolateRelatedData>> remainingData;
+  {
+    std::shared_lock<std::shared_mutex> lock(this->_compileMutex);
+    remaining.assign(this->_isolates.begin(), this->_isolates.end() - 1);
+    for (auto target: remaining) {
+      remainingData[target] = this->_isolatesData.at(target);
+    }
+  }
+
+  // its convs go to the remaining isolates round-robin
+  std::unordered_map<Conv, v8::Isolate*> moved;
+  for (const auto& conv: this->_convs) {
+    if (conv.second == isolate) {
+      moved[conv.first] = remaining[moved.size() % remaining.size()];
+    }
+  }
+
+  // top-level code of migrated functions runs before the exclusive lock,
+  // runs keep going on the old isolate meanwhile
+  std::vector<std::pair<ConvNodePair, PersistentFunction>> migrated;
+  bool failed = false;
+
+  for (const auto& function: this->_functions) {
+    auto target = moved.find(function.first.first);
+    if (target == moved.end()) {
+      continue;
+    }
+
+    // a pair without a source has nothing to compile
+    auto source = this->_sources.find(function.first);
+    if (source == this->_sources.end()) {
+      continue;
+    }
+
+    auto targetIsolate = target->second;
+
+    v8::Locker locker(targetIsolate);
+    v8::Isolate::Scope isolate_scope(targetIsolate);
+    v8::HandleScope scope(targetIsolate);
+
+    auto context = this->_convContext(function.first.first, targetIsolate, remainingData[targetIsolate]);
+    v8::Context::Scope context_scope(context);
+
+    PersistentFunction compiled;
+    auto res = this->_compileFunction(targetIsolate, context, source->second.c_str(), compiled);
+    if (std::get<ERR_CODE>(res) != STATUS::NO_ERR) {
+      std::cerr << "[ERROR] [resizeIsolates] "
+                << "Can not migrate (" << function.first.first << ", " << function.first.second << "), "
+                << "the isolate is kept: "
+                << std::get<DATA>(res)
+                << std::endl;
+      failed = true;
+      break;
+    }
+
+    migrated.emplace_back(function.first, std::move(compiled));
+  }
+
+  if (failed) {
+    // nothing is published: drop what was compiled and the conv contexts
+    // made for it (replicas of the moved convs had none left there)
+    for (auto& function: migrated) {
+      v8::Locker locker(moved[function.first.first]);
+      function.second.Reset();
+    }
+    for (const auto& conv: moved) {
+      this->_dropConvContexts(conv.first, conv.second);
+    }
+    return false;
+  }
+
+  std::unique_lock<std::shared_mutex> lock(this->_compileMutex);
+
+  this->_layoutVersion += 1;
+
+  this->_isolates.pop_back();
+  this->_isolateIndexes.pop_back();
+
+  for (const auto& conv: moved) {
+    this->_convs[conv.first] = conv.second;
+    this->_placeConv(conv.first, conv.second);
+  }
+
+  // runs of moved convs see all their functions in the new isolate at once
+  {
+    v8::Locker locker(isolate);
+    for (auto& function: this->_functions) {
+      if (moved.count(function.first.first)) {
+        function.second.Reset();
+      }
+    }
+  }
+  // moved into the emptied slots, the target isolates are not locked
+  for (auto& function: migrated) {
+    this->_functions[function.first] = std::move(function.second);
+  }
+
+  for (const auto& conv: moved) {
+    this->_dropConvContexts(conv.first, isolate);
+  }
+
+  // thread isolates: every function has a replica in the last slot
+  {
+    v8::Locker locker(isolate);
+    for (auto& replicas: this->_replicas) {
+      replicas.second.back().Reset();
+      replicas.second.pop_back();
+    }
+  }
+
+  // kept versions lose their copy in it, rollback compiles the source there
+  {
+    v8::Locker locker(isolate);
+    for (auto& versions: this->_versions) {
+      for (auto& version: versions.second.previous) {
+        for (auto& function: version.functions) {
+          if (function.first == isolate) {
+            function.second.Reset();
+          }
+        }
+      }
+    }
+  }
+
+  // the time checker must not touch it anymore
+  {
+    std::unique_lock<std::shared_mutex> lock(this->_timeCheckerMutex);
+    for (auto& item: this->_timing) {
+      if (item && item->isolate == isolate) {
+        item.reset();
+      }
+    }
+  }
+
+  // nothing of it may be reset after it is disposed
+  this->_resetDisplaced(isolate);
+
+  {
+    v8::Locker locker(isolate);
+    this->_isolatesData[isolate]->clean();
+  }
+
+  this->_isolatesData.erase(isolate);
+  this->_isolateNodes.erase(isolate);
+
+  isolate->Dispose();
+
+  std::cout << "[resizeIsolates] retired an isolate, "
+            << moved.size() << " convs (" << migrated.size() << " functions) migrated" << std::endl;
 
-      auto parts = ::splitString(i->path(), fs::path::preferred_separator);
-      auto partsLen = parts.size();
-      auto libPath = parts[partsLen-2] + fs::path::preferred_separator + parts[partsLen-1];
+  return true;
+}
+
+std::size_t V8Runner::_precompileLibs(v8::Isolate* isolate,
+                                      const std::shared_ptr<IsolateRelatedData>& isolateData) {
+  std::size_t compiled = 0;
+
+  v8::Locker locker(isolate);
+  v8::Isolate::Scope isolate_scope(isolate);
+  v8::HandleScope scope(isolate);
+
+  auto context = v8::Local<v8::Context>::New(isolate, isolateData->getPContext());
+  v8::Context::Scope context_scope(context);
+
+  for (const auto& lib: *V8Runner::_libs.files()) {
+    v8::HandleScope libScope(isolate);
+    v8::TryCatch try_catch(isolate);
+
+    // a broken library is reported by require()
+    v8::Local<v8::Script> script;
+    if (v8::Script::Compile(context, V8Runner::_libSource(isolate, lib.second)).ToLocal(&script)) {
+      compiled += 1;
+    }
+  }
+
+  return compiled;
+}
+
+std::tuple<int, std::string> V8Runner::_compileFunction(
+  v8::Isolate* isolate,
+  v8::Local<v8::Context> context,
+  const char* src,
+  PersistentFunction& function,
+  std::string* codeCache) {
+
+  v8::HandleScope scope(isolate);
+  v8::TryCatch try_catch(isolate);
+
+  auto script = v8::String::NewFromUtf8(isolate, src);
+
+  v8::Local<v8::Script> compiled_script;
+  if (!v8::Script::Compile(context, script).ToLocal(&compiled_script)) {
+    return std::make_tuple(STATUS::COMPILE_ERR, V8Runner::_makeTryCatchError(try_catch));
+  }
+
+  IsolateRelatedData::KVScope kvScope(isolate);
+  auto timing = this->_watch(isolate, EXEC_COMPILE);
+  v8::Local<v8::Value> result;
+  const bool evaluated = compiled_script->Run(context).ToLocal(&result);
+  this->_unwatch(timing);
 
-      V8Runner::_requireCache[libPath] = std::get<DATA>(requireFile);
+  if (!evaluated) {
+    if (try_catch.HasTerminated()) {
+      return std::make_tuple(STATUS::SCRIPT_TERMINATED_ERR, std::string("Script has been terminated."));
     }
+    return std::make_tuple(STATUS::COMPILE_ERR, V8Runner::_makeTryCatchError(try_catch));
   }
 
+  if (!result->IsFunction()) {
+    return std::make_tuple(STATUS::COMPILE_ERR, std::string("Script does not evaluate to a function."));
+  }
+
+  if (codeCache) {
+    // produced after Run, so it also contains eagerly executed functions
+    std::unique_ptr<v8::ScriptCompiler::CachedData> cache(
+      v8::ScriptCompiler::CreateCodeCache(compiled_script->GetUnboundScript(), script));
+    if (cache) {
+      codeCache->assign(reinterpret_cast<const char*>(cache->data), cache->length);
+    }
+  }
+
+  function.Reset();
+  function = PersistentFunction(isolate, result.As<v8::Function>());
+
+  return std::make_tuple(STATUS::NO_ERR, std::string());
+}
+
+std::size_t V8Runner::_sinceStartupUs() const {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - this->_startupStarted).count();
+}
+
+void V8Runner::waitForIsolates() {
+  std::unique_lock<std::shared_mutex> lock(this->_compileMutex);
+  this->_isolatesCreated.wait(lock, [this] {
+    return this->_isolates.size() >= this->_isolatesExpected;
+  });
+}
+
+V8Runner::StartupStatistics V8Runner::getStartupStatistics() {
+  std::shared_lock<std::shared_mutex> lock(this->_compileMutex);
+  return this->_startup;
+}
+
+std::size_t V8Runner::loadLibs() {
+
+  const auto found = V8Runner::_libs.load(V8Runner::_pathToLibs);
+
   if (!found) {
     std::cerr << "[WARNING] [loadLibs] "
               << "Didn't find any .js file. "
               << "Please, check lib path." << std::endl;
   }
 
-  return V8Runner::_requireCache;
+  // changed libraries are reloaded in background, no update command needed
+  V8Runner::_libs.watch();
+
+  return found;
 
 }
 
@@ -139,9 +636,24 @@ std::unordered_map<std::string, std::string> V8Runner::loadLibs() {
 std::tuple<int, std::string> V8Runner::compile(
   const char* conv_id,
   const char* node_id,
-  const char* src
+  const char* src,
+  const std::size_t& threadId,
+  WarmUp* warmUp
+) {
+  auto res = this->_compile(conv_id, node_id, src, threadId, warmUp);
+  this->_resetDisplaced();
+  return res;
+}
+
+
+std::tuple<int, std::string> V8Runner::compileBulk(
+  const char* conv_id,
+  std::vector<BulkNode>& nodes,
+  const bool& skipUnchanged
 ) {
-  return this->_compile(conv_id, node_id, src);
+  auto res = this->_compileBulk(conv_id, nodes, skipUnchanged);
+  this->_resetDisplaced();
+  return res;
 }
 
 
@@ -149,17 +661,33 @@ std::tuple<int, std::string> V8Runner::remove(
   const char* conv_id,
   const char* node_id
 ) {
-  return this->_remove(conv_id, node_id);
+  auto res = this->_remove(conv_id, node_id);
+  this->_resetDisplaced();
+  return res;
+}
+
+
+std::tuple<int, std::string> V8Runner::removeConv(const char* conv_id) {
+  auto res = this->_removeConv(conv_id);
+  this->_resetDisplaced();
+  return res;
 }
 
+std::tuple<int, std::string> V8Runner::rollback(const char* conv_id, const char* node_id) {
+  auto res = this->_rollback(conv_id, node_id);
+  this->_resetDisplaced();
+  return res;
+}
 
 std::tuple<int, std::string> V8Runner::run(
   const char* conv_id,
   const char* node_id,
   const char* data,
-  const std::size_t& threadId
+  const std::size_t& threadId,
+  RunTrace* trace,
+  const std::size_t& maxExecutionTime
 ) {
-  return this->_run(conv_id, node_id, data, threadId);
+  return this->_run(conv_id, node_id, data, threadId, trace, maxExecutionTime);
 }
 
 std::tuple<int, std::string> V8Runner::checkCode(
@@ -183,6 +711,26 @@ std::size_t V8Runner::getMaxExecutionTime() {
   return this->_maxExecutionTime;
 }
 
+void V8Runner::setMaxCompileTime(const std::size_t& maxCompileTime) {
+  std::unique_lock<std::shared_mutex> lock(this->_timeCheckerMutex);
+  this->_maxCompileTime = maxCompileTime;
+}
+
+std::size_t V8Runner::getMaxCompileTime() {
+  std::shared_lock<std::shared_mutex> lock(this->_timeCheckerMutex);
+  return this->_maxCompileTime;
+}
+
+void V8Runner::setMaxCheckCodeTime(const std::size_t& maxCheckCodeTime) {
+  std::unique_lock<std::shared_mutex> lock(this->_timeCheckerMutex);
+  this->_maxCheckCodeTime = maxCheckCodeTime;
+}
+
+std::size_t V8Runner::getMaxCheckCodeTime() {
+  std::shared_lock<std::shared_mutex> lock(this->_timeCheckerMutex);
+  return this->_maxCheckCodeTime;
+}
+
 void V8Runner::setTimeCheckerSleepTime(const std::size_t& timeCheckerSleepTime) {
   std::unique_lock<std::shared_mutex> lock(this->_timeCheckerMutex);
   this->_timeCheckerSleepTime = timeCheckerSleepTime;
@@ -193,6 +741,25 @@ std::size_t V8Runner::getTimeCheckerSleepTime() {
   return this->_timeCheckerSleepTime;
 }
 
+V8Runner::GCStatistics V8Runner::getGCStatistics() {
+  static const std::array<std::string, GC_KINDS_COUNT> names = {
+    "scavenge",
+    "mark_compact",
+    "incremental",
+    "weak_callbacks"
+  };
+
+  GCStatistics stats;
+  for (std::size_t kind = 0; kind < GC_KINDS_COUNT; kind++) {
+    stats[names[kind]] = (*this->_gcPauses)[kind].snapshot();
+  }
+  return stats;
+}
+
+V8Platform::Statistics V8Runner::getPlatformStatistics() {
+  return this->_platform->getStatistics();
+}
+
 std::size_t V8Runner::isolates_count() {
   std::shared_lock<std::shared_mutex> lock(this->_compileMutex);
   return this->_isolates.size();
@@ -200,29 +767,150 @@ std::size_t V8Runner::isolates_count() {
 
 std::size_t V8Runner::convs_count() {
   std::shared_lock<std::shared_mutex> lock(this->_compileMutex);
+
+  if (this->_isolateMode == THREAD_ISOLATES) {
+    std::set<Conv> convs;
+    for (const auto& kv: this->_replicas) {
+      convs.insert(kv.first.first);
+    }
+    return convs.size();
+  }
+
   return this->_convs.size();
 }
 
+V8Runner::RegistryStatistics V8Runner::getRegistryStatistics() {
+  std::shared_lock<std::shared_mutex> lock(this->_compileMutex);
+
+  RegistryStatistics stats;
+  stats.convs = this->_convs.size();
+  stats.functions = this->_isolateMode == THREAD_ISOLATES
+    ? this->_replicas.size()
+    : this->_functions.size();
+  stats.sources = this->_sources.size();
+  stats.buckets = this->_convs.bucket_count() +
+                  this->_convLoads.bucket_count() +
+                  this->_convNodes.bucket_count() +
+                  this->_functions.bucket_count() +
+                  this->_replicas.bucket_count() +
+                  this->_sources.bucket_count();
+  stats.compactions = this->_compactions;
+  return stats;
+}
+
 std::size_t V8Runner::nodes_count() {
   std::shared_lock<std::shared_mutex> lock(this->_compileMutex);
-  return this->_functions.size();
+  return this->_isolateMode == THREAD_ISOLATES ? this->_replicas.size() : this->_functions.size();
 }
 
-std::tuple<int, std::string> V8Runner::_checkCode(
-  const char* src,
-  const char* data,
-  const std::size_t& threadId
-) {
+V8Runner::ISOLATE_MODE V8Runner::getIsolateMode() const {
+  return this->_isolateMode;
+}
 
-  std::tuple<int, std::string> retValue {
-    STATUS::NO_ERR,
-    "WE JUST COMPILED THIS CODE!"
-  };
+void V8Runner::setConvContexts(const bool& enabled) {
+  this->_convContextsEnabled = enabled;
+}
 
-  auto isolateData = this->makeNewIsolate();
+bool V8Runner::getConvContexts() const {
+  return this->_convContextsEnabled;
+}
 
-  auto isolate = std::get<0>(isolateData);
-  auto iData = std::get<1>(isolateData);
+void V8Runner::setMemoization(const char* conv_id,
+                              const char* node_id,
+                              const bool& enabled,
+                              const std::size_t& ttlMs) {
+  if (enabled) {
+    this->_results.enable(conv_id, node_id, ttlMs);
+  } else {
+    this->_results.disable(conv_id, node_id);
+  }
+}
+
+bool V8Runner::isMemoizationEnabled() const {
+  return this->_results.pairsCount() > 0;
+}
+
+bool V8Runner::getMemoized(const char* conv_id, const char* node_id, const char* data, std::string& result) {
+  // no copies of the input while nothing is memoized
+  if (!this->isMemoizationEnabled()) {
+    return false;
+  }
+  return this->_results.get(conv_id, node_id, data, result);
+}
+
+void V8Runner::setMemoizationBudget(const std::size_t& budgetBytes) {
+  this->_results.setBudget(budgetBytes);
+}
+
+ResultCache::Statistics V8Runner::getMemoizationStatistics() {
+  return this->_results.statistics();
+}
+
+void V8Runner::setKeptVersions(const std::size_t& count) {
+  {
+    std::lock_guard<std::mutex> guard(this->_replicaMutex);
+    std::unique_lock<std::shared_mutex> lock(this->_compileMutex);
+
+    this->_keptVersions = count;
+
+    for (auto& versions: this->_versions) {
+      this->_trimVersions(versions.second, count);
+    }
+  }
+  this->_resetDisplaced();
+}
+
+std::size_t V8Runner::getKeptVersions() {
+  return this->_keptVersions;
+}
+
+int V8Runner::getConvNode(const char* conv_id) {
+  if (!this->_topology) {
+    return -1;
+  }
+
+  std::shared_lock<std::shared_mutex> lock(this->_convPlacementMutex);
+
+  auto it = this->_convPlacement.find(conv_id);
+  return it == this->_convPlacement.end() ? -1 : it->second;
+}
+
+void V8Runner::_placeConv(const Conv& conv, v8::Isolate* isolate) {
+  if (!this->_topology) {
+    return;
+  }
+
+  std::unique_lock<std::shared_mutex> lock(this->_convPlacementMutex);
+
+  if (!isolate) {
+    this->_convPlacement.erase(conv);
+    compact(this->_convPlacement);
+    return;
+  }
+
+  auto node = this->_isolateNodes.find(isolate);
+  this->_convPlacement[conv] = node == this->_isolateNodes.end() ? -1 : node->second;
+}
+
+bool V8Runner::isTopologyAware() const {
+  return this->_topology != nullptr;
+}
+
+std::tuple<int, std::string> V8Runner::_checkCode(
+  const char* src,
+  const char* data,
+  const std::size_t& threadId
+) {
+
+  std::tuple<int, std::string> retValue {
+    STATUS::NO_ERR,
+    "WE JUST COMPILED THIS CODE!"
+  };
+
+  auto isolateData = this->makeNewIsolate();
+
+  auto isolate = std::get<0>(isolateData);
+  auto iData = std::get<1>(isolateData);
 
   std::shared_ptr<v8::Isolate> freeIsolate(
     isolate,
@@ -254,10 +942,21 @@ std::tuple<int, std::string> V8Runner::_checkCode(
       return retValue;
     }
 
+    // the isolate is disposed after this block, unwatch it before
+    IsolateRelatedData::KVScope kvScope(isolate);
+    auto timing = this->_watch(isolate, EXEC_CHECK_CODE);
     v8::Local<v8::Value> result;
-    if (!compiled_script->Run(context).ToLocal(&result)) {
-      std::get<ERR_CODE>(retValue) = STATUS::COMPILE_ERR;
-      std::get<DATA>(retValue) = V8Runner::_makeTryCatchError(try_catch);
+    const bool evaluated = compiled_script->Run(context).ToLocal(&result);
+    this->_unwatch(timing);
+
+    if (!evaluated) {
+      if (try_catch.HasTerminated()) {
+        std::get<ERR_CODE>(retValue) = STATUS::SCRIPT_TERMINATED_ERR;
+        std::get<DATA>(retValue) = "Script has been terminated.";
+      } else {
+        std::get<ERR_CODE>(retValue) = STATUS::COMPILE_ERR;
+        std::get<DATA>(retValue) = V8Runner::_makeTryCatchError(try_catch);
+      }
       return retValue;
     }
   }
@@ -284,18 +983,40 @@ std::tuple<v8::Isolate*, std::shared_ptr<V8Runner::IsolateRelatedData>>
   global->Set(v8::String::NewFromUtf8(isolate, "require"),
               v8::FunctionTemplate::New(isolate, V8Runner::_Require));
 
+  auto kv = v8::ObjectTemplate::New(isolate);
+  auto kvData = v8::External::New(isolate, &this->_kv);
+  kv->Set(v8::String::NewFromUtf8(isolate, "get"),
+          v8::FunctionTemplate::New(isolate, V8Runner::_KVGet, kvData));
+  kv->Set(v8::String::NewFromUtf8(isolate, "version"),
+          v8::FunctionTemplate::New(isolate, V8Runner::_KVVersion, kvData));
+  global->Set(v8::String::NewFromUtf8(isolate, "kv"), kv);
+
+  NativeCrypto::install(isolate, global);
+
+  auto dateCache = std::make_shared<NativeDate::Cache>();
+  NativeDate::install(isolate, global, dateCache.get());
+
   PersistentContext pContext(isolate, v8::Context::New(isolate, nullptr, global));
 
-  return std::make_tuple(
-    isolate,
-    std::make_shared<IsolateRelatedData>(pGlobalTemplate, pContext)
-  );
+  auto isolateData =
+    std::make_shared<IsolateRelatedData>(pGlobalTemplate, pContext, this->_gcPauses, dateCache);
+
+  v8::Local<v8::Context>::New(isolate, pContext)->SetAlignedPointerInEmbedderData(
+    V8Runner::CONTEXT_DATASETS_SLOT, &isolateData->datasets());
+
+  // isolateData outlives the isolate: it is cleaned before Dispose
+  isolate->SetData(V8Runner::ISOLATE_DATA_SLOT, isolateData.get());
+  isolate->AddGCPrologueCallback(V8Runner::_GCPrologue);
+  isolate->AddGCEpilogueCallback(V8Runner::_GCEpilogue);
+
+  return std::make_tuple(isolate, isolateData);
 
 }
 
 v8::Isolate* V8Runner::getIsolate() {
   static std::size_t nextIsolate = 0;
-  if (nextIsolate == this->_isolates.size()) {
+  // isolates may have been retired since the last call
+  if (nextIsolate >= this->_isolates.size()) {
     nextIsolate = 0;
   }
   return this->_isolates[nextIsolate++];
@@ -305,263 +1026,1882 @@ v8::Isolate* V8Runner::getIsolate() {
 std::tuple<int, std::string> V8Runner::_compile(
   const char* conv_id,
   const char* node_id,
-  const char* src) {
+  const char* src,
+  const std::size_t& threadId,
+  WarmUp* warmUp) {
+
+  if (this->_isolateMode == THREAD_ISOLATES) {
+    return this->_compileReplicated(conv_id, node_id, src, threadId, warmUp);
+  }
+
+  const Conv conv = std::string(conv_id);
+  const Node node = std::string(node_id);
+  const auto key = std::make_pair(conv, node);
+
+  // with warm-up the new function is published only after warm-up,
+  // the old one keeps serving runs meanwhile
+  const bool withWarmUp = warmUp && warmUp->runs > 0;
+  std::string sample;
+  if (withWarmUp) {
+    sample = warmUp->sample;
+    if (sample.empty()) {
+      std::lock_guard<std::mutex> inputsGuard(this->_recentInputsMutex);
+      auto it = this->_recentInputs.find(key);
+      if (it != this->_recentInputs.end()) {
+        sample = it->second;
+      }
+    }
+  }
+
+  // isolates of the conv are not retired till it is published
+  std::shared_lock<std::shared_mutex> retireLock(this->_retireMutex);
+
+  while (true) {
+    v8::Isolate* isolate = nullptr;
+    std::shared_ptr<IsolateRelatedData> isolateData;
+    std::vector<BuildTarget> targets;
+    uint64_t layoutVersion = 0;
+    bool hadLive = false;
+    {
+      std::lock_guard<std::mutex> guard(this->_replicaMutex);
+      this->_bindConv(conv, isolate, isolateData);
+      targets = this->_buildTargets(conv, isolate, isolateData);
+      layoutVersion = this->_layoutVersion;
+      hadLive = this->_sources.count(key) > 0;
+    }
+
+    // the new version is built without _replicaMutex and _compileMutex,
+    // under isolate lockers only: other compiles and all runs go on and
+    // a hung script is terminated by the time checker.
+    // The conv isolate first, then its hot replicas
+    std::vector<std::pair<v8::Isolate*, PersistentFunction>> functions;
+    functions.reserve(targets.size());
+
+    std::string codeCache;
+    std::tuple<int, std::string> retValue;
+
+    for (std::size_t i = 0; i < targets.size(); i++) {
+      auto target = targets[i].isolate;
+
+      v8::Locker locker(target);
+      v8::Isolate::Scope isolate_scope(target);
+      v8::HandleScope scope(target);
+
+      auto context = v8::Local<v8::Context>::New(target, targets[i].context);
+      v8::Context::Scope context_scope(context);
+
+      PersistentFunction function;
+      auto res = this->_compileFunction(target, context, src, function,
+                                        i == 0 && this->_journal ? &codeCache : nullptr);
+      if (std::get<ERR_CODE>(res) != STATUS::NO_ERR) {
+        if (i == 0) {
+          retValue = res;
+          break;
+        }
+        // runs of the pair stay in the primary isolate then
+        std::cerr << "[ERROR] [hotConvs] "
+                  << "Can not replicate (" << key.first << ", " << key.second << "): "
+                  << std::get<DATA>(res)
+                  << std::endl;
+        continue;
+      }
+
+      functions.emplace_back(target, std::move(function));
+    }
+
+    if (std::get<ERR_CODE>(retValue) != STATUS::NO_ERR) {
+      this->_resetBuild(targets, functions);
+
+      // the live version (if any) keeps serving runs,
+      // a new conv does not keep its isolate
+      std::lock_guard<std::mutex> guard(this->_replicaMutex);
+      std::unique_lock<std::shared_mutex> lock(this->_compileMutex);
+      if (this->_convs.count(conv) && this->_convs.at(conv) == isolate) {
+        this->_releaseConv(conv);
+      }
+      return retValue;
+    }
+
+    if (withWarmUp && !sample.empty()) {
+      this->_warmUp(isolate, isolateData, functions.front().second, sample, threadId, warmUp);
+    }
+
+    bool rebuild = false;
+    {
+      std::lock_guard<std::mutex> guard(this->_replicaMutex);
+
+      if (hadLive && !this->_sources.count(key)) {
+        // a remove which came after the compile wins
+        retValue = std::make_tuple(STATUS::NOT_FOUND_PAIR_ERR,
+                                   "Pair (" + conv + ", " + node + ") was removed during compile.");
+      } else if (layoutVersion != this->_layoutVersion) {
+        // the conv moved, lost its context or changed its replicas: build again
+        rebuild = true;
+      } else {
+        // now publish it. In-flight runs hold the shared lock,
+        // so they finish on the old version
+        std::unique_lock<std::shared_mutex> lock(this->_compileMutex);
+        this->_publishVersion(key, src, functions, codeCache);
+      }
+    }
+
+    // what was not published is reset without the locks above
+    this->_resetBuild(targets, functions);
+
+    if (rebuild) {
+      if (withWarmUp) {
+        warmUp->doneRuns = 0;
+      }
+      continue;
+    }
+    return retValue;
+  }
+}
+
+std::vector<V8Runner::BuildTarget> V8Runner::_buildTargets(
+  const Conv& conv,
+  v8::Isolate* isolate,
+  const std::shared_ptr<IsolateRelatedData>& isolateData) {
+
+  std::vector<BuildTarget> targets;
+  targets.push_back(BuildTarget{isolate, isolateData, PersistentContext()});
+
+  auto load = this->_convLoads.find(conv);
+  if (load != this->_convLoads.end()) {
+    // new isolates may be added to the map meanwhile
+    std::shared_lock<std::shared_mutex> lock(this->_compileMutex);
+    for (auto replica: load->second->replicas) {
+      targets.push_back(BuildTarget{replica, this->_isolatesData.at(replica), PersistentContext()});
+    }
+  }
+
+  for (auto& target: targets) {
+    v8::Locker locker(target.isolate);
+    v8::Isolate::Scope isolate_scope(target.isolate);
+    v8::HandleScope scope(target.isolate);
+
+    target.context.Reset(target.isolate, this->_convContext(conv, target.isolate, target.isolateData));
+  }
+
+  return targets;
+}
+
+void V8Runner::_resetBuild(std::vector<BuildTarget>& targets,
+                           std::vector<std::pair<v8::Isolate*, PersistentFunction>>& functions) {
+  for (auto& function: functions) {
+    // published ones are moved out
+    if (function.second.IsEmpty()) {
+      continue;
+    }
+    v8::Locker locker(function.first);
+    function.second.Reset();
+  }
+  for (auto& target: targets) {
+    v8::Locker locker(target.isolate);
+    target.context.Reset();
+  }
+}
+
+std::tuple<int, std::string> V8Runner::_compileBulk(
+  const char* conv_id,
+  std::vector<BulkNode>& nodes,
+  const bool& skipUnchanged) {
+
+  const Conv conv = std::string(conv_id);
+  const bool replicated = this->_isolateMode == THREAD_ISOLATES;
+
+  // isolates of the conv are not retired till it is published
+  std::shared_lock<std::shared_mutex> retireLock(this->_retireMutex);
+
+  while (true) {
+    // indexes of nodes to compile and whether they had a live version
+    std::vector<std::size_t> pending;
+    std::vector<bool> hadLive;
+    v8::Isolate* isolate = nullptr;
+    std::vector<BuildTarget> targets;
+    uint64_t layoutVersion = 0;
+    {
+      std::lock_guard<std::mutex> guard(this->_replicaMutex);
+
+      // sources change under _replicaMutex only
+      for (std::size_t i = 0; i < nodes.size(); i++) {
+        auto& node = nodes[i];
+        node.code = STATUS::NO_ERR;
+        node.data.clear();
+
+        auto source = this->_sources.find(std::make_pair(conv, node.node));
+        node.skipped = skipUnchanged && source != this->_sources.end() && source->second == node.src;
+        if (!node.skipped) {
+          pending.push_back(i);
+          hadLive.push_back(source != this->_sources.end());
+        }
+      }
+
+      if (pending.empty()) {
+        return std::make_tuple(STATUS::NO_ERR, std::string());
+      }
+
+      // isolates to compile in: the conv isolate and its hot replicas
+      // in conv mode, every isolate in thread mode
+      if (replicated) {
+        std::shared_lock<std::shared_mutex> lock(this->_compileMutex);
+        for (auto target: this->_isolates) {
+          targets.push_back(BuildTarget{target, this->_isolatesData.at(target), PersistentContext()});
+        }
+      } else {
+        std::shared_ptr<IsolateRelatedData> isolateData;
+        this->_bindConv(conv, isolate, isolateData);
+        targets = this->_buildTargets(conv, isolate, isolateData);
+      }
+      layoutVersion = this->_layoutVersion;
+    }
+
+    // built as in _compile, without _replicaMutex and _compileMutex.
+    // functions[pending node]: the isolates it was compiled in, in target order
+    std::vector<std::vector<std::pair<v8::Isolate*, PersistentFunction>>> functions(pending.size());
+    for (auto& nodeFunctions: functions) {
+      nodeFunctions.reserve(targets.size());
+    }
+    std::vector<std::string> codeCaches(pending.size());
+
+    std::size_t failedCount = 0;
+    std::tuple<int, std::string> failed = { STATUS::NO_ERR, "" };
+
+    for (std::size_t t = 0; t < targets.size() && failedCount == 0; t++) {
+      auto target = targets[t].isolate;
+
+      // one lock entry for all nodes, top-level code is still watched per node
+      v8::Locker locker(target);
+      v8::Isolate::Scope isolate_scope(target);
+      v8::HandleScope scope(target);
+
+      auto context = replicated ?
+        v8::Local<v8::Context>::New(target, targets[t].isolateData->getPContext()) :
+        v8::Local<v8::Context>::New(target, targets[t].context);
+
+      v8::Context::Scope context_scope(context);
+
+      for (std::size_t i = 0; i < pending.size(); i++) {
+        auto& node = nodes[pending[i]];
+
+        // nodes of the conv are independent: keep going to report all of them
+        PersistentFunction function;
+        auto res = this->_compileFunction(target, context, node.src.c_str(), function,
+                                          t == 0 && this->_journal ? &codeCaches[i] : nullptr);
+
+        if (std::get<ERR_CODE>(res) == STATUS::NO_ERR) {
+          functions[i].emplace_back(target, std::move(function));
+          continue;
+        }
+
+        // every isolate serves the pair in thread mode: a slot left
+        // empty would fail its runs, see _compileReplicated
+        if (t == 0 || replicated) {
+          node.code = std::get<ERR_CODE>(res);
+          node.data = std::get<DATA>(res);
+          if (failedCount++ == 0) {
+            failed = res;
+          }
+          continue;
+        }
+
+        // runs of the pair stay with the other isolates then
+        std::cerr << "[ERROR] [compileBulk] "
+                  << "Can not replicate (" << conv << ", " << node.node << "): "
+                  << std::get<DATA>(res)
+                  << std::endl;
+      }
+    }
+
+    // what was not published is reset without the global locks
+    auto resetBuild = [this, &targets, &functions]() {
+      std::vector<std::pair<v8::Isolate*, PersistentFunction>> built;
+      for (auto& nodeFunctions: functions) {
+        for (auto& function: nodeFunctions) {
+          built.push_back(std::move(function));
+        }
+      }
+      this->_resetBuild(targets, built);
+    };
+
+    bool rebuild = false;
+    if (failedCount == 0) {
+      std::lock_guard<std::mutex> guard(this->_replicaMutex);
+
+      // a remove which came after the compile wins
+      for (std::size_t i = 0; i < pending.size(); i++) {
+        auto& node = nodes[pending[i]];
+        if (hadLive[i] && !this->_sources.count(std::make_pair(conv, node.node))) {
+          node.code = STATUS::NOT_FOUND_PAIR_ERR;
+          node.data = "Pair (" + conv + ", " + node.node + ") was removed during compile.";
+          if (failedCount++ == 0) {
+            failed = std::make_tuple(node.code, node.data);
+          }
+        }
+      }
+
+      if (failedCount > 0) {
+        // the rest is not published either
+      } else if (layoutVersion != this->_layoutVersion) {
+        // the conv moved, lost its context or the isolates changed: build again
+        rebuild = true;
+      } else {
+        // runs wait here for a moment and then see the whole new version
+        std::unique_lock<std::shared_mutex> lock(this->_compileMutex);
+
+        for (std::size_t i = 0; i < pending.size(); i++) {
+          const auto& node = nodes[pending[i]];
+          this->_publishVersion(std::make_pair(conv, node.node), node.src, functions[i], codeCaches[i]);
+        }
+      }
+    } else if (!replicated) {
+      // the old deployment stays as it was, a new conv does not keep its isolate
+      std::lock_guard<std::mutex> guard(this->_replicaMutex);
+      std::unique_lock<std::shared_mutex> lock(this->_compileMutex);
+      if (this->_convs.count(conv) && this->_convs.at(conv) == isolate) {
+        this->_releaseConv(conv);
+      }
+    }
+
+    resetBuild();
+
+    if (rebuild) {
+      continue;
+    }
+
+    if (failedCount > 0) {
+      std::get<DATA>(failed) = std::to_string(failedCount) + " of " + std::to_string(pending.size()) +
+                               " nodes failed, " + std::get<DATA>(failed);
+      return failed;
+    }
+    return std::make_tuple(STATUS::NO_ERR, std::string());
+  }
+}
+
+void V8Runner::_bindConv(const Conv& conv,
+                         v8::Isolate*& isolate,
+                         std::shared_ptr<IsolateRelatedData>& isolateData) {
+  std::unique_lock<std::shared_mutex> lock(this->_compileMutex);
+
+  // compile the same conv withing the same isolate
+  // if this conv does not have isolate, use next isolate
+  auto isolateItr = this->_convs.find(conv);
+  if (isolateItr == this->_convs.end()) {
+    isolate = this->getIsolate();
+    this->_convs[conv] = isolate;
+    this->_placeConv(conv, isolate);
+    this->_convLoads[conv] = std::make_unique<ConvLoad>();
+    if (this->_convContextsEnabled) {
+      this->_convContexts[conv];
+    }
+  } else {
+    isolate = isolateItr->second;
+  }
+
+  isolateData = this->_isolatesData.at(isolate);
+}
+
+void V8Runner::_publishVersion(
+  const ConvNodePair& key,
+  const std::string& src,
+  std::vector<std::pair<v8::Isolate*, PersistentFunction>>& functions,
+  const std::string& codeCache,
+  const bool& keepLive) {
+
+  const bool replicated = this->_isolateMode == THREAD_ISOLATES;
+
+  auto& versions = this->_versions[key];
+
+  // the live version goes to the history with its source
+  auto source = this->_sources.find(key);
+  const bool keep = keepLive && source != this->_sources.end() && this->_keptVersions > 0;
+
+  FunctionVersion live;
+  if (keep) {
+    live.version = versions.current;
+    live.src = source->second;
+    live.functions.reserve(replicated ? this->_isolates.size() : 1);
+  }
+
+  // handles are only moved here: no isolate is locked under the unique
+  // _compileMutex, a compile may run top-level code in it meanwhile.
+  // Slots are emptied first, a move into a non-empty one resets it
+  if (replicated) {
+    auto& replicas = this->_replicas[key];
+    replicas.resize(this->_isolates.size());
+
+    for (std::size_t i = 0; i < replicas.size(); i++) {
+      if (keep && !replicas[i].IsEmpty()) {
+        live.functions.emplace_back(this->_isolates[i], std::move(replicas[i]));
+      }
+      this->_displace(this->_isolates[i], replicas[i]);
+    }
+  } else {
+    auto it = this->_functions.find(key);
+    if (it != this->_functions.end()) {
+      auto isolate = this->_convs.at(key.first);
+      if (keep && !it->second.IsEmpty()) {
+        live.functions.emplace_back(isolate, std::move(it->second));
+      }
+      this->_displace(isolate, it->second);
+    }
+
+    // replicas are compiled again on rollback
+    auto hot = this->_hotFunctions.find(key);
+    if (hot != this->_hotFunctions.end()) {
+      for (auto& replica: hot->second) {
+        this->_displace(replica.first, replica.second);
+      }
+      this->_hotFunctions.erase(hot);
+    }
+  }
+
+  for (auto& function: functions) {
+    if (replicated) {
+      const std::size_t index =
+        std::find(this->_isolates.begin(), this->_isolates.end(), function.first) - this->_isolates.begin();
+      this->_replicas[key][index] = std::move(function.second);
+    } else if (function.first == this->_convs.at(key.first)) {
+      this->_functions[key] = std::move(function.second);
+    } else {
+      this->_hotFunctions[key][function.first] = std::move(function.second);
+    }
+  }
+
+  if (keep) {
+    versions.previous.push_back(std::move(live));
+    this->_trimVersions(versions, this->_keptVersions);
+  }
+  versions.current = ++versions.last;
+
+  this->_sources[key] = src;
+  this->_convNodes[key.first].insert(key.second);
+
+  // results of the old version
+  this->_results.invalidate(key.first, key.second);
+
+  // under _replicaMutex, so the journal keeps the order of compiles.
+  // The record is only queued, the journal writes it on its own thread
+  if (this->_journal) {
+    this->_journal->appendCompile(key.first, key.second, src, codeCache);
+  }
+}
+
+std::tuple<int, std::string> V8Runner::_rollback(const char* conv_id, const char* node_id) {
+
+  const Conv conv = std::string(conv_id);
+  const auto key = std::make_pair(conv, Node(node_id));
+  const bool replicated = this->_isolateMode == THREAD_ISOLATES;
+
+  // isolates are not retired till the version is published
+  std::shared_lock<std::shared_mutex> retireLock(this->_retireMutex);
+
+  while (true) {
+    // isolates which serve the pair now, the conv isolate (or the first one) first
+    std::vector<BuildTarget> targets;
+    uint64_t layoutVersion = 0;
+    uint64_t restored = 0;
+    std::string src;
+    // by target: the kept copy is published as it is, others are compiled
+    std::vector<bool> hasKept;
+    {
+      std::lock_guard<std::mutex> guard(this->_replicaMutex);
+
+      // versions change under _replicaMutex only
+      auto versions = this->_versions.find(key);
+      if (versions == this->_versions.end() || versions->second.previous.empty()) {
+        return std::make_tuple(STATUS::NOT_FOUND_PAIR_ERR, std::string("No previous version of the pair."));
+      }
+
+      if (replicated) {
+        std::shared_lock<std::shared_mutex> lock(this->_compileMutex);
+        for (auto isolate: this->_isolates) {
+          targets.push_back(BuildTarget{isolate, this->_isolatesData.at(isolate), PersistentContext()});
+        }
+      } else {
+        v8::Isolate* isolate = nullptr;
+        std::shared_ptr<IsolateRelatedData> isolateData;
+        this->_bindConv(conv, isolate, isolateData);
+        targets = this->_buildTargets(conv, isolate, isolateData);
+      }
+      layoutVersion = this->_layoutVersion;
+
+      const auto& version = versions->second.previous.back();
+      restored = version.version;
+      src = version.src;
+
+      for (const auto& target: targets) {
+        hasKept.push_back(std::any_of(version.functions.begin(), version.functions.end(),
+          [&target](const std::pair<v8::Isolate*, PersistentFunction>& function) {
+            return function.first == target.isolate && !function.second.IsEmpty();
+          }));
+      }
+    }
+
+    // isolates which got the pair after this version was replaced compile
+    // it again, without _replicaMutex and _compileMutex as in _compile
+    std::vector<std::pair<v8::Isolate*, PersistentFunction>> compiled(targets.size());
+    std::vector<bool> skipped(targets.size(), false);
+    std::tuple<int, std::string> retValue;
+
+    for (std::size_t t = 0; t < targets.size(); t++) {
+      auto isolate = targets[t].isolate;
+      compiled[t].first = isolate;
+      if (hasKept[t]) {
+        continue;
+      }
+
+      v8::Locker locker(isolate);
+      v8::Isolate::Scope isolate_scope(isolate);
+      v8::HandleScope scope(isolate);
+
+      auto context = replicated ?
+        v8::Local<v8::Context>::New(isolate, targets[t].isolateData->getPContext()) :
+        v8::Local<v8::Context>::New(isolate, targets[t].context);
+
+      v8::Context::Scope context_scope(context);
+
+      auto res = this->_compileFunction(isolate, context, src.c_str(), compiled[t].second);
+      if (std::get<ERR_CODE>(res) == STATUS::NO_ERR) {
+        continue;
+      }
+
+      // every isolate serves the pair in thread mode: the rollback fails
+      // and the version stays for another try. A hot replica is skipped
+      if (t == 0 || replicated) {
+        retValue = res;
+        break;
+      }
+      skipped[t] = true;
+      std::cerr << "[ERROR] [rollback] "
+                << "Can not replicate (" << key.first << ", " << key.second << "): "
+                << std::get<DATA>(res)
+                << std::endl;
+    }
+
+    bool rebuild = false;
+    if (std::get<ERR_CODE>(retValue) == STATUS::NO_ERR) {
+      std::lock_guard<std::mutex> guard(this->_replicaMutex);
+
+      auto versions = this->_versions.find(key);
+      if (versions == this->_versions.end() || versions->second.previous.empty()) {
+        // removed or trimmed meanwhile
+        retValue = std::make_tuple(STATUS::NOT_FOUND_PAIR_ERR, std::string("No previous version of the pair."));
+      } else if (layoutVersion != this->_layoutVersion || versions->second.previous.back().version != restored) {
+        // the conv moved or changed its replicas, or another rollback came first
+        rebuild = true;
+      } else {
+        auto& version = versions->second.previous.back();
+
+        std::vector<std::pair<v8::Isolate*, PersistentFunction>> functions;
+        functions.reserve(targets.size());
+
+        for (std::size_t t = 0; t < targets.size(); t++) {
+          if (skipped[t]) {
+            continue;
+          }
+          if (!hasKept[t]) {
+            functions.push_back(std::move(compiled[t]));
+            continue;
+          }
+          auto isolate = targets[t].isolate;
+          for (auto& function: version.functions) {
+            if (function.first == isolate && !function.second.IsEmpty()) {
+              functions.emplace_back(isolate, std::move(function.second));
+              break;
+            }
+          }
+        }
+
+        // copies in isolates which do not serve the pair anymore
+        for (auto& function: version.functions) {
+          this->_displace(function.first, function.second);
+        }
+        versions->second.previous.pop_back();
+
+        // the live version is dropped, not kept: rollbacks go back step by step
+        std::unique_lock<std::shared_mutex> lock(this->_compileMutex);
+
+        this->_publishVersion(key, src, functions, std::string(), false);
+        this->_versions.at(key).current = restored;
+
+        retValue = std::make_tuple(STATUS::NO_ERR, std::to_string(restored));
+      }
+    }
+
+    // what was not published is reset without the locks above
+    this->_resetBuild(targets, compiled);
+
+    if (rebuild) {
+      continue;
+    }
+    return retValue;
+  }
+}
+
+void V8Runner::_trimVersions(PairVersions& versions, const std::size_t& kept) {
+  while (versions.previous.size() > kept) {
+    for (auto& function: versions.previous.front().functions) {
+      this->_displace(function.first, function.second);
+    }
+    versions.previous.pop_front();
+  }
+}
+
+void V8Runner::_displace(v8::Isolate* isolate, PersistentFunction& function) {
+  // the copy in a retired isolate is gone already
+  if (function.IsEmpty()) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(this->_displacedMutex);
+  this->_displacedFunctions.emplace_back(isolate, std::move(function));
+}
+
+void V8Runner::_displace(v8::Isolate* isolate, std::unique_ptr<ConvContext>& context) {
+  if (!context) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(this->_displacedMutex);
+  this->_displacedContexts.emplace_back(isolate, std::move(context));
+}
+
+void V8Runner::_resetDisplaced(v8::Isolate* isolate) {
+  std::vector<std::pair<v8::Isolate*, PersistentFunction>> functions;
+  std::vector<std::pair<v8::Isolate*, std::unique_ptr<ConvContext>>> contexts;
+  {
+    std::lock_guard<std::mutex> guard(this->_displacedMutex);
+    auto take = [isolate](auto& from, auto& to) {
+      for (auto it = from.begin(); it != from.end(); ) {
+        if (isolate && it->first != isolate) {
+          ++it;
+          continue;
+        }
+        to.push_back(std::move(*it));
+        it = from.erase(it);
+      }
+    };
+    take(this->_displacedFunctions, functions);
+    take(this->_displacedContexts, contexts);
+  }
+
+  for (auto& function: functions) {
+    v8::Locker locker(function.first);
+    function.second.Reset();
+  }
+  for (auto& context: contexts) {
+    v8::Locker locker(context.first);
+    context.second.reset();
+  }
+}
+
+std::tuple<int, std::string> V8Runner::_compileReplicated(
+  const char* conv_id,
+  const char* node_id,
+  const char* src,
+  const std::size_t& threadId,
+  WarmUp* warmUp) {
+
+  const auto key = std::make_pair(Conv(conv_id), Node(node_id));
+
+  const bool withWarmUp = warmUp && warmUp->runs > 0;
+  std::string sample;
+  if (withWarmUp) {
+    sample = warmUp->sample;
+    if (sample.empty()) {
+      std::lock_guard<std::mutex> inputsGuard(this->_recentInputsMutex);
+      auto it = this->_recentInputs.find(key);
+      if (it != this->_recentInputs.end()) {
+        sample = it->second;
+      }
+    }
+  }
+
+  // isolates are not retired till the version is published
+  std::shared_lock<std::shared_mutex> retireLock(this->_retireMutex);
+
+  while (true) {
+    std::vector<BuildTarget> targets;
+    uint64_t layoutVersion = 0;
+    bool hadLive = false;
+    {
+      std::lock_guard<std::mutex> guard(this->_replicaMutex);
+      std::shared_lock<std::shared_mutex> lock(this->_compileMutex);
+      // the shared context of every isolate
+      for (auto isolate: this->_isolates) {
+        targets.push_back(BuildTarget{isolate, this->_isolatesData.at(isolate), PersistentContext()});
+      }
+      layoutVersion = this->_layoutVersion;
+      hadLive = this->_sources.count(key) > 0;
+    }
+
+    std::string codeCache;
+
+    // the new version is built aside, without _replicaMutex: runs keep using
+    // the live one and other broadcasts go on meanwhile
+    std::vector<std::pair<v8::Isolate*, PersistentFunction>> functions;
+    functions.reserve(targets.size());
+
+    std::tuple<int, std::string> failed = { STATUS::NO_ERR, "" };
+
+    for (std::size_t i = 0; i < targets.size(); i++) {
+      auto isolate = targets[i].isolate;
+      auto isolateData = targets[i].isolateData;
+
+      v8::Locker locker(isolate);
+      v8::Isolate::Scope isolate_scope(isolate);
+      v8::HandleScope scope(isolate);
+
+      auto context = v8::Local<v8::Context>::New(isolate, isolateData->getPContext());
+      v8::Context::Scope context_scope(context);
+
+      PersistentFunction function;
+      auto res = this->_compileFunction(isolate, context, src, function,
+                                        i == 0 && this->_journal ? &codeCache : nullptr);
+
+      // all isolates get the version or none does: a slot left
+      // with the old function (or none) would serve another version
+      if (std::get<ERR_CODE>(res) != STATUS::NO_ERR) {
+        failed = res;
+        break;
+      }
+
+      if (withWarmUp && !sample.empty()) {
+        WarmUp replicaWarmUp = *warmUp;
+        this->_warmUp(isolate, isolateData, function, sample, threadId, &replicaWarmUp);
+        warmUp->doneRuns += replicaWarmUp.doneRuns;
+        warmUp->timeUs += replicaWarmUp.timeUs;
+      }
+
+      functions.emplace_back(isolate, std::move(function));
+    }
+
+    // the live version (if any) keeps serving runs
+    if (std::get<ERR_CODE>(failed) != STATUS::NO_ERR) {
+      this->_resetBuild(targets, functions);
+      return failed;
+    }
+
+    bool rebuild = false;
+    {
+      std::lock_guard<std::mutex> guard(this->_replicaMutex);
+
+      if (hadLive && !this->_sources.count(key)) {
+        // a remove which came after the compile wins
+        failed = std::make_tuple(STATUS::NOT_FOUND_PAIR_ERR,
+                                 "Pair (" + key.first + ", " + key.second + ") was removed during compile.");
+      } else if (layoutVersion != this->_layoutVersion) {
+        // an isolate was added meanwhile, it needs the version too: build again
+        rebuild = true;
+      } else {
+        // all isolates switch at once, in-flight runs finish on the old version
+        std::unique_lock<std::shared_mutex> lock(this->_compileMutex);
+        this->_publishVersion(key, src, functions, codeCache);
+      }
+    }
+
+    // what was not published is reset without the locks above
+    this->_resetBuild(targets, functions);
+
+    if (rebuild) {
+      if (withWarmUp) {
+        warmUp->doneRuns = 0;
+        warmUp->timeUs = 0;
+      }
+      continue;
+    }
+    return failed;
+  }
+}
+
+std::tuple<int, std::string> V8Runner::_removeReplicated(const char* conv, const char* node) {
+
+  std::lock_guard<std::mutex> guard(this->_replicaMutex);
+  std::unique_lock<std::shared_mutex> lock(this->_compileMutex);
+
+  this->_erasePair(std::make_pair(Conv(conv), Node(node)));
+  this->_releaseConv(conv);
+
+  return std::make_tuple(STATUS::NO_ERR, std::string());
+}
+
+
+void V8Runner::_warmUp(
+  v8::Isolate* isolate,
+  const std::shared_ptr<IsolateRelatedData>& isolateData,
+  const PersistentFunction& pFunc,
+  const std::string& sample,
+  const std::size_t& threadId,
+  WarmUp* warmUp) {
+
+  using namespace std::chrono;
+
+  const auto started = steady_clock::now();
+
+  v8::Locker locker(isolate);
+  v8::Isolate::Scope isolate_scope(isolate);
+  v8::HandleScope scope(isolate);
+
+  auto func = v8::Local<v8::Function>::New(isolate, pFunc);
+  auto context = func->CreationContext();
+
+  v8::Context::Scope context_scope(context);
+
+  auto input = v8::String::NewFromUtf8(isolate, sample.c_str());
+
+  for (std::size_t i = 0; i < warmUp->runs; i++) {
+    v8::HandleScope iteration_scope(isolate);
+    v8::TryCatch try_catch(isolate);
+    IsolateRelatedData::KVScope kvScope(isolate);
+
+    // parse every time, the function may modify its input
+    v8::Local<v8::Value> data;
+    if (!v8::JSON::Parse(isolate, input).ToLocal(&data)) {
+      break;
+    }
+
+    v8::Local<v8::Value> args[] = { data };
+
+    // watched by the time checker as a regular run
+    auto timing = std::make_shared<V8Runner::ScriptWorkTime>(
+      true,
+      isolate,
+      duration_cast<milliseconds>(system_clock::now().time_since_epoch())
+    );
+    this->_timeCheckerMutex.lock_shared();
+      this->_timing[threadId] = timing;
+    this->_timeCheckerMutex.unlock_shared();
+
+    func->Call(context->Global(), 1, args);
+
+    timing->isWorking = false;
+
+    // the result is dropped, a failing sample stops the warm-up
+    if (try_catch.HasCaught()) {
+      break;
+    }
+
+    warmUp->doneRuns += 1;
+  }
+
+  warmUp->timeUs = duration_cast<microseconds>(steady_clock::now() - started).count();
+}
+
+
+void V8Runner::_sampleInput(const ConvNodePair& pair, const char* data) {
+  thread_local std::size_t runsCount = 0;
+
+  if (++runsCount % V8Runner::INPUT_SAMPLE_RATE != 0) {
+    return;
+  }
+
+  const std::size_t size = strlen(data);
+  if (size > V8Runner::INPUT_SAMPLE_MAX_SIZE) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> guard(this->_recentInputsMutex);
+  this->_recentInputs[pair].assign(data, size);
+}
+
+
+std::tuple<int, std::string> V8Runner::_remove(
+  const char* conv,
+  const char* node) {
+
+  if (this->_isolateMode == THREAD_ISOLATES) {
+    return this->_removeReplicated(conv, node);
+  }
+
+  std::lock_guard<std::mutex> guard(this->_replicaMutex);
+  std::unique_lock<std::shared_mutex> lock(this->_compileMutex);
+
+  if (this->_convs.count(conv)) {
+    this->_erasePair(std::make_pair(Conv(conv), Node(node)));
+    this->_releaseConv(conv);
+  }
+
+  return std::make_tuple(STATUS::NO_ERR, std::string());
+}
+
+bool V8Runner::_erasePair(const ConvNodePair& key) {
+  if (this->_isolateMode == THREAD_ISOLATES) {
+    auto it = this->_replicas.find(key);
+    if (it != this->_replicas.end()) {
+      for (std::size_t i = 0; i < it->second.size(); i++) {
+        this->_displace(this->_isolates[i], it->second[i]);
+      }
+      this->_replicas.erase(it);
+    }
+  } else {
+    auto it = this->_functions.find(key);
+    if (it != this->_functions.end()) {
+      this->_displace(this->_convs.at(key.first), it->second);
+      this->_functions.erase(it);
+    }
+
+    // and its replicas
+    auto hot = this->_hotFunctions.find(key);
+    if (hot != this->_hotFunctions.end()) {
+      for (auto& replica: hot->second) {
+        this->_displace(replica.first, replica.second);
+      }
+      this->_hotFunctions.erase(hot);
+    }
+  }
+
+  // and the versions kept for rollback
+  auto versions = this->_versions.find(key);
+  if (versions != this->_versions.end()) {
+    this->_trimVersions(versions->second, 0);
+    this->_versions.erase(versions);
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(this->_recentInputsMutex);
+    this->_recentInputs.erase(key);
+  }
+
+  this->_results.disable(key.first, key.second);
+
+  auto nodes = this->_convNodes.find(key.first);
+  if (nodes != this->_convNodes.end()) {
+    nodes->second.erase(key.second);
+  }
+
+  const bool erased = this->_sources.erase(key) > 0;
+
+  if (erased && this->_journal) {
+    this->_journal->appendRemove(key.first, key.second);
+  }
+
+  return erased;
+}
+
+void V8Runner::_releaseConv(const Conv& conv) {
+  auto nodes = this->_convNodes.find(conv);
+  if (nodes != this->_convNodes.end()) {
+    if (!nodes->second.empty()) {
+      return;
+    }
+    this->_convNodes.erase(nodes);
+  }
+
+  this->_layoutVersion += 1;
+
+  // whatever the functions left in their context goes away with it
+  this->_dropConvContexts(conv);
+
+  this->_convLoads.erase(conv);
+  this->_convs.erase(conv);
+  this->_placeConv(conv, nullptr);
+
+  this->_compactRegistry();
+}
+
+void V8Runner::_compactRegistry() {
+  std::size_t compacted = 0;
+
+  compacted += compact(this->_convs);
+  compacted += compact(this->_convLoads);
+  compacted += compact(this->_convNodes);
+  compacted += compact(this->_convContexts);
+  compacted += compact(this->_functions);
+  compacted += compact(this->_hotFunctions);
+  compacted += compact(this->_replicas);
+  compacted += compact(this->_versions);
+  compacted += compact(this->_sources);
+
+  {
+    std::lock_guard<std::mutex> guard(this->_recentInputsMutex);
+    compacted += compact(this->_recentInputs);
+  }
+
+  this->_compactions += compacted;
+}
+
+
+std::tuple<int, std::string> V8Runner::_removeConv(const char* conv_id) {
+
+  const Conv conv = std::string(conv_id);
+
+  std::lock_guard<std::mutex> guard(this->_replicaMutex);
+  std::unique_lock<std::shared_mutex> lock(this->_compileMutex);
+
+  std::size_t removed = 0;
+
+  auto nodes = this->_convNodes.find(conv);
+  if (nodes != this->_convNodes.end()) {
+    // _erasePair changes the set
+    const std::set<Node> convNodes = nodes->second;
+    for (const auto& node: convNodes) {
+      removed += this->_erasePair(std::make_pair(conv, node));
+    }
+  }
+
+  this->_releaseConv(conv);
+
+  return std::make_tuple(STATUS::NO_ERR, std::to_string(removed));
+}
+
+v8::Local<v8::Context> V8Runner::_convContext(const Conv& conv,
+                                              v8::Isolate* isolate,
+                                              const std::shared_ptr<IsolateRelatedData>& isolateData) {
+  auto contexts = this->_convContexts.find(conv);
+  if (contexts == this->_convContexts.end()) {
+    return v8::Local<v8::Context>::New(isolate, isolateData->getPContext());
+  }
+
+  auto& convContext = contexts->second[isolate];
+  if (!convContext) {
+    // same globals as the shared context, V8 makes it from its snapshot
+    convContext = std::make_unique<ConvContext>();
+
+    auto global = v8::Local<v8::ObjectTemplate>::New(isolate, isolateData->getPTemplate());
+    auto context = v8::Context::New(isolate, nullptr, global);
+    context->SetAlignedPointerInEmbedderData(V8Runner::CONTEXT_DATASETS_SLOT, &convContext->datasets);
+
+    convContext->context.Reset(isolate, context);
+  }
+
+  return v8::Local<v8::Context>::New(isolate, convContext->context);
+}
+
+void V8Runner::_dropConvContexts(const Conv& conv, v8::Isolate* isolate) {
+  auto contexts = this->_convContexts.find(conv);
+  if (contexts == this->_convContexts.end()) {
+    return;
+  }
+
+  for (auto it = contexts->second.begin(); it != contexts->second.end(); ) {
+    if (isolate && it->first != isolate) {
+      ++it;
+      continue;
+    }
+
+    this->_displace(it->first, it->second);
+    it = contexts->second.erase(it);
+  }
+
+  if (!isolate) {
+    this->_convContexts.erase(contexts);
+  }
+}
+
+std::tuple<int, std::string> V8Runner::_run(
+  const char* conv_id,
+  const char* node_id,
+  const char* data,
+  const std::size_t& threadId,
+  RunTrace* trace,
+  const std::size_t& maxExecutionTime
+) {
+
+  std::tuple<int, std::string> retValue;
+
+  const Conv conv = std::string(conv_id);
+  const Node node = std::string(node_id);
+
+  const auto key = std::make_pair(conv, node);
+
+  std::shared_lock<std::shared_mutex> lock(this->_compileMutex);
+
+  v8::Isolate* isolate = nullptr;
+  const PersistentFunction* function = nullptr;
+  ConvLoad* convLoad = nullptr;
+
+  if (this->_isolateMode == THREAD_ISOLATES) {
+    // the isolate of this thread, it has a replica of every function
+    auto it = this->_replicas.find(key);
+    if (it != this->_replicas.end()) {
+      const auto index = threadId % this->_isolates.size();
+      isolate = this->_isolates[index];
+      function = &it->second[index];
+    }
+  } else {
+    auto it = this->_functions.find(key);
+    if (it != this->_functions.end()) {
+      isolate = this->_convs[conv];
+      function = &it->second;
+
+      auto load = this->_convLoads.find(conv);
+      if (load != this->_convLoads.end()) {
+        convLoad = load->second.get();
+        if (!convLoad->replicas.empty()) {
+          this->_pickReplica(key, *convLoad, isolate, function);
+        }
+      }
+    }
+  }
+
+  if (!function) {
+    std::get<ERR_CODE>(retValue) = STATUS::NOT_FOUND_PAIR_ERR;
+    std::get<DATA>(retValue) = "Not found pair (" + conv + ", " + node + ")";
+    return retValue;
+  }
+
+  auto isolateData = this->_isolatesData[isolate];
+
+  IsolateUse use(isolateData->users);
+  const auto lockRequested = std::chrono::steady_clock::now();
+
+  {
+    v8::Locker locker(isolate);
+
+    // time the run waited for the isolate of its conv
+    if (convLoad) {
+      convLoad->runs += 1;
+      convLoad->lockWaitUs += std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - lockRequested).count();
+    }
+
+    // work with functions only after isolate has been locked
+    if (function->IsEmpty()) {
+      std::get<ERR_CODE>(retValue) = STATUS::NOT_FUNCTION_ERR;
+      std::get<DATA>(retValue) = "Pair (conv, node) does not contain compiled function.";
+      return retValue;
+    }
+
+    v8::Isolate::Scope isolate_scope(isolate);
+    v8::HandleScope scope(isolate);
+
+    v8::TryCatch try_catch(isolate);
+
+    // also covers toJSON of the result
+    IsolateRelatedData::KVScope kvScope(isolate);
+
+    // attribute GC pauses from here on to this run
+    isolateData->resetRunGC();
+
+    auto func = v8::Local<v8::Function>::New(isolate, *function);
+
+    // the own context of the conv or the shared one
+    auto context = func->CreationContext();
+
+    v8::Context::Scope context_scope(context);
+
+    this->_syncDatasets(isolate, context);
+
+    v8::MaybeLocal<v8::Value> jsonData =
+      v8::JSON::Parse(isolate, v8::String::NewFromUtf8(isolate, data));
+
+    if (jsonData.IsEmpty()) {
+      std::get<ERR_CODE>(retValue) = STATUS::BAD_INPUT_ERR;
+      std::get<DATA>(retValue) = "Error during parse JSON.";
+      return retValue;
+    }
+
+    this->_sampleInput(key, data);
+
+    v8::Local<v8::Object> obj = jsonData.ToLocalChecked()->ToObject();
+    v8::Local<v8::Value> args[] = { obj };
+
+    const auto now = std::chrono::system_clock::now();
+    const auto currentTime =
+      std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch());
+
+    // shared lock to be able to access _timing from different threads
+    // without any delay.
+    // _timing may grow meanwhile (resizeIsolates), keep our own pointer
+    auto timing = std::make_shared<V8Runner::ScriptWorkTime>(true, isolate, currentTime, EXEC_RUN, maxExecutionTime);
+    this->_timeCheckerMutex.lock_shared();
+      this->_timing[threadId] = timing;
+    this->_timeCheckerMutex.unlock_shared();
+
+    const auto execStarted = std::chrono::steady_clock::now();
+
+    v8::Local<v8::Value> res = func->Call(context->Global(), 1, args);
+
+    timing->isWorking = false;
+
+    if (trace) {
+      trace->execTimeUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - execStarted).count();
+      trace->gcPauseUs = isolateData->getRunGCPauseUs();
+      trace->gcCount = isolateData->getRunGCCount();
+    }
+
+    if (try_catch.HasCaught()) {
+      if (try_catch.HasTerminated()) {
+        std::get<ERR_CODE>(retValue) = STATUS::SCRIPT_TERMINATED_ERR;
+        std::get<DATA>(retValue) = "Script has been terminated.";
+      } else {
+        std::get<ERR_CODE>(retValue) = STATUS::SCRIPT_RUNTIME_ERR;
+        std::get<DATA>(retValue) = V8Runner::_makeTryCatchError(try_catch);
+      }
+      return retValue;
+    }
+
+    std::get<ERR_CODE>(retValue) = STATUS::NO_ERR;
+    std::get<DATA>(retValue) = V8Runner::_jsonStr(isolate, res);
+  }
+
+  // still under the shared _compileMutex, a recompile can not slip in
+  // between the run and its result being memoized
+  if (std::get<ERR_CODE>(retValue) == STATUS::NO_ERR) {
+    this->_results.put(conv, node, data, std::get<DATA>(retValue));
+  }
+
+  return retValue;
+}
+
+
+void V8Runner::_timeCheckerFunc() {
+
+  using namespace std::chrono;
+
+  auto now = system_clock::now();
+  auto currentTime = duration_cast<milliseconds>(now.time_since_epoch());
+
+  while (this->_timeCheckerWatch) {
+
+    // here we lock to write
+    // cuz we really need to iterate over all isolates
+    this->_timeCheckerMutex.lock();
+
+    const std::array<std::size_t, 3> limits = {
+      this->_maxExecutionTime,
+      this->_maxCompileTime,
+      this->_maxCheckCodeTime
+    };
+
+    for (auto timing: { &this->_timing, &this->_compileTiming }) {
+      for (auto &item: *timing) {
+        if (item && item->isWorking) {
+          auto threadLaunchTime = item->started;
+          auto timeExecution = std::size_t((currentTime - threadLaunchTime).count());
+
+          const auto limit = item->limit ? std::min(item->limit, limits[item->kind]) : limits[item->kind];
+
+          if (timeExecution > limit) {
+            if (item->isolate->IsInUse()) {
+              item->isolate->TerminateExecution();
+              item->isolate->DiscardThreadSpecificMetadata();
+            }
+          }
+        }
+      }
+    }
+
+    // access _timeCheckerSleepTime under the mutex
+    auto timeSpeelFor = this->_timeCheckerSleepTime;
+
+    this->_timeCheckerMutex.unlock();
+
+    std::this_thread::sleep_for (milliseconds(timeSpeelFor));
+
+    now = system_clock::now();
+    currentTime = duration_cast<milliseconds>(now.time_since_epoch());
+  }
+
+}
+
+std::shared_ptr<V8Runner::ScriptWorkTime> V8Runner::_watch(v8::Isolate* isolate, const EXECUTION_KIND& kind) {
+  using namespace std::chrono;
+
+  auto timing = std::make_shared<ScriptWorkTime>(
+    true,
+    isolate,
+    duration_cast<milliseconds>(system_clock::now().time_since_epoch()),
+    kind
+  );
+
+  std::unique_lock<std::shared_mutex> lock(this->_timeCheckerMutex);
+  this->_compileTiming.push_back(timing);
+
+  return timing;
+}
+
+void V8Runner::_unwatch(const std::shared_ptr<ScriptWorkTime>& timing) {
+  timing->isWorking = false;
+
+  // under the lock the time checker is not in the middle of a pass
+  std::unique_lock<std::shared_mutex> lock(this->_timeCheckerMutex);
+  auto& items = this->_compileTiming;
+  items.erase(std::remove(items.begin(), items.end(), timing), items.end());
+}
+
+void V8Runner::cleanData() {
+
+  std::lock_guard<std::mutex> guard(this->_replicaMutex);
+  std::unique_lock<std::shared_mutex> lock(this->_compileMutex);
+
+  this->_layoutVersion += 1;
+
+  // clean compiled functions
+  for (auto& kv: this->_functions) {
+    kv.second.Reset();
+  }
+
+  for (auto& kv: this->_replicas) {
+    for (auto& replica: kv.second) {
+      replica.Reset();
+    }
+  }
+  this->_replicas.clear();
+
+  for (auto& kv: this->_hotFunctions) {
+    for (auto& replica: kv.second) {
+      replica.second.Reset();
+    }
+  }
+
+  for (auto& kv: this->_versions) {
+    for (auto& version: kv.second.previous) {
+      for (auto& function: version.functions) {
+        function.second.Reset();
+      }
+    }
+  }
+
+  for (auto& conv: this->_convContexts) {
+    for (auto& context: conv.second) {
+      context.second->context.Reset();
+    }
+  }
+
+  this->_functions.clear();
+  this->_versions.clear();
+  this->_hotFunctions.clear();
+  this->_convs.clear();
+  this->_convLoads.clear();
+  this->_convContexts.clear();
+  this->_convNodes.clear();
+  this->_sources.clear();
+
+  {
+    std::unique_lock<std::shared_mutex> placementLock(this->_convPlacementMutex);
+    this->_convPlacement.clear();
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(this->_recentInputsMutex);
+    this->_recentInputs.clear();
+  }
+
+  this->_results.clear();
+}
+
+std::tuple<int, std::string> V8Runner::kvPut(const std::string& ns,
+                                             const std::string& key,
+                                             const std::string& value) {
+  try {
+    return std::make_tuple(STATUS::NO_ERR, std::to_string(this->_kv.put(ns, key, value)));
+  } catch(const std::exception& ex) {
+    return std::make_tuple(STATUS::KV_ERR, std::string(ex.what()));
+  }
+}
+
+std::tuple<int, std::string> V8Runner::kvLoadFile(const std::string& ns, const std::string& path) {
+  try {
+    return std::make_tuple(STATUS::NO_ERR, std::to_string(this->_kv.loadFile(ns, path)));
+  } catch(const std::exception& ex) {
+    return std::make_tuple(STATUS::KV_ERR, std::string(ex.what()));
+  }
+}
+
+uint64_t V8Runner::getKVVersion() const {
+  return this->_kv.version();
+}
+
+std::tuple<int, std::string> V8Runner::loadDatasets(const fs::path& dir) {
+  try {
+    return std::make_tuple(STATUS::NO_ERR, std::to_string(this->_datasets.load(dir)));
+  } catch(const std::exception& ex) {
+    return std::make_tuple(STATUS::DATASETS_ERR, std::string(ex.what()));
+  }
+}
+
+std::tuple<int, std::string> V8Runner::reloadDatasets() {
+  try {
+    return std::make_tuple(STATUS::NO_ERR, std::to_string(this->_datasets.reload()));
+  } catch(const std::exception& ex) {
+    return std::make_tuple(STATUS::DATASETS_ERR, std::string(ex.what()));
+  }
+}
+
+// a new datasets version is parsed into the context by the first run which sees it
+void V8Runner::_syncDatasets(v8::Isolate* isolate, v8::Local<v8::Context> context) {
+
+  auto binding = static_cast<DatasetsBinding*>(
+    context->GetAlignedPointerFromEmbedderData(V8Runner::CONTEXT_DATASETS_SLOT));
+
+  auto datasets = this->_datasets.current();
+  if (datasets->version == binding->version) {
+    return;
+  }
+
+  v8::TryCatch try_catch(isolate);
+  auto global = context->Global();
+
+  for (const auto& name: binding->names) {
+    if (!datasets->files.count(name)) {
+      global->Delete(context, v8::String::NewFromUtf8(isolate, name.c_str())).FromMaybe(false);
+    }
+  }
+
+  std::set<std::string> names;
+
+  for (const auto& file: datasets->files) {
+    v8::Local<v8::Value> value;
+    if (!v8::JSON::Parse(isolate, v8::String::NewFromUtf8(isolate, file.second.c_str())).ToLocal(&value)) {
+      std::cerr << "[ERROR] [syncDatasets] "
+                << "Dataset " << file.first << " is not valid JSON for V8."
+                << std::endl;
+      try_catch.Reset();
+      continue;
+    }
+
+    V8Runner::_deepFreeze(context, value);
+
+    // read only, but configurable: the next version redefines it
+    global->DefineOwnProperty(context,
+                              v8::String::NewFromUtf8(isolate, file.first.c_str()),
+                              value,
+                              v8::ReadOnly).FromMaybe(false);
+    names.insert(file.first);
+  }
+
+  binding->version = datasets->version;
+  binding->names = names;
+}
+
+void V8Runner::_deepFreeze(v8::Local<v8::Context> context, v8::Local<v8::Value> value) {
+  if (!value->IsObject()) {
+    return;
+  }
+
+  auto obj = value.As<v8::Object>();
+
+  v8::Local<v8::Array> keys;
+  if (obj->GetOwnPropertyNames(context).ToLocal(&keys)) {
+    for (uint32_t i = 0; i < keys->Length(); i++) {
+      v8::Local<v8::Value> key;
+      v8::Local<v8::Value> child;
+      if (keys->Get(context, i).ToLocal(&key) && obj->Get(context, key).ToLocal(&child)) {
+        V8Runner::_deepFreeze(context, child);
+      }
+    }
+  }
+
+  obj->SetIntegrityLevel(context, v8::IntegrityLevel::kFrozen).FromMaybe(false);
+}
+
+std::tuple<int, std::string> V8Runner::openJournal(const fs::path& path) {
+
+  using namespace std::chrono;
+
+  const auto started = steady_clock::now();
+
+  if (this->_journal) {
+    return std::make_tuple(STATUS::JOURNAL_ERR, "Journal is already open.");
+  }
 
-  std::tuple<int, std::string> retValue;
+  auto journal = std::make_unique<Journal>(path);
 
-  const Conv conv = std::string(conv_id);
-  const Node node = std::string(node_id);
+  std::vector<Journal::Entry> entries;
+  try {
+    entries = journal->open();
+  } catch(const std::exception& ex) {
+    return std::make_tuple(STATUS::JOURNAL_ERR, std::string(ex.what()));
+  }
+
+  // restored convs are spread over all isolates, not only the ready ones
+  this->waitForIsolates();
 
+  std::lock_guard<std::mutex> guard(this->_replicaMutex);
   std::unique_lock<std::shared_mutex> lock(this->_compileMutex);
 
-  v8::Isolate* isolate = nullptr;
+  // bind convs to isolates as compile does
+  std::map<v8::Isolate*, std::vector<const Journal::Entry*>> perIsolate;
 
-  {
-    // compile the same conv withing the same isolate
-    // if this conv does not have isolate, use next isolate
-    auto isolateItr = this->_convs.find(conv);
+  for (const auto& entry: entries) {
+    if (this->_isolateMode == THREAD_ISOLATES) {
+      // every isolate restores every function
+      this->_replicas[std::make_pair(entry.conv, entry.node)].resize(this->_isolates.size());
+      for (auto isolate: this->_isolates) {
+        perIsolate[isolate].push_back(&entry);
+      }
+      continue;
+    }
+
+    v8::Isolate* isolate = nullptr;
+
+    auto isolateItr = this->_convs.find(entry.conv);
     if (isolateItr == this->_convs.end()) {
       isolate = this->getIsolate();
-      this->_convs[conv] = isolate;
+      this->_convs[entry.conv] = isolate;
+      this->_placeConv(entry.conv, isolate);
+      this->_convLoads[entry.conv] = std::make_unique<ConvLoad>();
+      if (this->_convContextsEnabled) {
+        this->_convContexts[entry.conv];
+      }
     } else {
       isolate = isolateItr->second;
     }
-  }
 
-  {
-    v8::Locker locker(isolate);
-    v8::Isolate::Scope isolate_scope(isolate);
-    v8::HandleScope scope(isolate);
+    perIsolate[isolate].push_back(&entry);
+  }
 
-    auto isolateData = this->_isolatesData[isolate];
+  // one thread per isolate
+  std::mutex functionsMutex;
+  std::atomic<std::size_t> restored(0);
+  std::atomic<std::size_t> cacheRejected(0);
+  std::vector<std::thread> replayers;
 
-    auto context = v8::Local<v8::Context>::New(isolate, isolateData->getPContext());
+  for (const auto& kv: perIsolate) {
+    replayers.push_back(std::thread([this, &kv, &functionsMutex, &restored, &cacheRejected] {
+      restored += this->_replay(kv.first, kv.second, functionsMutex, cacheRejected);
+    }));
+  }
 
-    v8::Context::Scope context_scope(context);
+  for (auto& replayer: replayers) {
+    replayer.join();
+  }
 
-    auto script = v8::String::NewFromUtf8(isolate, src);
+  this->_journal = std::move(journal);
 
-    v8::TryCatch try_catch(isolate);
+  std::stringstream message;
+  message << "Restored " << restored << " of " << entries.size() << " functions"
+          << " in " << duration_cast<milliseconds>(steady_clock::now() - started).count() << " ms"
+          << " (code cache rejected: " << cacheRejected << ").";
 
-    {
-      // clean the function - if we already compiled this pair of conv and node
-      auto it = this->_functions.find(std::make_pair(conv, node));
-      if (it != this->_functions.end()) {
-        it->second.Reset();
-      }
-    }
+  return std::make_tuple(STATUS::NO_ERR, message.str());
+}
 
-    // compile
+std::size_t V8Runner::_replay(
+  v8::Isolate* isolate,
+  const std::vector<const Journal::Entry*>& entries,
+  std::mutex& functionsMutex,
+  std::atomic<std::size_t>& cacheRejected) {
 
-    v8::Local<v8::Script> compiled_script;
-    if (!v8::Script::Compile(context, script).ToLocal(&compiled_script)) {
+  std::size_t restored = 0;
 
-      std::get<ERR_CODE>(retValue) = STATUS::COMPILE_ERR;
-      std::get<DATA>(retValue) = V8Runner::_makeTryCatchError(try_catch);
+  const std::size_t replica =
+    std::find(this->_isolates.begin(), this->_isolates.end(), isolate) - this->_isolates.begin();
 
-      return retValue;
-    }
+  v8::Locker locker(isolate);
+  v8::Isolate::Scope isolate_scope(isolate);
+  v8::HandleScope scope(isolate);
 
-    v8::Local<v8::Value> result;
-    if (!compiled_script->Run(context).ToLocal(&result)) {
+  // other replayers read the map at the same time, no operator[] here
+  auto isolateData = this->_isolatesData.at(isolate);
 
-      std::get<ERR_CODE>(retValue) = STATUS::COMPILE_ERR;
-      std::get<DATA>(retValue) = V8Runner::_makeTryCatchError(try_catch);
+  for (auto entry: entries) {
+    v8::HandleScope entry_scope(isolate);
 
-      return retValue;
-    }
+    // a conv is replayed by one thread, its contexts are not shared
+    auto context = this->_isolateMode == THREAD_ISOLATES
+      ? v8::Local<v8::Context>::New(isolate, isolateData->getPContext())
+      : this->_convContext(entry->conv, isolate, isolateData);
 
-    this->_functions[std::make_pair(conv, node)] =
-      PersistentFunction(isolate, result.As<v8::Function>());
+    v8::Context::Scope context_scope(context);
+    v8::TryCatch try_catch(isolate);
 
-  }
+    auto script = v8::String::NewFromUtf8(isolate, entry->src.c_str());
 
-  std::get<ERR_CODE>(retValue) = STATUS::NO_ERR;
+    // source owns CachedData, but not the buffer
+    v8::ScriptCompiler::Source source(
+      script,
+      entry->codeCache.empty() ? nullptr : new v8::ScriptCompiler::CachedData(
+        reinterpret_cast<const uint8_t*>(entry->codeCache.data()),
+        entry->codeCache.size()
+      )
+    );
 
-  return retValue;
-}
+    v8::Local<v8::Script> compiled_script;
+    if (!v8::ScriptCompiler::Compile(
+          context,
+          &source,
+          entry->codeCache.empty()
+            ? v8::ScriptCompiler::kNoCompileOptions
+            : v8::ScriptCompiler::kConsumeCodeCache
+        ).ToLocal(&compiled_script)) {
+      std::cerr << "[ERROR] [openJournal] "
+                << "Can not compile (" << entry->conv << ", " << entry->node << "): "
+                << V8Runner::_makeTryCatchError(try_catch)
+                << std::endl;
+      continue;
+    }
 
+    if (source.GetCachedData() && source.GetCachedData()->rejected) {
+      cacheRejected += 1;
+    }
 
-std::tuple<int, std::string> V8Runner::_remove(
-  const char* conv,
-  const char* node) {
+    IsolateRelatedData::KVScope kvScope(isolate);
+    auto timing = this->_watch(isolate, EXEC_COMPILE);
+    v8::Local<v8::Value> result;
+    const bool evaluated = compiled_script->Run(context).ToLocal(&result);
+    this->_unwatch(timing);
+
+    if (!evaluated || !result->IsFunction()) {
+      std::cerr << "[ERROR] [openJournal] "
+                << "Can not run (" << entry->conv << ", " << entry->node << ")"
+                << std::endl;
+      continue;
+    }
 
-  std::tuple<int, std::string> retValue = { STATUS::NO_ERR, "" };
+    {
+      std::lock_guard<std::mutex> guard(functionsMutex);
+      const auto key = std::make_pair(entry->conv, entry->node);
+      if (this->_isolateMode == THREAD_ISOLATES) {
+        this->_replicas.at(key)[replica] = PersistentFunction(isolate, result.As<v8::Function>());
+      } else {
+        this->_functions[key] = PersistentFunction(isolate, result.As<v8::Function>());
+      }
+      this->_sources[key] = entry->src;
+      this->_convNodes[entry->conv].insert(entry->node);
+    }
 
-  v8::Isolate* isolate = nullptr;
+    restored += 1;
+  }
 
-  std::unique_lock<std::shared_mutex> lock(this->_compileMutex);
+  return restored;
+}
 
+void V8Runner::setHotConvs(const HotConvs& options) {
   {
-    auto isolateItr = this->_convs.find(conv);
-    if (isolateItr == this->_convs.end()) {
-      return retValue;
-    } else {
-      isolate = isolateItr->second;
-    }
+    std::lock_guard<std::mutex> guard(this->_hotConvsMutex);
+    this->_hotConvsOptions = options;
   }
+  this->_hotConvsVar.notify_one();
+}
 
-  auto key = std::make_pair(Conv(conv), Node(node));
+V8Runner::HotConvs V8Runner::getHotConvsOptions() {
+  std::lock_guard<std::mutex> guard(this->_hotConvsMutex);
+  return this->_hotConvsOptions;
+}
 
-  {
-    v8::Locker locker(isolate);
+std::map<V8Runner::Conv, std::size_t> V8Runner::getHotConvs() {
+  std::shared_lock<std::shared_mutex> lock(this->_compileMutex);
 
-    auto it = this->_functions.find(key);
-    if (it != this->_functions.end()) {
-      it->second.Reset();
+  std::map<Conv, std::size_t> res;
+  for (const auto& load: this->_convLoads) {
+    if (!load.second->replicas.empty()) {
+      res[load.first] = load.second->replicas.size();
     }
   }
-
-  return retValue;
+  return res;
 }
 
+void V8Runner::_hotConvsFunc() {
+  std::unique_lock<std::mutex> lock(this->_hotConvsMutex);
 
-std::tuple<int, std::string> V8Runner::_run(
-  const char* conv_id,
-  const char* node_id,
-  const char* data,
-  const std::size_t& threadId
-) {
-
-  std::tuple<int, std::string> retValue;
+  while (!this->_hotConvsStop) {
+    const auto status =
+      this->_hotConvsVar.wait_for(lock, std::chrono::milliseconds(this->_hotConvsOptions.intervalMs));
+    if (this->_hotConvsStop) {
+      break;
+    }
+    // new options, start the interval over
+    if (status == std::cv_status::no_timeout) {
+      continue;
+    }
 
-  const Conv conv = std::string(conv_id);
-  const Node node = std::string(node_id);
+    lock.unlock();
+    this->rebalanceHotConvs();
+    lock.lock();
+  }
+}
 
-  std::shared_lock<std::shared_mutex> lock(this->_compileMutex);
+void V8Runner::rebalanceHotConvs() {
+  if (this->_isolateMode == THREAD_ISOLATES) {
+    return;
+  }
 
-  auto it = this->_functions.find(std::make_pair(conv, node));
+  const auto options = this->getHotConvsOptions();
 
-  if (it == this->_functions.end()) {
-    std::get<ERR_CODE>(retValue) = STATUS::NOT_FOUND_PAIR_ERR;
-    std::get<DATA>(retValue) = "Not found pair (" + conv + ", " + node + ")";
-    return retValue;
-  }
+  std::unique_lock<std::mutex> guard(this->_replicaMutex);
 
-  auto isolate = this->_convs[conv];
+  std::vector<Conv> hot;
+  std::vector<Conv> cold;
+  std::unordered_map<v8::Isolate*, uint64_t> isolateRuns;
 
   {
-    v8::Locker locker(isolate);
+    std::shared_lock<std::shared_mutex> lock(this->_compileMutex);
 
-    // work with functions only after isolate has been locked
-    auto pFunc = it->second;
-    if (pFunc.IsEmpty()) {
-      std::get<ERR_CODE>(retValue) = STATUS::NOT_FUNCTION_ERR;
-      std::get<DATA>(retValue) = "Pair (conv, node) does not contain compiled function.";
-      return retValue;
-    }
+    for (auto& kv: this->_convLoads) {
+      auto& load = *kv.second;
 
-    v8::Isolate::Scope isolate_scope(isolate);
-    v8::HandleScope scope(isolate);
+      // window counters are touched under _replicaMutex only
+      const uint64_t runs = load.runs - load.lastRuns;
+      const uint64_t waitUs = load.lockWaitUs - load.lastLockWaitUs;
+      load.lastRuns += runs;
+      load.lastLockWaitUs += waitUs;
 
-    v8::TryCatch try_catch(isolate);
+      const uint64_t avgWaitUs = runs ? waitUs / runs : 0;
 
-    auto context =
-      v8::Local<v8::Context>::New(isolate, this->_isolatesData[isolate]->getPContext());
+      isolateRuns[this->_convs.at(kv.first)] += runs / (load.replicas.size() + 1);
+      for (auto replica: load.replicas) {
+        isolateRuns[replica] += runs / (load.replicas.size() + 1);
+      }
 
-    v8::Context::Scope context_scope(context);
+      if (runs >= options.minRuns && avgWaitUs >= options.lockWaitUs &&
+          load.replicas.size() < options.maxReplicas) {
+        hot.push_back(kv.first);
+      } else if (!load.replicas.empty() &&
+                 (avgWaitUs < options.lockWaitUs / 4 || load.replicas.size() > options.maxReplicas)) {
+        cold.push_back(kv.first);
+      }
+    }
+  }
 
-    v8::MaybeLocal<v8::Value> jsonData =
-      v8::JSON::Parse(isolate, v8::String::NewFromUtf8(isolate, data));
+  for (const auto& conv: hot) {
+    this->_addConvReplica(conv, isolateRuns);
+  }
 
-    if (jsonData.IsEmpty()) {
-      std::get<ERR_CODE>(retValue) = STATUS::BAD_INPUT_ERR;
-      std::get<DATA>(retValue) = "Error during parse JSON.";
-      return retValue;
+  if (!cold.empty()) {
+    std::unique_lock<std::shared_mutex> lock(this->_compileMutex);
+    for (const auto& conv: cold) {
+      this->_dropConvReplica(conv, this->_convLoads.at(conv)->replicas.back());
     }
+  }
 
-    v8::Local<v8::Object> obj = jsonData.ToLocalChecked()->ToObject();
-    v8::Local<v8::Value> args[] = { obj };
-
-    auto func =
-      v8::Local<v8::Function>::New(isolate, this->_functions[std::make_pair(conv, node)]);
+  guard.unlock();
+  this->_resetDisplaced();
+}
 
-    const auto now = std::chrono::system_clock::now();
-    const auto currentTime =
-      std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch());
+void V8Runner::_addConvReplica(const Conv& conv, std::unordered_map<v8::Isolate*, uint64_t>& isolateRuns) {
 
-    // shared lock to be able to access _timing from different threads
-    // without any delay.
-    this->_timeCheckerMutex.lock_shared();
-      this->_timing[threadId] =
-        std::make_shared<V8Runner::ScriptWorkTime>(true, isolate, currentTime);
-    this->_timeCheckerMutex.unlock_shared();
+  v8::Isolate* target = nullptr;
+  std::shared_ptr<IsolateRelatedData> targetData;
+  std::vector<std::pair<ConvNodePair, std::string>> sources;
 
-    v8::Local<v8::Value> res = func->Call(context->Global(), 1, args);
+  {
+    std::shared_lock<std::shared_mutex> lock(this->_compileMutex);
 
-    _timing[threadId]->isWorking = false;
+    const auto& load = *this->_convLoads.at(conv);
+    const auto primary = this->_convs.at(conv);
 
-    if (try_catch.HasCaught()) {
-      if (try_catch.HasTerminated()) {
-        std::get<ERR_CODE>(retValue) = STATUS::SCRIPT_TERMINATED_ERR;
-        std::get<DATA>(retValue) = "Script has been terminated.";
-      } else {
-        std::get<ERR_CODE>(retValue) = STATUS::SCRIPT_RUNTIME_ERR;
-        std::get<DATA>(retValue) = V8Runner::_makeTryCatchError(try_catch);
+    // the least busy isolate which does not have the conv yet
+    for (auto isolate: this->_isolates) {
+      if (isolate == primary ||
+          std::find(load.replicas.begin(), load.replicas.end(), isolate) != load.replicas.end()) {
+        continue;
+      }
+      if (!target || isolateRuns[isolate] < isolateRuns[target]) {
+        target = isolate;
       }
-      return retValue;
     }
 
-    std::get<ERR_CODE>(retValue) = STATUS::NO_ERR;
-    std::get<DATA>(retValue) = V8Runner::_jsonStr(isolate, res);
+    if (!target) {
+      return;
+    }
+    targetData = this->_isolatesData[target];
+
+    for (const auto& source: this->_sources) {
+      if (source.first.first == conv) {
+        sources.push_back(source);
+      }
+    }
   }
 
-  return retValue;
-}
+  // compiled without the global lock, nothing runs there yet
+  std::vector<std::pair<ConvNodePair, PersistentFunction>> functions;
+  functions.reserve(sources.size());
+  {
+    v8::Locker locker(target);
+    v8::Isolate::Scope isolate_scope(target);
+    v8::HandleScope scope(target);
 
+    auto context = this->_convContext(conv, target, targetData);
+    v8::Context::Scope context_scope(context);
 
-void V8Runner::_timeCheckerFunc() {
+    for (const auto& source: sources) {
+      PersistentFunction function;
+      auto res = this->_compileFunction(target, context, source.second.c_str(), function);
+      if (std::get<ERR_CODE>(res) != STATUS::NO_ERR) {
+        // keep the conv in one place rather than half of it in two
+        for (auto& compiled: functions) {
+          compiled.second.Reset();
+        }
+        std::cerr << "[ERROR] [hotConvs] "
+                  << "Can not replicate (" << source.first.first << ", " << source.first.second << "): "
+                  << std::get<DATA>(res)
+                  << std::endl;
+        return;
+      }
+      functions.emplace_back(source.first, std::move(function));
+    }
+  }
 
-  using namespace std::chrono;
+  // moved in without locking the target, see _publishVersion
+  std::unique_lock<std::shared_mutex> lock(this->_compileMutex);
 
-  auto now = system_clock::now();
-  auto currentTime = duration_cast<milliseconds>(now.time_since_epoch());
+  for (auto& function: functions) {
+    this->_hotFunctions[function.first][target] = std::move(function.second);
+  }
+  this->_convLoads.at(conv)->replicas.push_back(target);
+  this->_layoutVersion += 1;
 
-  while (this->_timeCheckerWatch) {
+  // do not pick it for the next hot conv of this round
+  isolateRuns[target] += 1;
 
-    // here we lock to write
-    // cuz we really need to iterate over all isolates
-    this->_timeCheckerMutex.lock();
+  std::cout << "[hotConvs] " << conv << " replicated, "
+            << this->_convLoads.at(conv)->replicas.size() << " replicas" << std::endl;
+}
 
-    for (auto &item: this->_timing) {
-      if (item && item->isWorking) {
-        auto threadLaunchTime = item->started;
-        auto timeExecution = std::size_t((currentTime - threadLaunchTime).count());
+void V8Runner::_dropConvReplica(const Conv& conv, v8::Isolate* replica) {
+  auto& replicas = this->_convLoads.at(conv)->replicas;
+  replicas.erase(std::remove(replicas.begin(), replicas.end(), replica), replicas.end());
+  this->_layoutVersion += 1;
 
-        if (timeExecution > this->_maxExecutionTime) {
-          if (item->isolate->IsInUse()) {
-            item->isolate->TerminateExecution();
-            item->isolate->DiscardThreadSpecificMetadata();
-          }
-        }
+  this->_dropConvContexts(conv, replica);
+
+  for (auto it = this->_hotFunctions.begin(); it != this->_hotFunctions.end(); ) {
+    if (it->first.first == conv) {
+      auto function = it->second.find(replica);
+      if (function != it->second.end()) {
+        this->_displace(replica, function->second);
+        it->second.erase(function);
       }
     }
+    it = it->second.empty() ? this->_hotFunctions.erase(it) : std::next(it);
+  }
+}
 
-    // access _timeCheckerSleepTime under the mutex
-    auto timeSpeelFor = this->_timeCheckerSleepTime;
-
-    this->_timeCheckerMutex.unlock();
-
-    std::this_thread::sleep_for (milliseconds(timeSpeelFor));
-
-    now = system_clock::now();
-    currentTime = duration_cast<milliseconds>(now.time_since_epoch());
+void V8Runner::_pickReplica(const ConvNodePair& key,
+                            ConvLoad& load,
+                            v8::Isolate*& isolate,
+                            const PersistentFunction*& function) {
+  auto hot = this->_hotFunctions.find(key);
+  if (hot == this->_hotFunctions.end()) {
+    return;
   }
 
-}
+  // the least used of the primary and the replicas, round-robin between equals
+  const std::size_t count = load.replicas.size() + 1;
+  const std::size_t start = load.next++;
 
-void V8Runner::cleanData() {
+  v8::Isolate* best = nullptr;
+  const PersistentFunction* bestFunction = nullptr;
+  int bestUsers = 0;
 
-  std::unique_lock<std::shared_mutex> lock(this->_compileMutex);
+  for (std::size_t i = 0; i < count; i++) {
+    const std::size_t index = (start + i) % count;
 
-  // clean compiled functions
-  for (auto& kv: this->_functions) {
-    kv.second.Reset();
-  }
+    v8::Isolate* candidate = isolate;
+    const PersistentFunction* candidateFunction = function;
+    if (index > 0) {
+      candidate = load.replicas[index - 1];
+      auto replica = hot->second.find(candidate);
+      if (replica == hot->second.end() || replica->second.IsEmpty()) {
+        continue;
+      }
+      candidateFunction = &replica->second;
+    }
 
-  this->_functions.clear();
-  this->_convs.clear();
+    const int users = this->_isolatesData[candidate]->users;
+    if (!best || users < bestUsers) {
+      best = candidate;
+      bestFunction = candidateFunction;
+      bestUsers = users;
+    }
+  }
 
+  if (best) {
+    isolate = best;
+    function = bestFunction;
+  }
 }
 
 void V8Runner::_Print(const v8::FunctionCallbackInfo<v8::Value>& args) {
@@ -597,23 +2937,17 @@ void V8Runner::_Require(const v8::FunctionCallbackInfo<v8::Value>& args) {
   const std::string fileName(*str);
 
   {
-    std::shared_lock<std::shared_mutex> lock(V8Runner::_requireCacheMutex);
+    auto file = V8Runner::_libs.get(fileName);
 
-    auto file = V8Runner::_requireCache.find(fileName);
-
-    if (file == V8Runner::_requireCache.end()) {
+    if (!file) {
       auto error = "Error opening file: " + fileName;
       isolate->ThrowException(v8::String::NewFromUtf8(isolate, error.c_str()));
       try_catch.ReThrow();
       return;
     }
 
-    const std::string& libContent = file->second;
-
-    auto script = v8::String::NewFromUtf8(isolate, libContent.c_str());
-
     v8::Local<v8::Script> compiled_script;
-    if (!v8::Script::Compile(isolate->GetCurrentContext(), script).ToLocal(&compiled_script)) {
+    if (!v8::Script::Compile(isolate->GetCurrentContext(), V8Runner::_libSource(isolate, file)).ToLocal(&compiled_script)) {
       try_catch.ReThrow();
       return;
     }
@@ -628,72 +2962,115 @@ void V8Runner::_Require(const v8::FunctionCallbackInfo<v8::Value>& args) {
 }
 
 
-std::tuple<int, std::string> V8Runner::getRequireCachedFile(const std::string& fileName) {
+v8::Local<v8::String> V8Runner::_libSource(v8::Isolate* isolate,
+                                           const std::shared_ptr<const LibCache::File>& file) {
+  // ASCII libraries are not copied to the V8 heap at all
+  if (file->isOneByte() && file->size() > 0) {
+    return v8::String::NewExternalOneByte(isolate, new LibResource(file)).ToLocalChecked();
+  }
+  return v8::String::NewFromUtf8(isolate, file->data(), v8::NewStringType::kNormal, file->size()).ToLocalChecked();
+}
 
-  std::tuple<int, std::string> retValue;
 
-  std::shared_lock<std::shared_mutex> lock(V8Runner::_requireCacheMutex);
+// kv.get(ns, key) - parsed value or undefined if there is no such key
+void V8Runner::_KVGet(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  auto isolate = args.GetIsolate();
 
-  auto file = V8Runner::_requireCache.find(fileName);
+  if (args.Length() < 2) {
+    isolate->ThrowException(v8::Exception::TypeError(
+      v8::String::NewFromUtf8(isolate, "kv.get: expected (ns, key).")));
+    return;
+  }
 
-  if (file == V8Runner::_requireCache.end()) {
-    std::get<ERR_CODE>(retValue) = STATUS::CACHED_REQUIRE_FILE_ERR;
-    std::get<DATA>(retValue) = "Don't have cache for " + fileName;
-  } else {
-    std::get<ERR_CODE>(retValue) = STATUS::NO_ERR;
-    std::get<DATA>(retValue) = file->second;
+  auto kv = static_cast<KVStore*>(args.Data().As<v8::External>()->Value());
+  auto isolateData = static_cast<IsolateRelatedData*>(isolate->GetData(V8Runner::ISOLATE_DATA_SLOT));
+
+  v8::String::Utf8Value ns(args[0]);
+  v8::String::Utf8Value key(args[1]);
+
+  const std::string* value = isolateData->kvSnapshot(*kv).get(
+    std::string(*ns, ns.length()), std::string(*key, key.length()));
+
+  if (!value) {
+    return;
   }
 
-  return retValue;
+  v8::Local<v8::Value> res;
+  if (v8::JSON::Parse(isolate, v8::String::NewFromUtf8(isolate, value->c_str())).ToLocal(&res)) {
+    args.GetReturnValue().Set(res);
+  }
+}
 
+void V8Runner::_KVVersion(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  auto kv = static_cast<KVStore*>(args.Data().As<v8::External>()->Value());
+  auto isolateData = static_cast<IsolateRelatedData*>(args.GetIsolate()->GetData(V8Runner::ISOLATE_DATA_SLOT));
+  args.GetReturnValue().Set(static_cast<double>(isolateData->kvSnapshot(*kv).version));
 }
 
 
-std::tuple<int, std::string> V8Runner::updateRequireCache(const std::string& fileName) {
-  std::tuple<int, std::string> retValue;
+V8Runner::GC_KIND V8Runner::_gcKind(v8::GCType type) {
+  switch (type) {
+    case v8::kGCTypeScavenge:
+      return GC_KIND::GC_SCAVENGE;
+    case v8::kGCTypeIncrementalMarking:
+      return GC_KIND::GC_INCREMENTAL;
+    case v8::kGCTypeProcessWeakCallbacks:
+      return GC_KIND::GC_WEAK_CALLBACKS;
+    default:
+      return GC_KIND::GC_MARK_COMPACT;
+  }
+}
 
-  auto requireFile = V8Runner::_getRequireFile(V8Runner::_pathToLibs / fileName);
+void V8Runner::_GCPrologue(v8::Isolate* isolate, v8::GCType type, v8::GCCallbackFlags flags) {
+  auto isolateData = static_cast<IsolateRelatedData*>(isolate->GetData(V8Runner::ISOLATE_DATA_SLOT));
+  if (isolateData) {
+    isolateData->gcPrologue(V8Runner::_gcKind(type));
+  }
+}
 
-  if (std::get<ERR_CODE>(requireFile) != STATUS::NO_ERR) {
-    std::cerr << "[ERROR] [updateRequireCache] "
-              << "Code: " << std::get<ERR_CODE>(requireFile) << ", "
-              << "Message: " << std::get<DATA>(requireFile)
-              << std::endl;
-    return requireFile;
+void V8Runner::_GCEpilogue(v8::Isolate* isolate, v8::GCType type, v8::GCCallbackFlags flags) {
+  auto isolateData = static_cast<IsolateRelatedData*>(isolate->GetData(V8Runner::ISOLATE_DATA_SLOT));
+  if (isolateData) {
+    isolateData->gcEpilogue(V8Runner::_gcKind(type));
   }
+}
 
-  {
-    std::unique_lock<std::shared_mutex> lock(V8Runner::_requireCacheMutex);
-    V8Runner::_requireCache[fileName] = std::get<DATA>(requireFile);
+
+std::tuple<int, std::string> V8Runner::getRequireCachedFile(const std::string& fileName) {
+
+  std::tuple<int, std::string> retValue;
+
+  auto file = V8Runner::_libs.get(fileName);
+
+  if (!file) {
+    std::get<ERR_CODE>(retValue) = STATUS::CACHED_REQUIRE_FILE_ERR;
+    std::get<DATA>(retValue) = "Don't have cache for " + fileName;
+  } else {
+    std::get<ERR_CODE>(retValue) = STATUS::NO_ERR;
+    std::get<DATA>(retValue) = std::string(file->data(), file->size());
   }
 
   return retValue;
+
 }
 
-std::tuple<int, std::string> V8Runner::_getRequireFile(const std::string& fileName) {
+
+std::tuple<int, std::string> V8Runner::updateRequireCache(const std::string& fileName) {
   std::tuple<int, std::string> retValue;
+
+  // watched libraries are reloaded automatically, this forces it
   try {
-    std::string libContent = V8Runner::_readFile(fileName);
-    std::get<DATA>(retValue) = STATUS::NO_ERR;
-    std::get<DATA>(retValue) = libContent;
+    V8Runner::_libs.reload(fileName);
   } catch(const std::exception& ex) {
+    std::cerr << "[ERROR] [updateRequireCache] "
+              << "Code: " << STATUS::CACHED_REQUIRE_FILE_ERR << ", "
+              << "Message: " << ex.what()
+              << std::endl;
     std::get<ERR_CODE>(retValue) = STATUS::CACHED_REQUIRE_FILE_ERR;
     std::get<DATA>(retValue) = ex.what();
   }
-  return retValue;
-}
-
 
-// maybe switch to boost in a future
-std::string V8Runner::_readFile(const std::string& fileName) {
-  std::ifstream file(fileName);
-  if (file) {
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
-  } else {
-    throw std::runtime_error("Error opening file: " + fileName);
-  }
+  return retValue;
 }
 
 // Stringify V8 value to JSON
@@ -731,13 +3108,3 @@ std::string V8Runner::_makeTryCatchError(const v8::TryCatch& try_catch) {
   return error.str();
 
 }
-
-std::vector<std::string> splitString(const std::string& str, const auto& separator) {
-  std::vector<std::string> parts;
-  std::istringstream f(str);
-  std::string s;
-  while (getline(f, s, separator)) {
-      parts.push_back(s);
-  }
-  return parts;
-}
@@ -0,0 +1,200 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "v8runner.h"
+
+
+#define CHECK(Expr, Msg) __CHECK(#Expr, Expr, __FILE__, __LINE__, Msg)
+
+void __CHECK(const char* expr_str, bool expr, const char* file, int line, const char* msg)
+{
+    if (!expr)
+    {
+        std::cerr << "Assert failed:\t" << msg << "\n"
+            << "Expected:\t" << expr_str << "\n"
+            << "Source:\t\t" << file << ", line " << line << "\n";
+        abort();
+    }
+}
+
+// the way functions did it before the native modules
+const std::string JS_HELPERS = R"SCRIPT(
+    function sha256(s) {
+      const primes = [];
+      for (let n = 2; primes.length < 64; n++) {
+        if (primes.every(p => n % p !== 0)) primes.push(n);
+      }
+      const frac = x => ((x - Math.floor(x)) * 0x100000000) | 0;
+      const K = primes.map(p => frac(Math.cbrt(p)));
+      const H = primes.slice(0, 8).map(p => frac(Math.sqrt(p)));
+
+      const bytes = [];
+      for (let i = 0; i < s.length; i++) bytes.push(s.charCodeAt(i) & 0xff);
+      const bits = bytes.length * 8;
+      bytes.push(0x80);
+      while (bytes.length % 64 !== 56) bytes.push(0);
+      for (let i = 7; i >= 0; i--) bytes.push(i > 3 ? 0 : (bits >>> (8 * i)) & 0xff);
+
+      const rotr = (x, n) => (x >>> n) | (x << (32 - n));
+      const W = new Array(64);
+      for (let off = 0; off < bytes.length; off += 64) {
+        for (let i = 0; i < 16; i++) {
+          const j = off + 4 * i;
+          W[i] = (bytes[j] << 24) | (bytes[j + 1] << 16) | (bytes[j + 2] << 8) | bytes[j + 3];
+        }
+        for (let i = 16; i < 64; i++) {
+          const s0 = rotr(W[i - 15], 7) ^ rotr(W[i - 15], 18) ^ (W[i - 15] >>> 3);
+          const s1 = rotr(W[i - 2], 17) ^ rotr(W[i - 2], 19) ^ (W[i - 2] >>> 10);
+          W[i] = (W[i - 16] + s0 + W[i - 7] + s1) | 0;
+        }
+        let [a, b, c, d, e, f, g, h] = H;
+        for (let i = 0; i < 64; i++) {
+          const t1 = (h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + W[i]) | 0;
+          const t2 = ((rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c))) | 0;
+          h = g; g = f; f = e; e = (d + t1) | 0;
+          d = c; c = b; b = a; a = (t1 + t2) | 0;
+        }
+        [a, b, c, d, e, f, g, h].forEach((x, i) => H[i] = (H[i] + x) | 0);
+      }
+      return H.map(x => (x >>> 0).toString(16).padStart(8, '0')).join('');
+    }
+
+    function base64Encode(s) {
+      const alphabet = 'ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/';
+      let res = '';
+      let i = 0;
+      for (; i + 2 < s.length; i += 3) {
+        const chunk = (s.charCodeAt(i) << 16) | (s.charCodeAt(i + 1) << 8) | s.charCodeAt(i + 2);
+        res += alphabet[(chunk >> 18) & 63] + alphabet[(chunk >> 12) & 63] +
+          alphabet[(chunk >> 6) & 63] + alphabet[chunk & 63];
+      }
+      if (i + 1 === s.length) {
+        const chunk = s.charCodeAt(i) << 16;
+        res += alphabet[(chunk >> 18) & 63] + alphabet[(chunk >> 12) & 63] + '==';
+      } else if (i + 2 === s.length) {
+        const chunk = (s.charCodeAt(i) << 16) | (s.charCodeAt(i + 1) << 8);
+        res += alphabet[(chunk >> 18) & 63] + alphabet[(chunk >> 12) & 63] + alphabet[(chunk >> 6) & 63] + '=';
+      }
+      return res;
+    }
+
+    function crc32(s) {
+      const table = [];
+      for (let n = 0; n < 256; n++) {
+        let c = n;
+        for (let k = 0; k < 8; k++) c = c & 1 ? 0xedb88320 ^ (c >>> 1) : c >>> 1;
+        table.push(c);
+      }
+      let crc = -1;
+      for (let i = 0; i < s.length; i++) crc = table[(crc ^ s.charCodeAt(i)) & 0xff] ^ (crc >>> 8);
+      return (crc ^ -1) >>> 0;
+    }
+
+    function uuidV4() {
+      const hex = '0123456789abcdef';
+      let res = '';
+      for (let i = 0; i < 36; i++) {
+        if (i === 8 || i === 13 || i === 18 || i === 23) res += '-';
+        else if (i === 14) res += '4';
+        else if (i === 19) res += hex[8 + Math.floor(Math.random() * 4)];
+        else res += hex[Math.floor(Math.random() * 16)];
+      }
+      return res;
+    }
+)SCRIPT";
+
+struct Workload {
+  std::string name;
+  std::string native;
+  std::string js;
+  // results of both must be equal
+  bool deterministic;
+};
+
+std::string functionSrc(const std::string& expr) {
+  return "(function(data) {\n" + JS_HELPERS +
+    "  const s = 'abcdefgh'.repeat(Math.ceil(data.size / 8)).slice(0, data.size);\n"
+    "  let res;\n"
+    "  for (let i = 0; i < data.iterations; i++) {\n"
+    "    res = " + expr + ";\n"
+    "  }\n"
+    "  return res;\n"
+    "})";
+}
+
+// Native hash, encoding and uuid modules against the JS code they replace,
+// every run hashes (encodes) a string of [size] bytes [iterations] times:
+// ./crypto_bench <LIBS_PATH> <RAM_in_Gb> [size] [iterations] [runs]
+int main(int argc, char* argv[]) {
+
+  fs::path pathToLibs(argv[1]);
+
+  const std::size_t maxExecutionTime = 60000; // milliseconds
+  const std::size_t timeCheckerSleepTime = 500; // milliseconds
+  const std::size_t maxRAMAvailable = std::stoi(argv[2]);
+  const std::size_t threadsCount = 1;
+
+  const std::size_t size = argc > 3 ? std::stoul(argv[3]) : 1024;
+  const std::size_t iterations = argc > 4 ? std::stoul(argv[4]) : 1000;
+  const std::size_t runs = argc > 5 ? std::stoul(argv[5]) : 20;
+
+  auto v8 = std::make_unique<pb::V8Runner>(
+    argc,
+    argv,
+    pathToLibs,
+    maxExecutionTime,
+    maxRAMAvailable,
+    timeCheckerSleepTime,
+    threadsCount
+  );
+
+  const std::vector<Workload> workloads = {
+    {"sha256", "hash.sha256(s)", "sha256(s)", true},
+    {"base64", "encoding.base64Encode(s)", "base64Encode(s)", true},
+    {"crc32", "hash.crc32(s)", "crc32(s)", true},
+    {"uuid.v4", "uuid.v4()", "uuidV4()", false}
+  };
+
+  const auto data = "{\"size\": " + std::to_string(size) + ", " +
+    "\"iterations\": " + std::to_string(iterations) + "}";
+
+  std::cout << runs << " runs of " << iterations << " calls on " << size << " bytes" << std::endl;
+
+  for (const auto& workload: workloads) {
+    std::string results[2];
+    long long totalUs[2];
+
+    for (int native = 0; native < 2; native++) {
+      const auto node = workload.name + (native ? "_native" : "_js");
+      const auto src = functionSrc(native ? workload.native : workload.js);
+
+      auto res = v8->compile("bench", node.c_str(), src.c_str());
+      CHECK(std::get<0>(res) == pb::V8Runner::STATUS::NO_ERR, std::get<1>(res).c_str());
+
+      // the first run is not measured, it warms the function up
+      res = v8->run("bench", node.c_str(), data.c_str());
+      CHECK(std::get<0>(res) == pb::V8Runner::STATUS::NO_ERR, std::get<1>(res).c_str());
+      results[native] = std::get<1>(res);
+
+      const auto started = std::chrono::steady_clock::now();
+      for (std::size_t i = 0; i < runs; i++) {
+        res = v8->run("bench", node.c_str(), data.c_str());
+        CHECK(std::get<0>(res) == pb::V8Runner::STATUS::NO_ERR, std::get<1>(res).c_str());
+      }
+      totalUs[native] = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - started).count();
+    }
+
+    CHECK(!workload.deterministic || results[0] == results[1], workload.name.c_str());
+
+    const double calls = double(runs) * iterations;
+    std::cout << "  " << workload.name << ": "
+              << "js " << totalUs[0] * 1000 / calls << " ns/call, "
+              << "native " << totalUs[1] * 1000 / calls << " ns/call, "
+              << "x" << (totalUs[1] ? double(totalUs[0]) / totalUs[1] : 0) << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,119 @@
+#include <memory>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <cstdlib>
+#include <cstring>
+
+#include <gtest/gtest.h>
+
+#include "threadpool.h"
+#include "inlinetask.h"
+#include "inflightruns.h"
+
+// Allocations of queued pool jobs. Counting them replaces the global
+// operator new, so these tests have a binary of their own.
+
+// allocations made by the current thread
+thread_local std::size_t threadAllocations = 0;
+
+void* operator new(std::size_t size) {
+  threadAllocations += 1;
+  if (void* ptr = std::malloc(size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+  std::free(ptr);
+}
+
+namespace pb {
+
+  typedef pb::concurrent::InlineTask<void(std::size_t)> Task;
+
+  RunKey::Buffer makeBuffer(const std::string& s) {
+    return RunKey::Buffer(strdup(s.c_str()), free);
+  }
+
+  TEST(InlineTaskTest, QueueingDoesNotAllocate) {
+    pb::concurrent::ThreadPool<Task> single(1, 1000);
+
+    // captures of a cnode run: shared terms and the key of a coalesced run
+    // with an input of a usual size, far over the small string buffer
+    auto from = std::make_shared<int>(1);
+    auto tuple = std::make_shared<int>(2);
+    auto func = std::make_shared<int>(3);
+    const std::string input = "{\"data\": \"" + std::string(1024, 'x') + "\"}";
+    RunKey key(makeBuffer("conv"), makeBuffer("node"), makeBuffer(input));
+    std::atomic<int> done(0);
+
+    auto round = [&]() {
+      // jobs are queued while the only worker is busy
+      std::atomic<bool> release(false);
+      single.addJob(0, [&release](std::size_t) {
+        while (!release) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+      });
+      while (single.getBusyThreads() == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+
+      for (int i = 0; i < 100; i++) {
+        // a job and its expiry callback, both with the key
+        single.addJob(0, [from, tuple, func, key, &done](std::size_t) {
+          done += *from + *tuple + *func == 6 && !key.empty();
+        }, -1, std::chrono::steady_clock::time_point::max(), [from, key](std::size_t) {});
+      }
+
+      release = true;
+      single.waitAll();
+    };
+
+    // the shard grows to its capacity once
+    round();
+
+    const auto before = threadAllocations;
+    round();
+    ASSERT_EQ(threadAllocations - before, 0);
+    ASSERT_EQ(done, 200);
+
+    // the same captures do not fit into std::function
+    const auto beforeFunction = threadAllocations;
+    std::function<void(std::size_t)> function = [from, tuple, func, key, &done](std::size_t) {
+      done += *from + *tuple + *func == 6 && !key.empty();
+    };
+    ASSERT_GT(threadAllocations - beforeFunction, 0);
+
+    // and a key copied as a string would allocate for every job
+    const auto beforeString = threadAllocations;
+    std::string copied(input);
+    ASSERT_GT(threadAllocations - beforeString, 0);
+    ASSERT_EQ(copied.size(), input.size());
+  }
+
+  TEST(InlineTaskTest, MoveOnlyCaptures) {
+    std::atomic<int> done(0);
+
+    auto owned = std::make_unique<int>(7);
+    Task task([owned = std::move(owned), &done](std::size_t) { done += *owned; });
+    Task moved(std::move(task));
+    ASSERT_FALSE(task);
+    moved(0);
+    ASSERT_EQ(done, 7);
+  }
+
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
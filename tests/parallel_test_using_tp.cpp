@@ -84,6 +84,13 @@ int main(int argc, char* argv[]) {
   const std::size_t maxThreadpoolQueueSize = std::stoi(argv[3]);
   const std::size_t threadsCount = 4;
 
+  // optional 7th argument: 1 - every pool thread owns an isolate with all
+  // functions, compare its time with the default conv-to-isolate mode
+  // (V8 can be initialized once per process, so one mode per run)
+  const auto isolateMode = argc > 7 && std::stoi(argv[7]) == 1
+    ? pb::V8Runner::THREAD_ISOLATES
+    : pb::V8Runner::CONV_ISOLATES;
+
   auto v8 = std::make_unique<pb::V8Runner>(
     argc,
     argv,
@@ -91,7 +98,11 @@ int main(int argc, char* argv[]) {
     maxExecutionTime,
     maxRAMAvailable,
     timeCheckerSleepTime,
-    threadsCount
+    threadsCount,
+    pb::V8Platform::Options(),
+    nullptr,
+    0,
+    isolateMode
   );
 
   auto pool = std::make_unique<ThreadPool>(threadsCount, maxThreadpoolQueueSize);
@@ -117,6 +128,8 @@ int main(int argc, char* argv[]) {
 
   int N = std::stoi(argv[6]);
 
+  const auto started = std::chrono::steady_clock::now();
+
   #pragma omp parallel for num_threads(threadsCount)
   for (int i = 0; i < N; i++) {
     auto pair_index = getRandomIndex(pairs.size() - 1);
@@ -132,7 +145,8 @@ int main(int argc, char* argv[]) {
           auto res = v8->compile(
             pair.first.c_str(),
             pair.second.c_str(),
-            src.c_str()
+            src.c_str(),
+            threadNum
           );
           CHECK(std::get<0>(res) == pb::V8Runner::STATUS::NO_ERR, std::get<1>(res).c_str());
         })
@@ -145,10 +159,12 @@ int main(int argc, char* argv[]) {
           auto res = v8->run(
             pair.first.c_str(),
             pair.second.c_str(),
-            bigJSON.c_str()
+            bigJSON.c_str(),
+            threadNum
           );
           CHECK(
             std::get<0>(res) == pb::V8Runner::STATUS::NO_ERR ||
+            std::get<0>(res) == pb::V8Runner::STATUS::NOT_FOUND_PAIR_ERR ||
             std::get<0>(res) == pb::V8Runner::STATUS::NOT_FUNCTION_ERR,
             std::get<1>(res).c_str()
           );
@@ -187,5 +203,12 @@ int main(int argc, char* argv[]) {
   auto amountOfJobs = pool->getAmountOfDoneJobs();
   CHECK(amountOfJobs == N, "getAmountOfJobs incorrect");
 
+  const auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now() - started).count();
+
+  std::cerr << (isolateMode == pb::V8Runner::THREAD_ISOLATES ? "thread" : "conv") << " isolates: "
+            << N << " jobs in " << elapsedMs << " ms"
+            << " (" << (elapsedMs ? N * 1000 / elapsedMs : 0) << " jobs/s)" << std::endl;
+
   return 0;
 }
@@ -0,0 +1,73 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include "threadpool.h"
+
+typedef pb::concurrent::ThreadPool<
+  std::function<void(std::size_t)>
+> ThreadPool;
+
+// Throughput of submit/dequeue: producers add short jobs the way the cnode
+// receive thread does, workers run them.
+// ./pool_bench [threads] [jobs] [producers] [work_us] [priorities]
+int main(int argc, char* argv[]) {
+
+  const std::size_t threadsCount = argc > 1 ? std::stoul(argv[1]) : 16;
+  const std::size_t jobsCount = argc > 2 ? std::stoul(argv[2]) : 1000000;
+  const std::size_t producersCount = argc > 3 ? std::stoul(argv[3]) : 1;
+  const std::size_t workUs = argc > 4 ? std::stoul(argv[4]) : 0;
+  const int prioritiesCount = argc > 5 ? std::stoi(argv[5]) : 2;
+
+  ThreadPool pool(threadsCount, jobsCount);
+
+  std::atomic<std::size_t> done(0);
+
+  auto job = [&done, workUs](std::size_t) {
+    if (workUs) {
+      const auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(workUs);
+      while (std::chrono::steady_clock::now() < until);
+    }
+    done += 1;
+  };
+
+  const auto started = std::chrono::steady_clock::now();
+
+  std::vector<std::thread> producers;
+  for (std::size_t p = 0; p < producersCount; p++) {
+    producers.emplace_back([&pool, &job, p, jobsCount, producersCount, prioritiesCount] {
+      for (std::size_t i = p; i < jobsCount; i += producersCount) {
+        // the queue is sized for all jobs, a full one is not measured
+        while (!pool.addJob(static_cast<int>(i % prioritiesCount), job));
+      }
+    });
+  }
+
+  for (auto& producer: producers) {
+    producer.join();
+  }
+
+  const auto submitted = std::chrono::steady_clock::now();
+
+  pool.waitAll();
+
+  const auto finished = std::chrono::steady_clock::now();
+
+  const auto submitUs = std::chrono::duration_cast<std::chrono::microseconds>(submitted - started).count();
+  const auto totalUs = std::chrono::duration_cast<std::chrono::microseconds>(finished - started).count();
+  const auto queueWait = pool.getQueueWait();
+
+  std::cout << threadsCount << " threads, " << producersCount << " producers, "
+            << jobsCount << " jobs of " << workUs << " us" << std::endl
+            << "  submit: " << submitUs << " us, "
+            << (submitUs ? jobsCount * 1000000 / submitUs : 0) << " jobs/s" << std::endl
+            << "  total:  " << totalUs << " us, "
+            << (totalUs ? jobsCount * 1000000 / totalUs : 0) << " jobs/s" << std::endl
+            << "  queue wait p50 " << queueWait.percentile(50) << " us, "
+            << "p99 " << queueWait.percentile(99) << " us" << std::endl;
+
+  return done == jobsCount ? 0 : 1;
+}
@@ -0,0 +1,116 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <algorithm>
+
+#include <unistd.h>
+
+#include "v8runner.h"
+
+
+#define CHECK(Expr, Msg) __CHECK(#Expr, Expr, __FILE__, __LINE__, Msg)
+
+void __CHECK(const char* expr_str, bool expr, const char* file, int line, const char* msg)
+{
+    if (!expr)
+    {
+        std::cerr << "Assert failed:\t" << msg << "\n"
+            << "Expected:\t" << expr_str << "\n"
+            << "Source:\t\t" << file << ", line " << line << "\n";
+        abort();
+    }
+}
+
+// resident set size in Mb
+double rssMb() {
+  std::ifstream statm("/proc/self/statm");
+  std::size_t size = 0;
+  std::size_t resident = 0;
+  statm >> size >> resident;
+  return double(resident) * sysconf(_SC_PAGESIZE) / (1024 * 1024);
+}
+
+// Every cycle compiles a function of a new conv and removes it, the way
+// conversations come and go on a long running node. Memory and the registry
+// must stay flat: ./soak_test <LIBS_PATH> <RAM_in_Gb> [cycles] [max_growth_mb]
+int main(int argc, char* argv[]) {
+
+  const std::string src = R"SCRIPT(
+    (function(data) {
+      data.a += 1;
+      return data;
+    })
+  )SCRIPT";
+
+  fs::path pathToLibs(argv[1]);
+
+  const std::size_t maxExecutionTime = 1000; // milliseconds
+  const std::size_t timeCheckerSleepTime = 500; // milliseconds
+  const std::size_t maxRAMAvailable = std::stoi(argv[2]);
+  const std::size_t threadsCount = 4;
+
+  const std::size_t cycles = argc > 3 ? std::stoul(argv[3]) : 10000000;
+  const double maxGrowthMb = argc > 4 ? std::stod(argv[4]) : 32;
+
+  auto v8 = std::make_unique<pb::V8Runner>(
+    argc,
+    argv,
+    pathToLibs,
+    maxExecutionTime,
+    maxRAMAvailable,
+    timeCheckerSleepTime,
+    threadsCount
+  );
+
+  const auto started = std::chrono::steady_clock::now();
+
+  // the baseline is taken once V8 heaps and the maps have warmed up,
+  // after the first cycle at least
+  const std::size_t warmUpCycles = std::max<std::size_t>(std::min<std::size_t>(cycles / 10, 100000), 1);
+  const std::size_t reportEvery = std::max<std::size_t>(cycles / 20, 1);
+  double baselineMb = rssMb();
+
+  for (std::size_t i = 0; i < cycles; i++) {
+    const auto conv = "conv" + std::to_string(i);
+
+    auto res = v8->compile(conv.c_str(), "node", src.c_str(), i % threadsCount);
+    CHECK(std::get<0>(res) == pb::V8Runner::STATUS::NO_ERR, std::get<1>(res).c_str());
+
+    res = v8->run(conv.c_str(), "node", "{\"a\": 1}", i % threadsCount);
+    CHECK(std::get<0>(res) == pb::V8Runner::STATUS::NO_ERR, std::get<1>(res).c_str());
+
+    res = v8->remove(conv.c_str(), "node");
+    CHECK(std::get<0>(res) == pb::V8Runner::STATUS::NO_ERR, std::get<1>(res).c_str());
+
+    if (i + 1 == warmUpCycles) {
+      baselineMb = rssMb();
+    }
+
+    if ((i + 1) % reportEvery == 0) {
+      const auto registry = v8->getRegistryStatistics();
+      std::cerr << i + 1 << " cycles: rss " << rssMb() << " Mb, "
+                << "convs " << registry.convs << ", "
+                << "functions " << registry.functions << ", "
+                << "buckets " << registry.buckets << ", "
+                << "compactions " << registry.compactions << std::endl;
+    }
+  }
+
+  const auto registry = v8->getRegistryStatistics();
+  CHECK(registry.convs == 0, "convs are left in the registry");
+  CHECK(registry.functions == 0, "functions are left in the registry");
+  CHECK(registry.sources == 0, "sources are left in the registry");
+
+  const double growthMb = rssMb() - baselineMb;
+
+  const auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now() - started).count();
+
+  std::cerr << cycles << " compile/run/remove cycles in " << elapsedMs << " ms, "
+            << "rss growth after warm-up " << growthMb << " Mb" << std::endl;
+
+  CHECK(growthMb <= maxGrowthMb, "memory grows with the amount of removed convs");
+
+  return 0;
+}
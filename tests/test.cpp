@@ -1,6 +1,9 @@
 #include <memory>
 #include <vector>
 #include <random>
+#include <algorithm>
+#include <thread>
+#include <chrono>
 #include <omp.h>
 
 #include <gtest/gtest.h>
@@ -8,6 +11,7 @@
 
 #include "v8runner.h"
 #include "threadpool.h"
+#include "inflightruns.h"
 
 using json = nlohmann::json;
 
@@ -249,7 +253,7 @@ namespace pb {
       << std::get<1>(res);
 
     res = v8->run("conv", "node", "{\"a\": 1, \"b\": 2, \"arr\": [1, 2, 3]}");
-    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NOT_FUNCTION_ERR)
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NOT_FOUND_PAIR_ERR)
       << std::get<1>(res);
 
     res = v8->run("conv", "node1", "{\"a\": 1, \"b\": 2, \"arr\": [1, 2, 3]}");
@@ -383,6 +387,26 @@ namespace pb {
       << std::get<1>(res);
   }
 
+  TEST_F(V8RunnerTest, CompileAndCheckCodeTerminated) {
+    const auto src = "(function() { for (;;); })(); (function(data) { return data; })";
+
+    auto res = v8->compile("conv", "node", src);
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::SCRIPT_TERMINATED_ERR)
+      << std::get<1>(res);
+
+    // the isolate is usable after that
+    res = v8->compile("conv", "node", "(function(data) { return data; })");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR)
+      << std::get<1>(res);
+    res = v8->run("conv", "node", "{}");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR)
+      << std::get<1>(res);
+
+    res = v8->checkCode(src, "{}");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::SCRIPT_TERMINATED_ERR)
+      << std::get<1>(res);
+  }
+
   TEST_F(V8RunnerTest, GetRequireCachedFile) {
     auto res = v8->getRequireCachedFile("libs/moment.js");
     ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR)
@@ -450,6 +474,699 @@ namespace pb {
     ASSERT_EQ(v8->nodes_count(), 3);
   }
 
+  TEST_F(V8RunnerTest, RunTraceAndGCStatistics) {
+    auto res = v8->compile(
+      "conv",
+      "node",
+      R"SCRIPT(
+        (function(data) {
+          let garbage = [];
+          for(let i = 0; i < 1000000; i++) garbage.push({ i: i });
+          data.a = garbage.length;
+          return data;
+        })
+      )SCRIPT"
+    );
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR)
+      << std::get<1>(res);
+
+    pb::V8Runner::RunTrace trace;
+    res = v8->run("conv", "node", "{}", 0, &trace);
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR)
+      << std::get<1>(res);
+
+    ASSERT_GT(trace.execTimeUs, 0);
+    ASSERT_GT(trace.gcCount, 0);
+    ASSERT_LE(trace.gcPauseUs, trace.execTimeUs);
+
+    auto gcStatistics = v8->getGCStatistics();
+    ASSERT_GT(gcStatistics["scavenge"].count, 0);
+  }
+
+  TEST_F(V8RunnerTest, CompileWithWarmUp) {
+    pb::V8Runner::WarmUp warmUp;
+    warmUp.runs = 100;
+    warmUp.sample = "{\"a\": 1}";
+
+    auto res = v8->compile(
+      "conv",
+      "node",
+      "(function(data) { data.a += 1; return data; })",
+      0,
+      &warmUp
+    );
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR)
+      << std::get<1>(res);
+
+    ASSERT_EQ(warmUp.doneRuns, 100);
+    ASSERT_GT(warmUp.timeUs, 0);
+
+    res = v8->run("conv", "node", "{\"a\": 1}");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR)
+      << std::get<1>(res);
+
+    auto j_res = json::parse(std::get<1>(res));
+    ASSERT_EQ(j_res["a"], 2);
+  }
+
+  TEST_F(V8RunnerTest, NativeDate) {
+    auto res = v8->compile(
+      "conv",
+      "node",
+      "(function(data) {"
+      "  var t = date.parse(data.t);"
+      "  var next = date.add(t, 1, 'months');"
+      "  data.next = date.format(next);"
+      "  data.day = date.format(next, 'yyyy-MM-dd', 'Europe/Kiev');"
+      "  data.diff = date.diff(next, t, 'days');"
+      "  data.start = date.format(date.startOf(t, 'year'));"
+      "  data.offset = date.offset(t, 'Europe/Kiev');"
+      "  data.bad = isNaN(date.parse('not a date'));"
+      "  return data;"
+      "})"
+    );
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR)
+      << std::get<1>(res);
+
+    res = v8->run("conv", "node", "{\"t\": \"2018-01-31T22:30:00.000Z\"}");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR)
+      << std::get<1>(res);
+
+    auto j_res = json::parse(std::get<1>(res));
+    ASSERT_EQ(j_res["next"], "2018-02-28T22:30:00.000Z");
+    ASSERT_EQ(j_res["day"], "2018-03-01");
+    ASSERT_EQ(j_res["diff"], 28);
+    ASSERT_EQ(j_res["start"], "2018-01-01T00:00:00.000Z");
+    ASSERT_EQ(j_res["offset"], 120);
+    ASSERT_EQ(j_res["bad"], true);
+
+    res = v8->compile("conv", "node", "(function(data) { return date.offset(0, 'Nowhere/City'); })");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR)
+      << std::get<1>(res);
+
+    res = v8->run("conv", "node", "{}");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::SCRIPT_RUNTIME_ERR)
+      << std::get<1>(res);
+  }
+
+  TEST_F(V8RunnerTest, NativeHashAndEncoding) {
+    auto res = v8->compile(
+      "conv",
+      "node",
+      "(function(data) {"
+      "  data.md5 = hash.md5(data.s);"
+      "  data.sha1 = hash.sha1(data.s);"
+      "  data.sha256 = hash.sha256(new Uint8Array([97, 98, 99]));"
+      "  data.hmac = hash.hmac('sha256', 'key', data.s, 'base64');"
+      "  data.crc32 = hash.crc32(data.s);"
+      "  data.b64 = encoding.base64Encode(data.s);"
+      "  data.decoded = encoding.base64Decode(data.b64);"
+      "  data.hex = encoding.hexEncode(data.s);"
+      "  data.bytes = new Uint8Array(encoding.hexDecode(data.hex, 'buffer')).length;"
+      "  data.uuid4 = uuid.v4();"
+      "  data.uuid7 = uuid.v7();"
+      "  return data;"
+      "})"
+    );
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR)
+      << std::get<1>(res);
+
+    res = v8->run("conv", "node", "{\"s\": \"abc\"}");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR)
+      << std::get<1>(res);
+
+    auto j_res = json::parse(std::get<1>(res));
+    ASSERT_EQ(j_res["md5"], "900150983cd24fb0d6963f7d28e17f72");
+    ASSERT_EQ(j_res["sha1"], "a9993e364706816aba3e25717850c26c9cd0d89d");
+    ASSERT_EQ(j_res["sha256"], "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    ASSERT_EQ(j_res["hmac"], "nBluMtwBdfhvSxy4konWYZ3mvuaZ5MN45oMJ7Zehpqs=");
+    ASSERT_EQ(j_res["crc32"], 891568578);
+    ASSERT_EQ(j_res["b64"], "YWJj");
+    ASSERT_EQ(j_res["decoded"], "abc");
+    ASSERT_EQ(j_res["hex"], "616263");
+    ASSERT_EQ(j_res["bytes"], 3);
+    ASSERT_EQ(j_res["uuid4"].get<std::string>().size(), 36);
+    ASSERT_EQ(j_res["uuid4"].get<std::string>()[14], '4');
+    ASSERT_EQ(j_res["uuid7"].get<std::string>()[14], '7');
+  }
+
+  TEST_F(V8RunnerTest, SharedKVStore) {
+    auto res = v8->kvPut("tariffs", "basic", "{\"price\": 10}");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR)
+      << std::get<1>(res);
+
+    res = v8->kvPut("tariffs", "broken", "{price: 10");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::KV_ERR);
+
+    res = v8->kvLoadFile("tariffs", "./no/such/file.json");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::KV_ERR);
+
+    res = v8->compile(
+      "conv",
+      "node",
+      "(function(data) {"
+      "  var tariff = kv.get('tariffs', data.tariff);"
+      "  data.total = tariff ? tariff.price * data.count : null;"
+      "  return data;"
+      "})"
+    );
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR)
+      << std::get<1>(res);
+
+    res = v8->run("conv", "node", "{\"tariff\": \"basic\", \"count\": 3}");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR)
+      << std::get<1>(res);
+    ASSERT_EQ(json::parse(std::get<1>(res))["total"], 30);
+
+    res = v8->run("conv", "node", "{\"tariff\": \"premium\", \"count\": 3}");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR)
+      << std::get<1>(res);
+    ASSERT_TRUE(json::parse(std::get<1>(res))["total"].is_null());
+
+    v8->kvPut("tariffs", "basic", "{\"price\": 20}");
+
+    res = v8->run("conv", "node", "{\"tariff\": \"basic\", \"count\": 3}");
+    ASSERT_EQ(json::parse(std::get<1>(res))["total"], 60);
+  }
+
+  TEST_F(V8RunnerTest, KVSnapshotIsNotPinnedByCompile) {
+    v8->kvPut("tariffs", "basic", "{\"price\": 10}");
+
+    // top-level code reads the store as well
+    auto res = v8->compile(
+      "conv",
+      "node",
+      "(function() {"
+      "  var initial = kv.get('tariffs', 'basic');"
+      "  return function(data) {"
+      "    data.initial = initial.price;"
+      "    data.price = kv.get('tariffs', 'basic').price;"
+      "    return data;"
+      "  };"
+      "})()"
+    );
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR)
+      << std::get<1>(res);
+
+    v8->kvPut("tariffs", "basic", "{\"price\": 20}");
+
+    res = v8->run("conv", "node", "{}");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR)
+      << std::get<1>(res);
+    ASSERT_EQ(json::parse(std::get<1>(res))["initial"], 10);
+    ASSERT_EQ(json::parse(std::get<1>(res))["price"], 20);
+  }
+
+  TEST_F(V8RunnerTest, FrozenDatasets) {
+    const auto dir = fs::temp_directory_path() / "v8runner_datasets_test";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+
+    std::ofstream(dir / "tariffs.json") << "{\"basic\": {\"price\": 10}}";
+
+    auto res = v8->loadDatasets(dir);
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR)
+      << std::get<1>(res);
+
+    res = v8->compile(
+      "conv",
+      "node",
+      "(function(data) {"
+      "  'use strict';"
+      "  data.price = tariffs.basic.price;"
+      "  if (data.mutate) tariffs.basic.price = 0;"
+      "  return data;"
+      "})"
+    );
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR)
+      << std::get<1>(res);
+
+    res = v8->run("conv", "node", "{}");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR)
+      << std::get<1>(res);
+    ASSERT_EQ(json::parse(std::get<1>(res))["price"], 10);
+
+    res = v8->run("conv", "node", "{\"mutate\": true}");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::SCRIPT_RUNTIME_ERR)
+      << std::get<1>(res);
+
+    // a broken file keeps the previous version
+    std::ofstream(dir / "tariffs.json") << "{\"basic\": {\"price\": 20}}";
+    std::ofstream(dir / "broken.json") << "{";
+
+    res = v8->reloadDatasets();
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::DATASETS_ERR);
+
+    res = v8->run("conv", "node", "{}");
+    ASSERT_EQ(json::parse(std::get<1>(res))["price"], 10);
+
+    fs::remove(dir / "broken.json");
+
+    res = v8->reloadDatasets();
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR)
+      << std::get<1>(res);
+
+    res = v8->run("conv", "node", "{}");
+    ASSERT_EQ(json::parse(std::get<1>(res))["price"], 20);
+
+    fs::remove_all(dir);
+  }
+
+  TEST_F(V8RunnerTest, StartupStatistics) {
+    v8->waitForIsolates();
+
+    auto startup = v8->getStartupStatistics();
+    ASSERT_EQ(startup.isolatesCount, v8->isolates_count());
+    ASSERT_EQ(startup.precompiledLibs, startup.libsCount * startup.isolatesCount);
+    ASSERT_GT(startup.allIsolatesUs, 0u);
+    ASSERT_LE(startup.libsUs, startup.firstIsolateUs);
+    ASSERT_LE(startup.firstIsolateUs, startup.readyUs);
+    ASSERT_LE(startup.readyUs, startup.allIsolatesUs);
+  }
+
+  TEST_F(V8RunnerTest, RunOnEveryThread) {
+    auto res = v8->compile("conv", "node", "(function(data) { data.a += 1; return data; })");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+
+    // in thread mode every thread has its own replica
+    for (std::size_t threadId = 0; threadId < v8->isolates_count(); threadId++) {
+      res = v8->run("conv", "node", "{\"a\": 1}", threadId);
+      ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+      ASSERT_EQ(json::parse(std::get<1>(res))["a"], 2);
+    }
+
+    v8->remove("conv", "node");
+
+    for (std::size_t threadId = 0; threadId < v8->isolates_count(); threadId++) {
+      res = v8->run("conv", "node", "{\"a\": 1}", threadId);
+      ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NOT_FOUND_PAIR_ERR);
+    }
+  }
+
+  TEST_F(V8RunnerTest, ResizeIsolatesMigratesConvs) {
+    const auto initial = v8->isolates_count();
+
+    for (int i = 0; i < 8; i++) {
+      const auto conv = "conv" + std::to_string(i);
+      auto res = v8->compile(conv.c_str(), "node", "(function(data) { data.a += 1; return data; })");
+      ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+    }
+    v8->remove("conv7", "node");
+
+    ASSERT_EQ(v8->resizeIsolates(initial + 2), initial + 2);
+
+    // new thread numbers are watched too
+    auto res = v8->run("conv0", "node", "{\"a\": 1}", initial + 1);
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+
+    ASSERT_EQ(v8->resizeIsolates(1), 1u);
+
+    for (int i = 0; i < 7; i++) {
+      const auto conv = "conv" + std::to_string(i);
+      res = v8->run(conv.c_str(), "node", "{\"a\": 1}");
+      ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+      ASSERT_EQ(json::parse(std::get<1>(res))["a"], 2);
+    }
+
+    res = v8->run("conv7", "node", "{\"a\": 1}");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NOT_FOUND_PAIR_ERR);
+
+    ASSERT_EQ(v8->resizeIsolates(initial), initial);
+  }
+
+  TEST_F(V8RunnerTest, CompileDoesNotWaitForTopLevelCodeOfAnotherConv) {
+    if (v8->getIsolateMode() != pb::V8Runner::CONV_ISOLATES || v8->isolates_count() < 2) {
+      return;
+    }
+
+    // new convs land on different isolates
+    std::thread slow([] {
+      auto res = v8->compile(
+        "slow",
+        "node",
+        "var until = Date.now() + 500; while (Date.now() < until) {}"
+        "(function(data) { return data; })"
+      );
+      ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    const auto started = std::chrono::steady_clock::now();
+    auto res = v8->compile("fast", "node", "(function(data) { return data; })");
+    const auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - started).count();
+
+    slow.join();
+
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+    ASSERT_LT(elapsedMs, 300);
+
+    res = v8->run("slow", "node", "{\"a\": 1}");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+  }
+
+  TEST_F(V8RunnerTest, ResizeIsolatesKeepsIsolateOnFailedMigration) {
+    const auto initial = v8->isolates_count();
+    if (v8->getIsolateMode() != pb::V8Runner::CONV_ISOLATES || initial < 2) {
+      return;
+    }
+
+    v8->kvPut("migration", "fail", "false");
+
+    // convs land on all isolates round-robin
+    for (std::size_t i = 0; i < initial; i++) {
+      const auto conv = "conv" + std::to_string(i);
+      auto res = v8->compile(
+        conv.c_str(),
+        "node",
+        "if (kv.get('migration', 'fail')) { throw new Error('can not compile'); }"
+        "(function(data) { data.a += 1; return data; })"
+      );
+      ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+    }
+
+    v8->kvPut("migration", "fail", "true");
+
+    ASSERT_EQ(v8->resizeIsolates(1), initial);
+
+    for (std::size_t i = 0; i < initial; i++) {
+      const auto conv = "conv" + std::to_string(i);
+      auto res = v8->run(conv.c_str(), "node", "{\"a\": 1}");
+      ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+      ASSERT_EQ(json::parse(std::get<1>(res))["a"], 2);
+    }
+
+    v8->kvPut("migration", "fail", "false");
+
+    ASSERT_EQ(v8->resizeIsolates(1), 1u);
+
+    for (std::size_t i = 0; i < initial; i++) {
+      const auto conv = "conv" + std::to_string(i);
+      auto res = v8->run(conv.c_str(), "node", "{\"a\": 1}");
+      ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+    }
+
+    ASSERT_EQ(v8->resizeIsolates(initial), initial);
+  }
+
+  TEST_F(V8RunnerTest, HotConvReplicas) {
+    if (v8->getIsolateMode() != pb::V8Runner::CONV_ISOLATES || v8->isolates_count() < 2) {
+      return;
+    }
+
+    // every conv with runs is hot, rebalanced by hand only
+    pb::V8Runner::HotConvs options;
+    options.maxReplicas = 2;
+    options.lockWaitUs = 0;
+    options.minRuns = 1;
+    options.intervalMs = 1000000;
+    v8->setHotConvs(options);
+
+    auto res = v8->compile("hot", "node", "(function(data) { data.a += 1; return data; })");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+    res = v8->run("hot", "node", "{\"a\": 1}");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+
+    v8->rebalanceHotConvs();
+    ASSERT_EQ(v8->getHotConvs()["hot"], 1u);
+
+    // a compile reaches the replica, runs alternate between the copies
+    res = v8->compile("hot", "node", "(function(data) { data.a += 2; return data; })");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+    for (int i = 0; i < 4; i++) {
+      res = v8->run("hot", "node", "{\"a\": 1}");
+      ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+      ASSERT_EQ(json::parse(std::get<1>(res))["a"], 3);
+    }
+
+    v8->remove("hot", "node");
+    for (int i = 0; i < 4; i++) {
+      res = v8->run("hot", "node", "{\"a\": 1}");
+      ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NOT_FOUND_PAIR_ERR);
+    }
+
+    options.maxReplicas = 0;
+    v8->setHotConvs(options);
+    v8->rebalanceHotConvs();
+    ASSERT_TRUE(v8->getHotConvs().empty());
+  }
+
+  TEST_F(V8RunnerTest, RemoveConvWithOwnContext) {
+    const bool contexts = v8->getIsolateMode() == pb::V8Runner::CONV_ISOLATES;
+    v8->setConvContexts(contexts);
+
+    auto res = v8->compile("tenantA", "node", "var secret = 42; (function(data) { data.s = typeof secret; return data; })");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+    res = v8->compile("tenantA", "node1", "(function(data) { data.s = secret; return data; })");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+    res = v8->compile("tenantB", "node", "(function(data) { data.s = typeof secret; return data; })");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+
+    // nodes of a conv share its context
+    res = v8->run("tenantA", "node1", "{}");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+    ASSERT_EQ(json::parse(std::get<1>(res))["s"], 42);
+
+    if (contexts) {
+      res = v8->run("tenantB", "node", "{}");
+      ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+      ASSERT_EQ(json::parse(std::get<1>(res))["s"], "undefined");
+    }
+
+    const auto convs = v8->convs_count();
+
+    res = v8->removeConv("tenantA");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+    ASSERT_EQ(std::get<1>(res), "2");
+    ASSERT_EQ(v8->convs_count(), convs - 1);
+
+    res = v8->run("tenantA", "node", "{}");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NOT_FOUND_PAIR_ERR);
+
+    // and it comes back clean
+    res = v8->compile("tenantA", "node", "(function(data) { data.s = typeof secret; return data; })");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+    if (contexts) {
+      res = v8->run("tenantA", "node", "{}");
+      ASSERT_EQ(json::parse(std::get<1>(res))["s"], "undefined");
+    }
+
+    v8->removeConv("tenantA");
+    v8->removeConv("tenantB");
+    v8->setConvContexts(false);
+  }
+
+  TEST_F(V8RunnerTest, RegistryShrinksAfterRemove) {
+    const auto before = v8->getRegistryStatistics();
+
+    for (int i = 0; i < 500; i++) {
+      const auto conv = "churn" + std::to_string(i);
+      auto res = v8->compile(conv.c_str(), "node", "(function(data) { return data; })");
+      ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+    }
+    ASSERT_EQ(v8->getRegistryStatistics().convs, before.convs + 500);
+
+    for (int i = 0; i < 500; i++) {
+      const auto conv = "churn" + std::to_string(i);
+      v8->remove(conv.c_str(), "node");
+    }
+
+    // a failed compile does not keep a new conv either
+    auto res = v8->compile("churn", "node", "(function(data) {");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::COMPILE_ERR);
+
+    const auto after = v8->getRegistryStatistics();
+    ASSERT_EQ(after.convs, before.convs);
+    ASSERT_EQ(after.functions, before.functions);
+    ASSERT_EQ(after.sources, before.sources);
+    ASSERT_GT(after.compactions, before.compactions);
+  }
+
+  TEST_F(V8RunnerTest, FailedRecompileKeepsLiveVersion) {
+    auto res = v8->compile("versioned", "node", "(function(data) { data.v = 1; return data; })");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+    res = v8->compile("versioned", "node", "(function(data) { data.v = 2; return data; })");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+
+    res = v8->compile("versioned", "node", "(function(data) {");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::COMPILE_ERR);
+
+    res = v8->run("versioned", "node", "{}");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+    ASSERT_EQ(json::parse(std::get<1>(res))["v"], 2);
+
+    // one replaced version is kept by default
+    res = v8->rollback("versioned", "node");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+    ASSERT_EQ(std::get<1>(res), "1");
+
+    res = v8->run("versioned", "node", "{}");
+    ASSERT_EQ(json::parse(std::get<1>(res))["v"], 1);
+
+    res = v8->rollback("versioned", "node");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NOT_FOUND_PAIR_ERR);
+
+    v8->setKeptVersions(0);
+    v8->compile("versioned", "node", "(function(data) { data.v = 3; return data; })");
+    res = v8->rollback("versioned", "node");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NOT_FOUND_PAIR_ERR);
+
+    v8->setKeptVersions(1);
+    v8->removeConv("versioned");
+  }
+
+  TEST_F(V8RunnerTest, FailedRollbackKeepsVersion) {
+    if (v8->getIsolateMode() != pb::V8Runner::THREAD_ISOLATES) {
+      return;
+    }
+    const auto initial = v8->isolates_count();
+
+    v8->kvPut("rollback", "fail", "false");
+
+    auto res = v8->compile(
+      "versioned",
+      "node",
+      "if (kv.get('rollback', 'fail')) { throw new Error('can not compile'); }"
+      "(function(data) { data.v = 1; return data; })"
+    );
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+    res = v8->compile("versioned", "node", "(function(data) { data.v = 2; return data; })");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+
+    // the new isolate has no kept copy, the old version is compiled there again
+    v8->kvPut("rollback", "fail", "true");
+    ASSERT_EQ(v8->resizeIsolates(initial + 1), initial + 1);
+
+    res = v8->rollback("versioned", "node");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::COMPILE_ERR);
+
+    for (std::size_t threadId = 0; threadId < v8->isolates_count(); threadId++) {
+      res = v8->run("versioned", "node", "{}", threadId);
+      ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+      ASSERT_EQ(json::parse(std::get<1>(res))["v"], 2);
+    }
+
+    // the version stays for another try
+    v8->kvPut("rollback", "fail", "false");
+
+    res = v8->rollback("versioned", "node");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+    ASSERT_EQ(std::get<1>(res), "1");
+
+    for (std::size_t threadId = 0; threadId < v8->isolates_count(); threadId++) {
+      res = v8->run("versioned", "node", "{}", threadId);
+      ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+      ASSERT_EQ(json::parse(std::get<1>(res))["v"], 1);
+    }
+
+    v8->removeConv("versioned");
+    ASSERT_EQ(v8->resizeIsolates(initial), initial);
+  }
+
+  TEST_F(V8RunnerTest, CompileBulkIsAllOrNothing) {
+    std::vector<pb::V8Runner::BulkNode> nodes(3);
+    nodes[0].node = "a";
+    nodes[0].src = "(function(data) { data.v = 1; return data; })";
+    nodes[1].node = "b";
+    nodes[1].src = "(function(data) { data.v = 1; return data; })";
+    nodes[2].node = "c";
+    nodes[2].src = "(function(data) { data.v = 1; return data; })";
+
+    auto res = v8->compileBulk("bulk", nodes);
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+
+    // a broken node keeps the whole old version live
+    nodes[0].src = "(function(data) { data.v = 2; return data; })";
+    nodes[1].src = "(function(data) {";
+    res = v8->compileBulk("bulk", nodes);
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::COMPILE_ERR);
+    ASSERT_EQ(nodes[0].code, pb::V8Runner::STATUS::NO_ERR);
+    ASSERT_EQ(nodes[1].code, pb::V8Runner::STATUS::COMPILE_ERR);
+
+    res = v8->run("bulk", "a", "{}");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+    ASSERT_EQ(json::parse(std::get<1>(res))["v"], 1);
+
+    // only the changed node is compiled
+    nodes[1].src = "(function(data) { data.v = 1; return data; })";
+    res = v8->compileBulk("bulk", nodes, true);
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+    ASSERT_FALSE(nodes[0].skipped);
+    ASSERT_TRUE(nodes[1].skipped);
+    ASSERT_TRUE(nodes[2].skipped);
+
+    res = v8->run("bulk", "a", "{}");
+    ASSERT_EQ(json::parse(std::get<1>(res))["v"], 2);
+    res = v8->run("bulk", "c", "{}");
+    ASSERT_EQ(json::parse(std::get<1>(res))["v"], 1);
+
+    // a failed deployment of a new conv does not keep it
+    const auto convs = v8->getRegistryStatistics().convs;
+    std::vector<pb::V8Runner::BulkNode> broken(1);
+    broken[0].node = "a";
+    broken[0].src = "(function(data) {";
+    res = v8->compileBulk("bulk_new", broken);
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::COMPILE_ERR);
+    ASSERT_EQ(v8->getRegistryStatistics().convs, convs);
+
+    // in thread mode a node which fails in a later isolate fails the bulk too
+    if (v8->getIsolateMode() == pb::V8Runner::THREAD_ISOLATES && v8->isolates_count() > 1) {
+      res = v8->compile("bulk", "poison", "(function(data) { bulkPoisoned = true; return data; })");
+      ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+      // only the second isolate runs it
+      res = v8->run("bulk", "poison", "{}", 1);
+      ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+
+      nodes[0].src =
+        "if (typeof bulkPoisoned !== 'undefined') { throw new Error('can not compile'); }"
+        "(function(data) { data.v = 3; return data; })";
+      res = v8->compileBulk("bulk", nodes, true);
+      ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::COMPILE_ERR);
+      ASSERT_EQ(nodes[0].code, pb::V8Runner::STATUS::COMPILE_ERR);
+
+      // every isolate keeps the live version
+      for (std::size_t thread = 0; thread < v8->isolates_count(); thread++) {
+        res = v8->run("bulk", "a", "{}", thread);
+        ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+        ASSERT_EQ(json::parse(std::get<1>(res))["v"], 2);
+      }
+    }
+
+    v8->removeConv("bulk");
+  }
+
+  TEST_F(V8RunnerTest, MemoizedResultsDroppedOnRecompile) {
+    auto res = v8->compile("memo", "node", "(function(data) { data.v = 1; return data; })");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+
+    std::string result;
+    ASSERT_FALSE(v8->isMemoizationEnabled());
+    v8->setMemoization("memo", "node", true);
+    ASSERT_TRUE(v8->isMemoizationEnabled());
+    ASSERT_FALSE(v8->getMemoized("memo", "node", "{}", result));
+
+    res = v8->run("memo", "node", "{}");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+    ASSERT_TRUE(v8->getMemoized("memo", "node", "{}", result));
+    ASSERT_EQ(result, std::get<1>(res));
+    ASSERT_FALSE(v8->getMemoized("memo", "node", "{\"a\": 1}", result));
+
+    res = v8->compile("memo", "node", "(function(data) { data.v = 2; return data; })");
+    ASSERT_EQ(std::get<0>(res), pb::V8Runner::STATUS::NO_ERR) << std::get<1>(res);
+    ASSERT_FALSE(v8->getMemoized("memo", "node", "{}", result));
+
+    // the pair opts in again after it is removed
+    v8->run("memo", "node", "{}");
+    v8->removeConv("memo");
+    v8->compile("memo", "node", "(function(data) { return data; })");
+    v8->run("memo", "node", "{}");
+    ASSERT_FALSE(v8->getMemoized("memo", "node", "{}", result));
+
+    v8->removeConv("memo");
+    ASSERT_FALSE(v8->isMemoizationEnabled());
+  }
+
   TEST_F(V8RunnerTest, CompileAndRunBunchOfPairs) {
 
     const int numberOfIterations = 2;
@@ -600,6 +1317,455 @@ namespace pb {
     CHECK(amountOfJobs == pairs.size(), "getAmountOfDoneJobs incorrect");
   }
 
+  TEST(ThreadPoolResizeTest, ThreadNumbersStayUnique) {
+    ThreadPool resizable(2, 100000);
+
+    std::vector<std::atomic<int>> inUse(8);
+    std::atomic<int> clashes(0);
+
+    for (int round = 0; round < 20; round++) {
+      for (int i = 0; i < 100; i++) {
+        while (!resizable.addJob(0, [&inUse, &clashes](std::size_t threadNum) {
+          if (threadNum >= inUse.size() || inUse[threadNum]++ != 0) {
+            clashes += 1;
+          }
+          std::this_thread::sleep_for(std::chrono::microseconds(100));
+          inUse[threadNum % inUse.size()] -= 1;
+        }));
+      }
+      resizable.resize(1 + (round * 3) % 8);
+    }
+
+    resizable.waitAll();
+
+    ASSERT_EQ(clashes, 0);
+    ASSERT_EQ(resizable.getAmountOfDoneJobs(), 2000);
+    ASSERT_EQ(resizable.size(), 1 + (19 * 3) % 8);
+  }
+
+  TEST(ThreadPoolDeadlineTest, EarliestDeadlineFirstAndExpiredDropped) {
+    ThreadPool single(1, 100);
+
+    // the only worker waits till all jobs are queued
+    std::atomic<bool> release(false);
+    single.addJob(0, [&release](std::size_t) {
+      while (!release) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    });
+    while (single.getBusyThreads() == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    std::vector<int> order;
+    std::vector<int> expired;
+
+    for (int i = 0; i < 3; i++) {
+      single.addJob(0,
+        [&order, i](std::size_t) { order.push_back(i); }, -1,
+        now + std::chrono::seconds(30 - i * 10));
+    }
+    single.addJob(0,
+      [&order](std::size_t) { order.push_back(-1); }, -1,
+      now,
+      [&expired](std::size_t) { expired.push_back(-1); });
+    // a higher priority goes first whatever its deadline is
+    single.addJob(1, [&order](std::size_t) { order.push_back(3); });
+
+    release = true;
+    single.waitAll();
+
+    ASSERT_EQ(order, std::vector<int>({3, 2, 1, 0}));
+    ASSERT_EQ(expired.size(), 1);
+    ASSERT_EQ(single.getJobsExpired(), 1);
+  }
+
+  TEST(ThreadPoolDeadlineTest, EarliestDeadlineFirstAcrossShards) {
+    ThreadPool pair(2, 100);
+
+    // every worker is held by its own job, then worker 0 is released
+    // and takes the jobs queued over both shards
+    std::atomic<bool> release[2] = {{false}, {false}};
+    for (int i = 0; i < 2; i++) {
+      pair.addJob(0, [&release](std::size_t threadNum) {
+        while (!release[threadNum]) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+      });
+    }
+    while (pair.getBusyThreads() < 2) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // round robin: even jobs go to the shard of worker 0, odd ones to the other
+    const auto now = std::chrono::steady_clock::now();
+    std::vector<int> order;
+    std::atomic<int> done(0);
+    for (int i = 0; i < 10; i++) {
+      pair.addJob(0, [&order, &done, i](std::size_t) {
+        order.push_back(i);
+        done += 1;
+      }, -1, now + std::chrono::seconds(60 - i));
+    }
+
+    release[0] = true;
+    while (done < 10) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    release[1] = true;
+    pair.waitAll();
+
+    ASSERT_EQ(order, std::vector<int>({9, 8, 7, 6, 5, 4, 3, 2, 1, 0}));
+  }
+
+  TEST(ThreadPoolAgingTest, LowPriorityIsNotStarved) {
+    // jobs of priority 0 wait 30ms, then jobs of priority 1 come
+    auto order = [](const std::size_t& agingMs) {
+      ThreadPool single(1, 100);
+      single.setAging(agingMs);
+
+      std::atomic<bool> release(false);
+      single.addJob(0, [&release](std::size_t) {
+        while (!release) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+      });
+      while (single.getBusyThreads() == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+
+      std::vector<int> order;
+      for (int i = 0; i < 3; i++) {
+        single.addJob(0, [&order, i](std::size_t) { order.push_back(i); });
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(30));
+      for (int i = 10; i < 13; i++) {
+        single.addJob(1, [&order, i](std::size_t) { order.push_back(i); });
+      }
+
+      release = true;
+      single.waitAll();
+
+      auto levels = single.getLevels();
+      EXPECT_EQ(levels.size(), 2);
+      EXPECT_EQ(levels[0].queued, 0);
+      EXPECT_EQ(levels[0].waitUs.count, 4);
+      EXPECT_GE(levels[0].waitUs.max, 30000);
+      return order;
+    };
+
+    // strict priorities, first in first out within a level
+    ASSERT_EQ(order(0), std::vector<int>({10, 11, 12, 0, 1, 2}));
+    // 30ms of wait is worth more than one level
+    ASSERT_EQ(order(10), std::vector<int>({0, 1, 2, 10, 11, 12}));
+  }
+
+  TEST(ThreadPoolAgingTest, AgingAndArrivalOrderAcrossShards) {
+    // jobs of priority 0 wait 30ms, then jobs of priority 1 come,
+    // both spread over the shards of two workers
+    auto order = [](const std::size_t& agingMs) {
+      ThreadPool pair(2, 100);
+      pair.setAging(agingMs);
+
+      // every worker is held by its own job, then worker 0 is released
+      std::atomic<bool> release[2] = {{false}, {false}};
+      for (int i = 0; i < 2; i++) {
+        pair.addJob(0, [&release](std::size_t threadNum) {
+          while (!release[threadNum]) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+          }
+        });
+      }
+      while (pair.getBusyThreads() < 2) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+
+      // round robin: even jobs go to the shard of worker 0, odd ones to the other
+      std::vector<int> order;
+      std::atomic<int> done(0);
+      for (int i = 0; i < 4; i++) {
+        pair.addJob(0, [&order, &done, i](std::size_t) {
+          order.push_back(i);
+          done += 1;
+        });
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(30));
+      for (int i = 10; i < 14; i++) {
+        pair.addJob(1, [&order, &done, i](std::size_t) {
+          order.push_back(i);
+          done += 1;
+        });
+      }
+
+      release[0] = true;
+      while (done < 8) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      release[1] = true;
+      pair.waitAll();
+      return order;
+    };
+
+    // strict priorities, first in first out within a level
+    ASSERT_EQ(order(0), std::vector<int>({10, 11, 12, 13, 0, 1, 2, 3}));
+    // 30ms of wait is worth more than one level
+    ASSERT_EQ(order(10), std::vector<int>({0, 1, 2, 3, 10, 11, 12, 13}));
+  }
+
+  TEST(ThreadPoolStealingTest, JobsOfIdleGroupAreStolen) {
+    // workers 2 and 3 of group 1 are not started, their shards get the jobs
+    ThreadPool grouped(2, 1000, std::vector<int>(), 0, std::vector<int>({0, 0, 1, 1}));
+
+    std::atomic<int> done(0);
+    for (int i = 0; i < 100; i++) {
+      ASSERT_TRUE(grouped.addJob(i % 2, [&done](std::size_t threadNum) {
+        if (threadNum < 2) {
+          done += 1;
+        }
+      }, 1));
+    }
+
+    grouped.waitAll();
+
+    ASSERT_EQ(done, 100);
+    ASSERT_EQ(grouped.getJobsStolen(), 100);
+  }
+
+  TEST(JournalTest, ReplayKeepsLiveEntries) {
+    auto path = fs::temp_directory_path() / "v8runner_journal_test";
+    fs::remove(path);
+
+    {
+      Journal journal(path);
+      ASSERT_EQ(journal.open().size(), 0);
+
+      journal.appendCompile("conv", "node", "(function(data) { return data; })", "cache");
+      journal.appendCompile("conv", "node1", "(function(data) { return 1; })", "");
+      journal.appendCompile("conv1", "node", "(function(data) { return 2; })", "");
+      journal.appendRemove("conv", "node1");
+      journal.appendCompile("conv", "node", "(function(data) { return 3; })", "");
+    }
+
+    Journal journal(path);
+    auto entries = journal.open();
+
+    ASSERT_EQ(entries.size(), 2);
+    ASSERT_EQ(entries[0].conv, "conv");
+    ASSERT_EQ(entries[0].node, "node");
+    ASSERT_EQ(entries[0].src, "(function(data) { return 3; })");
+    ASSERT_EQ(entries[1].conv, "conv1");
+    ASSERT_EQ(journal.liveCount(), 2);
+
+    fs::remove(path);
+  }
+
+  TEST(JournalTest, FailedCompactionKeepsJournal) {
+    auto path = fs::temp_directory_path() / "v8runner_journal_compact_test";
+    auto tmpPath = path;
+    tmpPath += ".tmp";
+    fs::remove(path);
+    fs::remove_all(tmpPath);
+
+    std::size_t appended = 0;
+    auto append = [&appended](Journal& journal, std::size_t count) {
+      for (std::size_t i = 0; i < count; i++) {
+        journal.appendCompile("conv", "node", "(function(data) { return " + std::to_string(appended++) + "; })", "");
+      }
+    };
+
+    {
+      Journal journal(path);
+      journal.open();
+
+      // the compacted copy can not be written
+      fs::create_directory(tmpPath);
+      append(journal, Journal::COMPACT_MIN_RECORDS + 2);
+      ASSERT_EQ(journal.compactionsCount(), 0);
+      ASSERT_EQ(journal.liveCount(), 1);
+
+      fs::remove_all(tmpPath);
+      append(journal, Journal::COMPACT_MIN_RECORDS);
+      ASSERT_EQ(journal.compactionsCount(), 1);
+    }
+
+    Journal journal(path);
+    auto entries = journal.open();
+
+    ASSERT_EQ(entries.size(), 1);
+    ASSERT_EQ(entries[0].src, "(function(data) { return " + std::to_string(appended - 1) + "; })");
+
+    fs::remove(path);
+  }
+
+  TEST(ResultCacheTest, EvictsWithinBudgetAndExpires) {
+    // one shard, room for a few entries of ~200 bytes
+    ResultCache cache(1024, 1);
+    std::string result;
+
+    cache.put("conv", "node", "in", "out");
+    ASSERT_FALSE(cache.get("conv", "node", "in", result));
+
+    cache.enable("conv", "node", 0);
+    for (int i = 0; i < 10; i++) {
+      cache.put("conv", "node", std::to_string(i), "out" + std::to_string(i));
+      // keeps the first input the most recently used
+      ASSERT_TRUE(cache.get("conv", "node", "0", result));
+    }
+
+    auto statistics = cache.statistics();
+    ASSERT_GT(statistics.evictions, 0);
+    ASSERT_LE(statistics.bytes, 1024);
+    ASSERT_TRUE(cache.get("conv", "node", "0", result));
+    ASSERT_EQ(result, "out0");
+    ASSERT_TRUE(cache.get("conv", "node", "9", result));
+    ASSERT_FALSE(cache.get("conv", "node", "1", result));
+
+    cache.invalidate("conv", "node");
+    ASSERT_FALSE(cache.get("conv", "node", "0", result));
+    ASSERT_TRUE(cache.enabled("conv", "node"));
+
+    cache.enable("conv", "node1", 1);
+    cache.put("conv", "node1", "in", "out");
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    ASSERT_FALSE(cache.get("conv", "node1", "in", result));
+    ASSERT_EQ(cache.statistics().expired, 1);
+
+    cache.disable("conv", "node");
+    cache.put("conv", "node", "in", "out");
+    ASSERT_EQ(cache.statistics().entries, 0);
+  }
+
+  RunKey makeRunKey(const std::string& conv, const std::string& node, const std::string& input) {
+    auto buffer = [](const std::string& s) {
+      return RunKey::Buffer(strdup(s.c_str()), free);
+    };
+    return RunKey(buffer(conv), buffer(node), buffer(input));
+  }
+
+  TEST(InFlightRunsTest, DuplicatesGetTheReplyOfTheFirstRun) {
+    InFlightRuns<int> runs;
+    const std::string input(4096, 'x');
+
+    // keys are compared by content, not by their buffers
+    ASSERT_TRUE(runs.attach(makeRunKey("conv", "node", input), 0));
+    ASSERT_FALSE(runs.attach(makeRunKey("conv", "node", input), 1));
+    ASSERT_FALSE(runs.attach(makeRunKey("conv", "node", input), 2));
+    ASSERT_TRUE(runs.attach(makeRunKey("conv", "node", input + "y"), 3));
+    // the same bytes split differently are another run
+    ASSERT_TRUE(runs.attach(makeRunKey("con", "vnode", input), 4));
+    ASSERT_EQ(runs.size(), 3);
+
+    auto waiters = runs.complete(makeRunKey("conv", "node", input));
+    ASSERT_EQ(waiters, std::vector<int>({1, 2}));
+    ASSERT_EQ(runs.size(), 2);
+    ASSERT_TRUE(runs.complete(makeRunKey("conv", "node", input + "y")).empty());
+    ASSERT_TRUE(runs.complete(makeRunKey("con", "vnode", input)).empty());
+    ASSERT_EQ(runs.size(), 0);
+
+    // a run after the reply is executed again
+    ASSERT_TRUE(runs.attach(makeRunKey("conv", "node", input), 5));
+
+    auto statistics = runs.statistics();
+    ASSERT_EQ(statistics.runs, 6);
+    ASSERT_EQ(statistics.coalesced, 2);
+  }
+
+  TEST(InFlightRunsTest, RejectedRunIsCleanedUp) {
+    InFlightRuns<int> runs;
+    auto key = makeRunKey("conv", "node", "in");
+
+    // the pool rejected the first run before any duplicate came
+    ASSERT_TRUE(runs.attach(key, 0));
+    ASSERT_TRUE(runs.complete(key).empty());
+    ASSERT_EQ(runs.size(), 0);
+
+    ASSERT_TRUE(runs.attach(key, 1));
+    ASSERT_EQ(runs.statistics().coalesced, 0);
+  }
+
+  TEST(InFlightRunsTest, FanOutToEveryWaiter) {
+    InFlightRuns<int> runs;
+    const int threadsCount = 8;
+    const int attachesCount = 1000;
+
+    ASSERT_TRUE(runs.attach(makeRunKey("conv", "node", "in"), -1));
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadsCount; t++) {
+      threads.emplace_back([&runs, t]() {
+        for (int i = 0; i < attachesCount; i++) {
+          runs.attach(makeRunKey("conv", "node", "in"), t * attachesCount + i);
+        }
+      });
+    }
+    for (auto& thread: threads) {
+      thread.join();
+    }
+
+    auto waiters = runs.complete(makeRunKey("conv", "node", "in"));
+    std::sort(waiters.begin(), waiters.end());
+    ASSERT_EQ(waiters.size(), threadsCount * attachesCount);
+    for (int i = 0; i < threadsCount * attachesCount; i++) {
+      ASSERT_EQ(waiters[i], i);
+    }
+    ASSERT_EQ(runs.size(), 0);
+    ASSERT_EQ(runs.statistics().coalesced, threadsCount * attachesCount);
+  }
+
+  TEST(LibCacheTest, ReloadKeepsOldFileAlive) {
+    const auto dir = fs::temp_directory_path() / "v8runner_libcache_test";
+    fs::remove_all(dir);
+    fs::create_directories(dir / "libs");
+
+    std::ofstream(dir / "libs" / "lib.js") << "var a = 1;";
+
+    LibCache libs;
+    ASSERT_EQ(libs.load(dir), 1);
+
+    auto old = libs.get("libs/lib.js");
+    ASSERT_TRUE(old != nullptr);
+    ASSERT_TRUE(old->isOneByte());
+
+    std::ofstream(dir / "libs" / "lib.tmp") << "var a = \"\xc3\xa9\";";
+    fs::rename(dir / "libs" / "lib.tmp", dir / "libs" / "lib.js");
+
+    libs.reload("libs/lib.js");
+
+    auto current = libs.get("libs/lib.js");
+    ASSERT_FALSE(current->isOneByte());
+    ASSERT_EQ(std::string(old->data(), old->size()), "var a = 1;");
+    ASSERT_THROW(libs.reload("libs/none.js"), std::runtime_error);
+
+    fs::remove_all(dir);
+  }
+
+  TEST(LibCacheTest, InPlaceRewriteDoesNotChangeLoadedFile) {
+    const auto dir = fs::temp_directory_path() / "v8runner_libcache_rewrite_test";
+    fs::remove_all(dir);
+    fs::create_directories(dir / "libs");
+
+    const std::string src(64 * 1024, 'a');
+    std::ofstream(dir / "libs" / "lib.js") << src;
+
+    LibCache libs;
+    ASSERT_EQ(libs.load(dir), 1);
+
+    auto old = libs.get("libs/lib.js");
+
+    // truncated and written again in place, as `cp` or an editor does
+    std::ofstream(dir / "libs" / "lib.js", std::ios::trunc) << "var b = 2;";
+
+    ASSERT_EQ(std::string(old->data(), old->size()), src);
+
+    libs.reload("libs/lib.js");
+    auto current = libs.get("libs/lib.js");
+    ASSERT_EQ(std::string(current->data(), current->size()), "var b = 2;");
+    ASSERT_EQ(std::string(old->data(), old->size()), src);
+
+    fs::remove_all(dir);
+  }
+
 } // namespace
 
 int main(int argc, char** argv) {
@@ -613,6 +1779,11 @@ int main(int argc, char** argv) {
   const std::size_t maxRAMAvailable = std::stoi(argv[2]);
   const std::size_t maxThreadpoolQueueSize = std::stoi(argv[3]);
 
+  // optional 4th argument: 1 - run the same tests with thread isolates
+  const auto isolateMode = argc > 4 && strcmp(argv[4], "1") == 0
+    ? pb::V8Runner::THREAD_ISOLATES
+    : pb::V8Runner::CONV_ISOLATES;
+
   pb::v8 = std::make_unique<pb::V8Runner>(
     argc,
     argv,
@@ -620,7 +1791,11 @@ int main(int argc, char** argv) {
     maxExecutionTime,
     maxRAMAvailable,
     timeCheckerSleepTime,
-    threadsCount
+    threadsCount,
+    pb::V8Platform::Options(),
+    nullptr,
+    0,
+    isolateMode
   );
 
   pb::pool = std::make_unique<ThreadPool>(threadsCount, maxThreadpoolQueueSize);